@@ -0,0 +1,82 @@
+#!/bin/bash
+
+# Bash script which measures dji_irp_omp throughput from 1 to N worker threads.
+#
+# @Copyright (c) 2020-2023 DJI. All rights reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# Usage : bench_scaling.sh [file count] [max threads] [action] [source directory]
+#         The R-JPEG files of the source directory (default: the repository assets, one
+#         camera) are replicated to file count inputs, the way a single flight looks.
+#         DJI_IRP_OMP=<path to dji_irp_omp> overrides the executable location.
+
+PROJ_PATH=$(dirname $(readlink -f "$0"))/
+
+FILE_COUNT=${1:-3000}
+MAX_THREADS=${2:-$(nproc)}
+ACTION=${3:-measure}
+SOURCE_DIR=${4:-${PROJ_PATH}../../assets}
+
+BIN=${DJI_IRP_OMP:-${PROJ_PATH}build/Release_x64/dji_irp_omp}
+export LD_LIBRARY_PATH=${PROJ_PATH}../tsdk-core/lib/linux/release_x64:${LD_LIBRARY_PATH}
+
+if [ ! -x "${BIN}" ]; then
+    echo "ERROR: ${BIN} not found, run build.sh or set DJI_IRP_OMP"
+    exit 1
+fi
+
+WORK_DIR=$(mktemp -d)
+trap "rm -rf ${WORK_DIR}" EXIT
+mkdir ${WORK_DIR}/input ${WORK_DIR}/output
+
+echo "****************************************"
+echo "Replicate ${FILE_COUNT} R-JPEG files from ${SOURCE_DIR}"
+echo "****************************************"
+
+SOURCES=($(find ${SOURCE_DIR} -maxdepth 1 -type f -iname "*.jpg" | sort))
+if [ ${#SOURCES[@]} -eq 0 ]; then
+    echo "ERROR: no R-JPEG file found in ${SOURCE_DIR}"
+    exit 1
+fi
+for ((i=0; i<${FILE_COUNT}; i++)); do
+    cp "${SOURCES[$((i % ${#SOURCES[@]}))]}" ${WORK_DIR}/input/DJI_$(printf "%06d" $i)_T.JPG
+done
+
+echo "****************************************"
+echo "Run action ${ACTION} with 1..${MAX_THREADS} threads"
+echo "****************************************"
+
+THREADS=1
+BASE_RATE=
+while true; do
+    rm -f ${WORK_DIR}/output/*
+    RESULT=$(${BIN} -s ${WORK_DIR}/input/ -a ${ACTION} -o ${WORK_DIR}/output/out -t ${THREADS} | grep "^Processed")
+    RATE=$(echo ${RESULT} | sed -e 's/.*(\(.*\) files\/s).*/\1/')
+    BASE_RATE=${BASE_RATE:-${RATE}}
+    echo "threads ${THREADS} : ${RATE} files/s, speedup $(awk "BEGIN { printf \"%.2f\", ${RATE} / ${BASE_RATE} }")x"
+
+    if [ ${THREADS} -ge ${MAX_THREADS} ]; then
+        break
+    fi
+    THREADS=$((THREADS * 2))
+    if [ ${THREADS} -gt ${MAX_THREADS} ]; then
+        THREADS=${MAX_THREADS}
+    fi
+done
@@ -0,0 +1,96 @@
+#!/bin/bash
+
+# Bash script which compares request latency of dji_irp --serve with one dji_irp process per image.
+#
+# @Copyright (c) 2020-2023 DJI. All rights reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# Usage : bench_serve.sh [request count] [source directory]
+#         DJI_IRP=<path to dji_irp> overrides the executable location.
+#         The client is serve_request of main.py, so its Python requirements must be installed.
+
+PROJ_PATH=$(dirname $(readlink -f "$0"))/
+
+REQUEST_COUNT=${1:-200}
+SOURCE_DIR=$(readlink -f ${2:-${PROJ_PATH}../../assets})
+
+BIN=$(readlink -f ${DJI_IRP:-${PROJ_PATH}build/Release_x64/dji_irp})
+export LD_LIBRARY_PATH=${PROJ_PATH}../tsdk-core/lib/linux/release_x64:${LD_LIBRARY_PATH}
+
+if [ ! -x "${BIN}" ]; then
+    echo "ERROR: ${BIN} not found, run build.sh or set DJI_IRP"
+    exit 1
+fi
+
+WORK_DIR=$(mktemp -d)
+SOCKET=${WORK_DIR}/dji_irp.sock
+trap "kill \${SERVE_PID} 2>/dev/null; wait \${SERVE_PID} 2>/dev/null; rm -rf ${WORK_DIR}" EXIT
+
+${BIN} --serve ${SOCKET} -t 1 > ${WORK_DIR}/serve.log &
+SERVE_PID=$!
+while [ ! -S ${SOCKET} ]; do
+    sleep 0.1
+done
+
+echo "****************************************"
+echo "Measure ${REQUEST_COUNT} R-JPEG files of ${SOURCE_DIR} one at a time"
+echo "****************************************"
+
+cd ${PROJ_PATH}../.. && python3 - "${BIN}" "${SOCKET}" "${SOURCE_DIR}" "${REQUEST_COUNT}" "${WORK_DIR}" <<'EOF'
+import glob
+import os
+import subprocess
+import sys
+import time
+
+import numpy as np
+
+import main
+
+binary, socket_path, source_dir, count, work_dir = sys.argv[1], sys.argv[2], sys.argv[3], int(sys.argv[4]), sys.argv[5]
+files = sorted(glob.glob(os.path.join(source_dir, "*.JPG")) + glob.glob(os.path.join(source_dir, "*.jpg")))
+files = [files[i % len(files)] for i in range(count)]
+
+
+def report(name, latencies):
+    latencies = np.array(latencies) * 1000
+    print("%-16s : p50 %8.2f ms, p99 %8.2f ms, mean %8.2f ms" %
+          (name, np.percentile(latencies, 50), np.percentile(latencies, 99), latencies.mean()))
+
+
+latencies = []
+for path in files:
+    start = time.perf_counter()
+    subprocess.run([binary, "-s", path, "-a", "measure", "--measurefmt", "float32",
+                    "-o", os.path.join(work_dir, "out.raw")], stdout=subprocess.DEVNULL, check=True)
+    with open(os.path.join(work_dir, "out.raw"), "rb") as f:
+        f.read()
+    latencies.append(time.perf_counter() - start)
+report("exec per image", latencies)
+
+sock = main.serve_connect(socket_path)
+latencies = []
+for path in files:
+    start = time.perf_counter()
+    main.serve_request(sock, path)
+    latencies.append(time.perf_counter() - start)
+sock.close()
+report("dji_irp --serve", latencies)
+EOF
@@ -0,0 +1,333 @@
+/*
+ * Batched console logger of worker threads for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _BATCH_LOGGER_H_
+#define _BATCH_LOGGER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <sstream>
+#include <condition_variable>
+#include <algorithm>
+
+#define BATCH_LOGGER_RING_SIZE                  (64 << 10)  /* Bytes buffered per thread, a power of 2 */
+#define BATCH_LOGGER_DRAIN_MS                   (20)        /* Max age of a buffered line */
+#define BATCH_LOGGER_PROGRESS_MS                (250)       /* Refresh period of the quiet mode progress line */
+
+typedef enum
+{
+    batch_log_level_error = 0,
+    batch_log_level_warning,
+    batch_log_level_info,
+    batch_log_level_debug,
+    batch_log_level_num,
+} batch_log_level_e;
+
+/* Format message and queue it as one line, the arguments are not evaluated when the level is filtered out */
+#define BATCH_LOG(level, message) \
+            do \
+            { \
+                if (batch_logger::enabled(level)) \
+                { \
+                    std::ostringstream &batch_log_line = batch_logger::line_stream(); \
+                    batch_log_line << message; \
+                    batch_logger::instance().write(batch_log_line.str()); \
+                } \
+            } while (0)
+
+#define LOG_ERROR(message)                      BATCH_LOG(batch_log_level_error,   message)
+#define LOG_WARNING(message)                    BATCH_LOG(batch_log_level_warning, message)
+#define LOG_INFO(message)                       BATCH_LOG(batch_log_level_info,    message)
+#define LOG_DEBUG(message)                      BATCH_LOG(batch_log_level_debug,   message)
+
+/*
+ * Every thread writes finished lines into its own single producer ring, so logging takes no lock
+ * and never flushes. One drain thread collects the rings and writes them to stdout with one fwrite
+ * per batch; lines stay whole, only their order across threads is not kept.
+ * A producer that fills its ring waits for the drain thread instead of dropping lines.
+ * In quiet mode only errors and a progress line refreshed in place are printed.
+ * Before start() and after stop() lines are written directly.
+ */
+class batch_logger
+{
+public:
+    static batch_logger &instance(void)
+    {
+        static batch_logger logger;
+        return logger;
+    }
+
+    static bool enabled(batch_log_level_e level)
+    {
+        return (int32_t)level <= instance().m_level.load(std::memory_order_relaxed);
+    }
+
+    /* Per thread line formatter, reset for every line */
+    static std::ostringstream &line_stream(void)
+    {
+        static thread_local std::ostringstream line;
+        static thread_local std::ios::fmtflags flags = line.flags();
+
+        line.str(std::string());
+        line.clear();
+        line.flags(flags);
+        return line;
+    }
+
+    static bool parse_level(const std::string &name, batch_log_level_e *level, bool *quiet)
+    {
+        static const char *names[batch_log_level_num] = {"error", "warning", "info", "debug"};
+
+        *quiet = ("quiet" == name);
+        if (*quiet)
+        {
+            *level = batch_log_level_error;
+            return true;
+        }
+        for (int32_t i = 0; i < batch_log_level_num; i++)
+        {
+            if (name == names[i])
+            {
+                *level = (batch_log_level_e)i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void start(batch_log_level_e level, bool quiet)
+    {
+        m_level   = level;
+        m_quiet   = quiet;
+        m_running = true;
+        m_start   = std::chrono::steady_clock::now();
+        m_drainer = std::thread(&batch_logger::prv_drain_loop, this);
+    }
+
+    /* Write every queued line and the final progress line, then write directly again */
+    void stop(void)
+    {
+        if (!m_drainer.joinable())
+        {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_wake_mutex);
+            m_running = false;
+        }
+        m_wake.notify_one();
+        m_drainer.join();
+    }
+
+    void write(const std::string &line)
+    {
+        if (!m_running.load(std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> lock(m_rings_mutex);
+            fwrite(line.data(), 1, line.size(), stdout);
+            fputc('\n', stdout);
+            fflush(stdout);
+            return;
+        }
+
+        ring_t *ring = prv_thread_ring();
+        size_t size = std::min(line.size(), (size_t)BATCH_LOGGER_RING_SIZE - 1);
+        uint64_t head = ring->head.load(std::memory_order_relaxed);
+
+        while (head + size + 1 - ring->tail.load(std::memory_order_acquire) > BATCH_LOGGER_RING_SIZE)
+        {
+            m_wake.notify_one();
+            std::this_thread::yield();
+        }
+
+        prv_ring_copy_in(ring, head, line.data(), size);
+        prv_ring_copy_in(ring, head + size, "\n", 1);
+        ring->head.store(head + size + 1, std::memory_order_release);
+    }
+
+    /* Progress counters shown by the quiet mode */
+    void progress_found(void)
+    {
+        m_found.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void progress_done(bool failed)
+    {
+        m_done.fetch_add(1, std::memory_order_relaxed);
+        if (failed)
+        {
+            m_failed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    typedef struct
+    {
+        std::atomic<uint64_t>   head;               /* Written by the owner thread */
+        std::atomic<uint64_t>   tail;               /* Written by the drain thread */
+        char                    data[BATCH_LOGGER_RING_SIZE];
+    } ring_t;
+
+    batch_logger(void)
+    {
+    }
+
+    ~batch_logger(void)
+    {
+        stop();
+    }
+
+    ring_t *prv_thread_ring(void)
+    {
+        static thread_local ring_t *ring = nullptr;
+
+        if (nullptr == ring)
+        {
+            std::unique_ptr<ring_t> fresh(new ring_t);
+            fresh->head = 0;
+            fresh->tail = 0;
+            ring = fresh.get();
+
+            std::lock_guard<std::mutex> lock(m_rings_mutex);
+            m_rings.push_back(std::move(fresh));
+        }
+
+        return ring;
+    }
+
+    static void prv_ring_copy_in(ring_t *ring, uint64_t pos, const char *src, size_t size)
+    {
+        size_t offset = pos & (BATCH_LOGGER_RING_SIZE - 1);
+        size_t first  = std::min(size, (size_t)BATCH_LOGGER_RING_SIZE - offset);
+
+        memcpy(ring->data + offset, src, first);
+        memcpy(ring->data, src + first, size - first);
+    }
+
+    /* Append the complete lines queued in every ring to batch */
+    void prv_collect(std::string &batch)
+    {
+        std::lock_guard<std::mutex> lock(m_rings_mutex);
+
+        for (const std::unique_ptr<ring_t> &ring : m_rings)
+        {
+            uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            size_t offset = tail & (BATCH_LOGGER_RING_SIZE - 1);
+            size_t size   = (size_t)(head - tail);
+            size_t first  = std::min(size, (size_t)BATCH_LOGGER_RING_SIZE - offset);
+
+            batch.append(ring->data + offset, first);
+            batch.append(ring->data, size - first);
+            ring->tail.store(head, std::memory_order_release);
+        }
+    }
+
+    void prv_progress_line(std::string &batch)
+    {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+        uint64_t done  = m_done.load(std::memory_order_relaxed);
+        char line[160];
+
+        snprintf(line, sizeof(line), "\rProcessed %llu of %llu files, %llu failed, %.1f files/s   ",
+                 (unsigned long long)done, (unsigned long long)m_found.load(std::memory_order_relaxed),
+                 (unsigned long long)m_failed.load(std::memory_order_relaxed), (elapsed > 0) ? done / elapsed : 0.0);
+        batch += line;
+    }
+
+    void prv_drain_loop(void)
+    {
+        std::string batch;
+        std::string lines;
+        std::chrono::steady_clock::time_point progress_time = std::chrono::steady_clock::now();
+        bool progress_shown = false;
+        bool running = true;
+
+        while (running)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_wake_mutex);
+                m_wake.wait_for(lock, std::chrono::milliseconds(BATCH_LOGGER_DRAIN_MS));
+                running = m_running;
+            }
+
+            /* Lines queued before stop() are collected by the last round */
+            lines.clear();
+            prv_collect(lines);
+
+            batch.clear();
+            if (!lines.empty())
+            {
+                batch += progress_shown ? "\n" : "";
+                batch += lines;
+                progress_shown = false;
+            }
+            if (m_quiet && (!running ||
+                (std::chrono::steady_clock::now() - progress_time >= std::chrono::milliseconds(BATCH_LOGGER_PROGRESS_MS))))
+            {
+                prv_progress_line(batch);
+                batch += running ? "" : "\n";
+                progress_shown = running;
+                progress_time  = std::chrono::steady_clock::now();
+            }
+
+            if (!batch.empty())
+            {
+                fwrite(batch.data(), 1, batch.size(), stdout);
+                fflush(stdout);
+            }
+        }
+
+        m_running.store(false, std::memory_order_release);
+    }
+
+    std::atomic<int32_t>                    m_level {batch_log_level_debug};
+    std::atomic<bool>                       m_running {false};
+    bool                                    m_quiet = false;
+    std::chrono::steady_clock::time_point   m_start;
+    std::atomic<uint64_t>                   m_found {0};
+    std::atomic<uint64_t>                   m_done {0};
+    std::atomic<uint64_t>                   m_failed {0};
+
+    std::mutex                              m_rings_mutex;
+    std::vector<std::unique_ptr<ring_t>>    m_rings;
+
+    std::mutex                              m_wake_mutex;
+    std::condition_variable                 m_wake;
+    std::thread                             m_drainer;
+};
+
+#endif /* _BATCH_LOGGER_H_ */
@@ -0,0 +1,168 @@
+/*
+ * Bounded blocking queue for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _BOUNDED_QUEUE_H_
+#define _BOUNDED_QUEUE_H_
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/*
+ * Multi producer / multi consumer FIFO with a fixed capacity.
+ * push() blocks while the queue is full, try_push() returns instead, pop() blocks while it is empty.
+ * After close() producers are rejected and consumers drain the remaining items.
+ */
+template <typename T>
+class bounded_queue
+{
+public:
+    explicit bounded_queue(size_t capacity)
+        : m_capacity(capacity < 1 ? 1 : capacity)
+    {
+    }
+
+    bool push(T &&item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_items.size() >= m_capacity)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            m_not_full.wait(lock, [this] { return m_closed || (m_items.size() < m_capacity); });
+            m_blocked += std::chrono::steady_clock::now() - start;
+        }
+        if (m_closed)
+        {
+            return false;
+        }
+
+        m_items.push_back(std::move(item));
+        m_pushes++;
+        m_depth_sum += m_items.size();
+        if (m_items.size() > m_depth_max)
+        {
+            m_depth_max = m_items.size();
+        }
+        lock.unlock();
+
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    /* Non blocking push, false when the queue is full or closed and the item is left with the caller */
+    bool try_push(T &&item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_closed || (m_items.size() >= m_capacity))
+        {
+            return false;
+        }
+
+        m_items.push_back(std::move(item));
+        m_pushes++;
+        m_depth_sum += m_items.size();
+        if (m_items.size() > m_depth_max)
+        {
+            m_depth_max = m_items.size();
+        }
+        lock.unlock();
+
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_empty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+        if (m_items.empty())
+        {
+            return false;
+        }
+
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        lock.unlock();
+
+        m_not_full.notify_one();
+        return true;
+    }
+
+    void close(void)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_not_empty.notify_all();
+        m_not_full.notify_all();
+    }
+
+    size_t capacity(void) const
+    {
+        return m_capacity;
+    }
+
+    /* Largest queue depth observed right after a push */
+    size_t depth_max(void)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_depth_max;
+    }
+
+    /* Mean queue depth observed right after each push */
+    double depth_mean(void)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return (m_pushes > 0) ? (double)m_depth_sum / m_pushes : 0.0;
+    }
+
+    /* Total time producers spent waiting for a free slot, in seconds */
+    double blocked_seconds(void)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return std::chrono::duration<double>(m_blocked).count();
+    }
+
+private:
+    const size_t                        m_capacity;
+    std::deque<T>                       m_items;
+    bool                                m_closed = false;
+
+    std::mutex                          m_mutex;
+    std::condition_variable             m_not_empty;
+    std::condition_variable             m_not_full;
+
+    uint64_t                            m_pushes = 0;
+    uint64_t                            m_depth_sum = 0;
+    size_t                              m_depth_max = 0;
+    std::chrono::steady_clock::duration m_blocked {0};
+};
+
+#endif /* _BOUNDED_QUEUE_H_ */
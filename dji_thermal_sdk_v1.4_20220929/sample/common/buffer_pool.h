@@ -0,0 +1,242 @@
+/*
+ * Size-classed buffer pool for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _BUFFER_POOL_H_
+#define _BUFFER_POOL_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+#define BUFFER_POOL_CLASS_SHIFT                 (16)        /* 64 KB size classes */
+#define BUFFER_POOL_LOCAL_DEPTH                 (2)         /* Buffers per class kept by one thread */
+
+/*
+ * Recycles byte buffers of the same size class across files.
+ * Frames of one resolution always map to the same class, so after the first few files
+ * every acquire() is served from the pool and no fresh pages are faulted in.
+ *
+ * Each thread bound with bind_thread() owns a small cache which is used without locking.
+ * Buffers a thread releases beyond that cache, and buffers a thread misses locally,
+ * go through the shared cache. This keeps producer/consumer hand-offs, like the
+ * read -> process -> write pipeline, balanced.
+ * The pool keeps at most max_bytes of idle buffers, the rest are freed on release().
+ */
+class buffer_pool
+{
+public:
+    typedef std::vector<uint8_t> buffer_t;
+
+    buffer_pool(int32_t num_threads, uint64_t max_bytes)
+        : m_local(num_threads < 1 ? 1 : num_threads), m_max_bytes(max_bytes)
+    {
+        for (size_t i = 0; i < m_local.size(); i++)
+        {
+            m_local[i].reset(new class_map_t());
+        }
+    }
+
+    /* Bind the calling thread to a local cache, index in [0, num_threads) */
+    static void bind_thread(int32_t index)
+    {
+        thread_index() = index;
+    }
+
+    /* Replace buf with a pooled buffer holding size bytes, the content is undefined */
+    void acquire(size_t size, buffer_t &buf)
+    {
+        size_t size_class = (size + ((size_t)1 << BUFFER_POOL_CLASS_SHIFT) - 1) >> BUFFER_POOL_CLASS_SHIFT;
+        bool hit = false;
+
+        m_acquires++;
+        if ((buf.capacity() >> BUFFER_POOL_CLASS_SHIFT) == size_class)
+        {
+            hit = true;                                 /* Caller already holds a buffer of this class */
+        }
+        else
+        {
+            release(buf);
+
+            class_map_t *local = local_cache();
+            hit = local && take(*local, size_class, buf);
+            if (!hit)
+            {
+                std::lock_guard<std::mutex> lock(m_shared_mutex);
+                hit = take(m_shared, size_class, buf);
+            }
+            if (!hit)
+            {
+                buf.reserve(size_class << BUFFER_POOL_CLASS_SHIFT);
+            }
+        }
+
+        if (hit)
+        {
+            m_hits++;
+        }
+        buf.resize(size);
+    }
+
+    /* Give buf back to the pool, buf is left empty */
+    void release(buffer_t &buf)
+    {
+        size_t size_class = buf.capacity() >> BUFFER_POOL_CLASS_SHIFT;
+        if (0 == size_class)
+        {
+            buffer_t().swap(buf);
+            return;
+        }
+
+        uint64_t bytes = (uint64_t)size_class << BUFFER_POOL_CLASS_SHIFT;
+        uint64_t idle = m_idle_bytes.fetch_add(bytes) + bytes;
+        if (idle > m_max_bytes)
+        {
+            m_idle_bytes -= bytes;
+            buffer_t().swap(buf);
+            return;
+        }
+        update_peak(idle);
+
+        class_map_t *local = local_cache();
+        if (local && ((*local)[size_class].size() < BUFFER_POOL_LOCAL_DEPTH))
+        {
+            put(*local, size_class, buf);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_shared_mutex);
+        put(m_shared, size_class, buf);
+    }
+
+    uint64_t acquire_count(void) const
+    {
+        return m_acquires.load();
+    }
+
+    /* Share of acquire() calls served without a fresh allocation */
+    double hit_rate(void) const
+    {
+        uint64_t acquires = m_acquires.load();
+        return (acquires > 0) ? (double)m_hits.load() / acquires : 0.0;
+    }
+
+    /* Largest amount of idle memory held by the pool, in bytes */
+    uint64_t peak_idle_bytes(void) const
+    {
+        return m_peak_idle_bytes.load();
+    }
+
+    /* Peak resident set size of the whole process, in bytes */
+    static uint64_t peak_rss_bytes(void)
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            return (uint64_t)counters.PeakWorkingSetSize;
+        }
+        return 0;
+#else
+        struct rusage usage;
+        if (0 == getrusage(RUSAGE_SELF, &usage))
+        {
+            return (uint64_t)usage.ru_maxrss * 1024;    /* Linux reports KB */
+        }
+        return 0;
+#endif
+    }
+
+private:
+    typedef std::map<size_t, std::vector<buffer_t> > class_map_t;
+
+    static int32_t &thread_index(void)
+    {
+        static thread_local int32_t index = -1;
+        return index;
+    }
+
+    class_map_t *local_cache(void)
+    {
+        int32_t index = thread_index();
+        return ((index >= 0) && (index < (int32_t)m_local.size())) ? m_local[index].get() : nullptr;
+    }
+
+    bool take(class_map_t &cache, size_t size_class, buffer_t &buf)
+    {
+        class_map_t::iterator it = cache.find(size_class);
+        if ((cache.end() == it) || it->second.empty())
+        {
+            return false;
+        }
+
+        buf.swap(it->second.back());
+        it->second.pop_back();
+        m_idle_bytes -= (uint64_t)size_class << BUFFER_POOL_CLASS_SHIFT;
+        return true;
+    }
+
+    void put(class_map_t &cache, size_t size_class, buffer_t &buf)
+    {
+        std::vector<buffer_t> &list = cache[size_class];
+        list.push_back(buffer_t());
+        list.back().swap(buf);
+    }
+
+    void update_peak(uint64_t idle)
+    {
+        uint64_t peak = m_peak_idle_bytes.load();
+        while ((idle > peak) && !m_peak_idle_bytes.compare_exchange_weak(peak, idle))
+        {
+        }
+    }
+
+    std::vector<std::unique_ptr<class_map_t> >  m_local;
+    class_map_t                                 m_shared;
+    std::mutex                                  m_shared_mutex;
+
+    const uint64_t                              m_max_bytes;
+    std::atomic<uint64_t>                       m_idle_bytes {0};
+    std::atomic<uint64_t>                       m_peak_idle_bytes {0};
+    std::atomic<uint64_t>                       m_acquires {0};
+    std::atomic<uint64_t>                       m_hits {0};
+};
+
+#endif /* _BUFFER_POOL_H_ */
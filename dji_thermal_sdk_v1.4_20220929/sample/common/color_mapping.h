@@ -0,0 +1,198 @@
+/*
+ * Pseudo color LUT mapping kernels for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _COLOR_MAPPING_H_
+#define _COLOR_MAPPING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "dirp_api.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COLOR_MAPPING_X86
+#define COLOR_MAPPING_TARGET(isa)               __attribute__((target(isa)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define COLOR_MAPPING_X86
+#define COLOR_MAPPING_TARGET(isa)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+/* Bytes past width * height * 3 the RGB frame must provide, vector stores write 16 bytes for 12 */
+#define COLOR_MAPPING_FRAME_PADDING             (16)
+
+typedef enum
+{
+    color_mapping_isa_scalar = 0,
+    color_mapping_isa_sse41,
+    color_mapping_isa_avx2,
+    color_mapping_isa_num,
+} color_mapping_isa_e;
+
+/*
+ * Maps a FLOAT32 stretch image to RGB888 through one pseudo color LUT of the SDK.
+ * Pixels in [0, 256] take LUT entry min(floor(value), 255), every other value, NaN included, is black.
+ * The three LUT channels are interleaved into one 32-bit entry per index, so the vector kernels
+ * gather a whole RGB triplet with one load and shuffle triplets together into the output.
+ */
+class color_mapping
+{
+public:
+    color_mapping(const uint8_t *lut_r, const uint8_t *lut_g, const uint8_t *lut_b)
+    {
+        for (int32_t i = 0; i < DIRP_PSEUDO_COLOR_LUT_DEPTH; i++)
+        {
+            m_lut[i] = (uint32_t)lut_r[i] | ((uint32_t)lut_g[i] << 8) | ((uint32_t)lut_b[i] << 16);
+        }
+    }
+
+    /* Map count pixels of src into rgb, which holds count * 3 + COLOR_MAPPING_FRAME_PADDING bytes */
+    void map(const float *src, size_t count, uint8_t *rgb, color_mapping_isa_e isa) const
+    {
+        size_t done = 0;
+#ifdef COLOR_MAPPING_X86
+        if (color_mapping_isa_avx2 == isa)
+        {
+            done = map_avx2(src, count, rgb);
+        }
+        else if (color_mapping_isa_sse41 == isa)
+        {
+            done = map_sse41(src, count, rgb);
+        }
+#else
+        (void)isa;
+#endif
+        map_scalar(src + done, count - done, rgb + done * 3);
+    }
+
+    /* Widest kernel the running CPU supports */
+    static color_mapping_isa_e best_isa(void)
+    {
+#if defined(COLOR_MAPPING_X86) && defined(__GNUC__)
+        if (__builtin_cpu_supports("avx2"))     return color_mapping_isa_avx2;
+        if (__builtin_cpu_supports("sse4.1"))   return color_mapping_isa_sse41;
+#elif defined(COLOR_MAPPING_X86)
+        int32_t info[4];
+        __cpuid(info, 0);
+        int32_t max_leaf = info[0];
+        __cpuid(info, 1);
+        bool sse41 = (0 != (info[2] & (1 << 19)));
+        bool avx   = (0 != (info[2] & (1 << 27))) && (0 != (info[2] & (1 << 28))) && (6 == (_xgetbv(0) & 6));
+        if (avx && (max_leaf >= 7))
+        {
+            __cpuidex(info, 7, 0);
+            if (info[1] & (1 << 5))             return color_mapping_isa_avx2;
+        }
+        if (sse41)                              return color_mapping_isa_sse41;
+#endif
+        return color_mapping_isa_scalar;
+    }
+
+    static const char *isa_name(color_mapping_isa_e isa)
+    {
+        static const char *names[color_mapping_isa_num] = {"scalar", "sse4.1", "avx2"};
+        return ((isa >= 0) && (isa < color_mapping_isa_num)) ? names[isa] : "unknown";
+    }
+
+private:
+    void map_scalar(const float *src, size_t count, uint8_t *rgb) const
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t color = 0;
+            if ((src[i] >= 0.0f) && (src[i] <= 256.0f))
+            {
+                int32_t index = (int32_t)src[i];
+                color = m_lut[(index < DIRP_PSEUDO_COLOR_LUT_DEPTH) ? index : DIRP_PSEUDO_COLOR_LUT_DEPTH - 1];
+            }
+            rgb[i * 3 + 0] = (uint8_t)(color);
+            rgb[i * 3 + 1] = (uint8_t)(color >> 8);
+            rgb[i * 3 + 2] = (uint8_t)(color >> 16);
+        }
+    }
+
+#ifdef COLOR_MAPPING_X86
+    /* Truncation equals floor() for the non-negative values kept, out of range lanes read entry 0 */
+    COLOR_MAPPING_TARGET("sse4.1")
+    size_t map_sse41(const float *src, size_t count, uint8_t *rgb) const
+    {
+        const __m128  lower   = _mm_setzero_ps();
+        const __m128  upper   = _mm_set1_ps(256.0f);
+        const __m128i max_idx = _mm_set1_epi32(DIRP_PSEUDO_COLOR_LUT_DEPTH - 1);
+        const __m128i pack    = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128  value = _mm_loadu_ps(src + i);
+            __m128i valid = _mm_castps_si128(_mm_and_ps(_mm_cmpge_ps(value, lower), _mm_cmple_ps(value, upper)));
+            __m128i index = _mm_and_si128(_mm_min_epi32(_mm_cvttps_epi32(value), max_idx), valid);
+
+            __m128i color = _mm_setr_epi32((int32_t)m_lut[_mm_extract_epi32(index, 0)],
+                                           (int32_t)m_lut[_mm_extract_epi32(index, 1)],
+                                           (int32_t)m_lut[_mm_extract_epi32(index, 2)],
+                                           (int32_t)m_lut[_mm_extract_epi32(index, 3)]);
+            color = _mm_shuffle_epi8(_mm_and_si128(color, valid), pack);
+            _mm_storeu_si128((__m128i *)(rgb + i * 3), color);
+        }
+
+        return i;
+    }
+
+    COLOR_MAPPING_TARGET("avx2")
+    size_t map_avx2(const float *src, size_t count, uint8_t *rgb) const
+    {
+        const __m256  lower   = _mm256_setzero_ps();
+        const __m256  upper   = _mm256_set1_ps(256.0f);
+        const __m256i max_idx = _mm256_set1_epi32(DIRP_PSEUDO_COLOR_LUT_DEPTH - 1);
+        const __m256i pack    = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                                 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256  value = _mm256_loadu_ps(src + i);
+            __m256i valid = _mm256_castps_si256(_mm256_and_ps(_mm256_cmp_ps(value, lower, _CMP_GE_OQ),
+                                                              _mm256_cmp_ps(value, upper, _CMP_LE_OQ)));
+            __m256i index = _mm256_and_si256(_mm256_min_epi32(_mm256_cvttps_epi32(value), max_idx), valid);
+
+            __m256i color = _mm256_i32gather_epi32((const int *)m_lut, index, 4);
+            color = _mm256_shuffle_epi8(_mm256_and_si256(color, valid), pack);
+            _mm_storeu_si128((__m128i *)(rgb + i * 3), _mm256_castsi256_si128(color));
+            _mm_storeu_si128((__m128i *)(rgb + i * 3 + 12), _mm256_extracti128_si256(color, 1));
+        }
+
+        return i;
+    }
+#endif
+
+    uint32_t m_lut[DIRP_PSEUDO_COLOR_LUT_DEPTH];
+};
+
+#endif /* _COLOR_MAPPING_H_ */
@@ -0,0 +1,144 @@
+/*
+ * Fast non-cryptographic content hash for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _CONTENT_HASH_H_
+#define _CONTENT_HASH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define CONTENT_HASH_PRIME1                     (11400714785074694791ULL)
+#define CONTENT_HASH_PRIME2                     (14029467366897019727ULL)
+#define CONTENT_HASH_PRIME3                     (1609587929392839161ULL)
+#define CONTENT_HASH_PRIME4                     (9650029242287828579ULL)
+#define CONTENT_HASH_PRIME5                     (2870177450012600261ULL)
+
+/*
+ * 64-bit XXH64 hash, hashes data at memory bandwidth on one core.
+ * Used to recognise unchanged inputs, not as a defence against crafted collisions.
+ */
+class content_hash
+{
+public:
+    static uint64_t hash64(const void *data, size_t size, uint64_t seed)
+    {
+        const uint8_t *p   = (const uint8_t *)data;
+        const uint8_t *end = p + size;
+        uint64_t h = 0;
+
+        if (size >= 32)
+        {
+            uint64_t v1 = seed + CONTENT_HASH_PRIME1 + CONTENT_HASH_PRIME2;
+            uint64_t v2 = seed + CONTENT_HASH_PRIME2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - CONTENT_HASH_PRIME1;
+
+            do
+            {
+                v1 = round(v1, read64(p));
+                v2 = round(v2, read64(p + 8));
+                v3 = round(v3, read64(p + 16));
+                v4 = round(v4, read64(p + 24));
+                p += 32;
+            } while (p + 32 <= end);
+
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = merge(h, v1);
+            h = merge(h, v2);
+            h = merge(h, v3);
+            h = merge(h, v4);
+        }
+        else
+        {
+            h = seed + CONTENT_HASH_PRIME5;
+        }
+
+        h += (uint64_t)size;
+
+        for (; p + 8 <= end; p += 8)
+        {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * CONTENT_HASH_PRIME1 + CONTENT_HASH_PRIME4;
+        }
+        if (p + 4 <= end)
+        {
+            h ^= (uint64_t)read32(p) * CONTENT_HASH_PRIME1;
+            h = rotl(h, 23) * CONTENT_HASH_PRIME2 + CONTENT_HASH_PRIME3;
+            p += 4;
+        }
+        for (; p < end; p++)
+        {
+            h ^= (*p) * CONTENT_HASH_PRIME5;
+            h = rotl(h, 11) * CONTENT_HASH_PRIME1;
+        }
+
+        h ^= h >> 33;
+        h *= CONTENT_HASH_PRIME2;
+        h ^= h >> 29;
+        h *= CONTENT_HASH_PRIME3;
+        h ^= h >> 32;
+
+        return h;
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static uint64_t round(uint64_t acc, uint64_t input)
+    {
+        acc += input * CONTENT_HASH_PRIME2;
+        acc  = rotl(acc, 31);
+        return acc * CONTENT_HASH_PRIME1;
+    }
+
+    static uint64_t merge(uint64_t acc, uint64_t v)
+    {
+        acc ^= round(0, v);
+        return acc * CONTENT_HASH_PRIME1 + CONTENT_HASH_PRIME4;
+    }
+
+    /* Little endian loads, all supported targets are little endian */
+    static uint64_t read64(const uint8_t *p)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static uint32_t read32(const uint8_t *p)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+};
+
+#endif /* _CONTENT_HASH_H_ */
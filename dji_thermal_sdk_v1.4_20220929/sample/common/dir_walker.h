@@ -0,0 +1,279 @@
+/*
+ * Streaming recursive directory walker for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _DIR_WALKER_H_
+#define _DIR_WALKER_H_
+
+#include <stdint.h>
+#include <ctype.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+#define DIR_WALKER_READ_SIZE                    (32 << 10)  /* Directory entry bytes fetched per system call */
+
+/*
+ * Recursively visits the regular files of a directory tree whose names match a filter,
+ * calling back as soon as each file is read from the directory instead of listing the tree first.
+ * On Linux entries are read in large batches with getdents64 and every sub directory is opened
+ * relative to its parent with openat, so there is no limit on path length or tree size.
+ * The filter is a file extension ("JPG"), or a name pattern when it holds '*' or '?' ("DJI_*_R.JPG").
+ * Both are case insensitive, an empty filter accepts every file.
+ * Symbolic links to files are visited, symbolic links to directories are not followed.
+ */
+class dir_walker
+{
+public:
+    typedef std::function<void(const std::string &)> visit_t;
+
+    explicit dir_walker(const std::string &filter)
+    {
+        if (filter.empty() || (std::string::npos != filter.find_first_of("*?")))
+        {
+            m_pattern = filter;
+        }
+        else
+        {
+            m_pattern = "*." + filter;
+        }
+    }
+
+    /* Case insensitive match of '*' and '?' wildcards */
+    static bool glob_match(const char *pattern, const char *name)
+    {
+        const char *star = nullptr;
+        const char *retry = nullptr;
+
+        while (*name)
+        {
+            if ('*' == *pattern)
+            {
+                star  = ++pattern;
+                retry = name;
+            }
+            else if (('?' == *pattern) || (tolower((unsigned char)*pattern) == tolower((unsigned char)*name)))
+            {
+                pattern++;
+                name++;
+            }
+            else if (star)
+            {
+                pattern = star;
+                name    = ++retry;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        while ('*' == *pattern)
+        {
+            pattern++;
+        }
+
+        return ('\0' == *pattern);
+    }
+
+    bool matches(const char *name) const
+    {
+        return m_pattern.empty() || glob_match(m_pattern.c_str(), name);
+    }
+
+    /* Returns false when root is not a readable directory */
+    bool walk(const std::string &root, const visit_t &visit) const
+    {
+        std::string prefix = root;
+        if (!prefix.empty() && ('/' != prefix.back()) && ('\\' != prefix.back()))
+        {
+#ifdef _WIN32
+            prefix += "\\";
+#else
+            prefix += "/";
+#endif
+        }
+
+#ifdef _WIN32
+        return prv_walk(prefix, visit);
+#else
+        int fd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        prv_walk(fd, prefix, visit);
+        return true;
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    bool prv_walk(const std::string &prefix, const visit_t &visit) const
+    {
+        WIN32_FIND_DATAA info;
+        HANDLE find = FindFirstFileA((prefix + "*").c_str(), &info);
+        if (INVALID_HANDLE_VALUE == find)
+        {
+            return false;
+        }
+
+        do
+        {
+            if ((0 == strcmp(info.cFileName, ".")) || (0 == strcmp(info.cFileName, "..")))
+            {
+                continue;
+            }
+            if (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            {
+                if (!(info.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+                {
+                    prv_walk(prefix + info.cFileName + "\\", visit);
+                }
+            }
+            else if (matches(info.cFileName))
+            {
+                visit(prefix + info.cFileName);
+            }
+        } while (FindNextFileA(find, &info));
+        FindClose(find);
+
+        return true;
+    }
+#else
+    /* Takes ownership of fd */
+    void prv_walk(int fd, const std::string &prefix, const visit_t &visit) const
+    {
+        prv_read_entries(fd, [&](const char *name, unsigned char type)
+        {
+            if ((0 == strcmp(name, ".")) || (0 == strcmp(name, "..")))
+            {
+                return;
+            }
+
+            /* Resolve file systems without d_type, and links to their targets */
+            if ((DT_UNKNOWN == type) || (DT_LNK == type))
+            {
+                struct stat info;
+                if (0 != fstatat(fd, name, &info, 0))
+                {
+                    return;
+                }
+                if (S_ISREG(info.st_mode))
+                {
+                    type = DT_REG;
+                }
+                else if (S_ISDIR(info.st_mode) && (DT_UNKNOWN == type))
+                {
+                    type = DT_DIR;
+                }
+                else
+                {
+                    return;
+                }
+            }
+
+            if (DT_DIR == type)
+            {
+                int child = openat(fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+                if (child >= 0)
+                {
+                    prv_walk(child, prefix + name + "/", visit);
+                }
+            }
+            else if ((DT_REG == type) && matches(name))
+            {
+                visit(prefix + name);
+            }
+        });
+    }
+
+    template <typename F>
+    static void prv_read_entries(int fd, F on_entry)
+    {
+#ifdef __linux__
+        /* Layout of the records returned by getdents64 */
+        struct linux_dirent64_t
+        {
+            uint64_t        d_ino;
+            int64_t         d_off;
+            unsigned short  d_reclen;
+            unsigned char   d_type;
+            char            d_name[1];
+        };
+
+        std::vector<char> buffer(DIR_WALKER_READ_SIZE);
+        for (;;)
+        {
+            long count = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+            if (count <= 0)
+            {
+                break;
+            }
+            for (long offset = 0; offset < count;)
+            {
+                const linux_dirent64_t *entry = (const linux_dirent64_t *)(buffer.data() + offset);
+                offset += entry->d_reclen;
+                on_entry(entry->d_name, entry->d_type);
+            }
+        }
+        close(fd);
+#else
+        DIR *dir = fdopendir(fd);
+        struct dirent *ptr;
+        if (nullptr == dir)
+        {
+            close(fd);
+            return;
+        }
+        while (nullptr != (ptr = readdir(dir)))
+        {
+            on_entry(ptr->d_name, ptr->d_type);
+        }
+        closedir(dir);
+#endif
+    }
+#endif
+
+    std::string m_pattern;
+};
+
+#endif /* _DIR_WALKER_H_ */
@@ -0,0 +1,392 @@
+/*
+ * Directory tree watcher of DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _DIR_WATCHER_H_
+#define _DIR_WATCHER_H_
+
+#ifdef __linux__
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <iterator>
+
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "dir_walker.h"
+
+#define DIR_WATCHER_EVENT_BUFFER                (64 << 10)  /* Event bytes read per system call */
+#define DIR_WATCHER_REPORTED_MAX                (1 << 16)   /* Reported files remembered before pruning */
+#define DIR_WATCHER_MASK                        (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_ONLYDIR)
+
+/*
+ * Follows a directory tree with inotify and reports every file matching a dir_walker filter once
+ * it is complete. A file becomes a candidate on IN_CLOSE_WRITE or IN_MOVED_TO and is reported after
+ * it kept its size and mtime for settle_ms, so a file written in several passes is reported once.
+ * A reported file is reported again only if its size or mtime changes later.
+ * Files already in the tree when open() is called are candidates too. New sub directories are
+ * watched and scanned, which finds files that landed before their watch was added. An overflowed
+ * event queue makes the whole tree be scanned again, unchanged files are not reported twice.
+ * Reported files are forgotten once deleted or moved away; past DIR_WATCHER_REPORTED_MAX of them
+ * the ones that vanished unseen and then the oldest are forgotten, so a long running watch keeps
+ * a bounded record at the cost of reporting a pruned file again if a later rescan finds it.
+ */
+class dir_watcher
+{
+public:
+    typedef std::function<void(const std::string &)> visit_t;
+
+    dir_watcher(const std::string &filter, int32_t settle_ms)
+        : m_filter(filter), m_settle(settle_ms), m_events(DIR_WATCHER_EVENT_BUFFER)
+    {
+    }
+
+    ~dir_watcher(void)
+    {
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+        }
+    }
+
+    dir_watcher(const dir_watcher &) = delete;
+    dir_watcher &operator=(const dir_watcher &) = delete;
+
+    /* Returns false when root is not a directory that can be watched */
+    bool open(const std::string &root)
+    {
+        m_root = root;
+        m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_fd < 0)
+        {
+            return false;
+        }
+
+        return prv_watch_tree(root);
+    }
+
+    /* Wait up to timeout_ms for changes, then pass every settled file to ready */
+    void poll(int32_t timeout_ms, const visit_t &ready)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        for (const std::pair<const std::string, pending_t> &pending : m_pending)
+        {
+            int64_t remaining = std::chrono::duration_cast<std::chrono::milliseconds>(pending.second.deadline - now).count();
+            timeout_ms = (int32_t)std::max<int64_t>(0, std::min<int64_t>(timeout_ms, remaining + 1));
+        }
+
+        struct pollfd poll_fd = {m_fd, POLLIN, 0};
+        if (::poll(&poll_fd, 1, timeout_ms) > 0)
+        {
+            prv_read_events();
+        }
+
+        prv_report_settled(ready);
+    }
+
+    /* Files seen but not settled yet */
+    size_t pending_count(void) const
+    {
+        return m_pending.size();
+    }
+
+    size_t watch_count(void) const
+    {
+        return m_dirs.size();
+    }
+
+    uint64_t overflow_count(void) const
+    {
+        return m_overflows;
+    }
+
+private:
+    typedef struct
+    {
+        uint64_t    size;
+        int64_t     mtime;                      /* Nanoseconds */
+    } state_t;
+
+    typedef struct
+    {
+        std::chrono::steady_clock::time_point   deadline;
+        state_t                                 state;
+    } pending_t;
+
+    typedef struct
+    {
+        state_t     state;
+        uint64_t    order;                      /* Report sequence number, the oldest are pruned first */
+    } reported_t;
+
+    static std::string prv_join(const std::string &dir, const char *name)
+    {
+        return (!dir.empty() && ('/' == dir.back())) ? dir + name : dir + "/" + name;
+    }
+
+    static bool prv_stat(const std::string &path, state_t *state)
+    {
+        struct stat info;
+        if ((0 != stat(path.c_str(), &info)) || !S_ISREG(info.st_mode))
+        {
+            return false;
+        }
+
+        state->size  = (uint64_t)info.st_size;
+        state->mtime = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+        return true;
+    }
+
+    static bool prv_same(const state_t &a, const state_t &b)
+    {
+        return (a.size == b.size) && (a.mtime == b.mtime);
+    }
+
+    /* (Re)start the settle time of a file, unless it was reported in its current state */
+    void prv_candidate(const std::string &path)
+    {
+        pending_t pending;
+        if (!prv_stat(path, &pending.state))
+        {
+            m_pending.erase(path);
+            return;
+        }
+
+        std::map<std::string, reported_t>::const_iterator reported = m_reported.find(path);
+        if ((m_reported.end() != reported) && prv_same(reported->second.state, pending.state))
+        {
+            return;
+        }
+
+        pending.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_settle);
+        m_pending[path] = pending;
+    }
+
+    /* Watch dir and its sub directories, matching files found in them become candidates */
+    bool prv_watch_tree(const std::string &dir)
+    {
+        int wd = inotify_add_watch(m_fd, dir.c_str(), DIR_WATCHER_MASK);
+        if (wd < 0)
+        {
+            return false;
+        }
+        m_dirs[wd] = dir;
+
+        DIR *handle = opendir(dir.c_str());
+        if (nullptr == handle)
+        {
+            return true;
+        }
+
+        struct dirent *entry = nullptr;
+        while (nullptr != (entry = readdir(handle)))
+        {
+            if ((0 == strcmp(entry->d_name, ".")) || (0 == strcmp(entry->d_name, "..")))
+            {
+                continue;
+            }
+
+            std::string path = prv_join(dir, entry->d_name);
+            struct stat info;
+            if (0 != lstat(path.c_str(), &info))
+            {
+                continue;
+            }
+            if (S_ISDIR(info.st_mode))
+            {
+                prv_watch_tree(path);
+            }
+            else if (m_filter.matches(entry->d_name))
+            {
+                prv_candidate(path);
+            }
+        }
+        closedir(handle);
+
+        return true;
+    }
+
+    void prv_read_events(void)
+    {
+        for (;;)
+        {
+            ssize_t size = read(m_fd, m_events.data(), m_events.size());
+            if (size <= 0)
+            {
+                break;
+            }
+
+            for (ssize_t offset = 0; offset < size; )
+            {
+                const struct inotify_event *event = (const struct inotify_event *)(m_events.data() + offset);
+                offset += sizeof(struct inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    m_overflows++;
+                    prv_watch_tree(m_root);
+                    continue;
+                }
+                if (event->mask & IN_IGNORED)
+                {
+                    m_dirs.erase(event->wd);
+                    continue;
+                }
+
+                std::map<int, std::string>::const_iterator dir = m_dirs.find(event->wd);
+                if ((m_dirs.end() == dir) || (0 == event->len))
+                {
+                    continue;
+                }
+
+                std::string path = prv_join(dir->second, event->name);
+                if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                {
+                    prv_forget(path, 0 != (event->mask & IN_ISDIR));
+                }
+                else if (event->mask & IN_ISDIR)
+                {
+                    prv_watch_tree(path);
+                }
+                else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && m_filter.matches(event->name))
+                {
+                    prv_candidate(path);
+                }
+            }
+        }
+    }
+
+    void prv_report_settled(const visit_t &ready)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+        for (std::map<std::string, pending_t>::iterator it = m_pending.begin(); it != m_pending.end(); )
+        {
+            state_t state;
+            if (it->second.deadline > now)
+            {
+                ++it;
+            }
+            else if (!prv_stat(it->first, &state))
+            {
+                it = m_pending.erase(it);
+            }
+            else if (!prv_same(state, it->second.state))
+            {
+                /* Still being written without a close, e.g. appended to through an open handle */
+                it->second.state    = state;
+                it->second.deadline = now + std::chrono::milliseconds(m_settle);
+                ++it;
+            }
+            else
+            {
+                std::string path = it->first;
+                reported_t &reported = m_reported[path];
+                reported.state = state;
+                reported.order = m_report_order++;
+                it = m_pending.erase(it);
+                ready(path);
+            }
+        }
+
+        if (m_reported.size() > DIR_WATCHER_REPORTED_MAX)
+        {
+            prv_prune_reported();
+        }
+    }
+
+    /* Drop a file, or every file below a directory, that left the tree */
+    void prv_forget(const std::string &path, bool is_dir)
+    {
+        m_pending.erase(path);
+        m_reported.erase(path);
+        if (!is_dir)
+        {
+            return;
+        }
+
+        std::string prefix = prv_join(path, "");
+        std::map<std::string, reported_t>::iterator it = m_reported.lower_bound(prefix);
+        while ((m_reported.end() != it) && (0 == it->first.compare(0, prefix.size(), prefix)))
+        {
+            it = m_reported.erase(it);
+        }
+    }
+
+    /* Shrink the reported record to half its limit, files gone from disk first, then the oldest reports */
+    void prv_prune_reported(void)
+    {
+        state_t state;
+        for (std::map<std::string, reported_t>::iterator it = m_reported.begin(); it != m_reported.end(); )
+        {
+            it = prv_stat(it->first, &state) ? std::next(it) : m_reported.erase(it);
+        }
+        if (m_reported.size() <= DIR_WATCHER_REPORTED_MAX / 2)
+        {
+            return;
+        }
+
+        std::vector<uint64_t> orders;
+        orders.reserve(m_reported.size());
+        for (const std::pair<const std::string, reported_t> &reported : m_reported)
+        {
+            orders.push_back(reported.second.order);
+        }
+        size_t drop = m_reported.size() - DIR_WATCHER_REPORTED_MAX / 2;
+        std::nth_element(orders.begin(), orders.begin() + drop, orders.end());
+        uint64_t oldest_kept = orders[drop];
+
+        for (std::map<std::string, reported_t>::iterator it = m_reported.begin(); it != m_reported.end(); )
+        {
+            it = (it->second.order < oldest_kept) ? m_reported.erase(it) : std::next(it);
+        }
+    }
+
+    dir_walker                          m_filter;
+    int32_t                             m_settle;
+    std::string                         m_root;
+    int                                 m_fd = -1;
+    std::vector<char>                   m_events;
+    std::map<int, std::string>          m_dirs;
+    std::map<std::string, pending_t>    m_pending;
+    std::map<std::string, reported_t>   m_reported;
+    uint64_t                            m_report_order = 0;
+    uint64_t                            m_overflows = 0;
+};
+
+#endif /* __linux__ */
+
+#endif /* _DIR_WATCHER_H_ */
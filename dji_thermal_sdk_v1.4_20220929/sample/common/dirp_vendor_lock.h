@@ -0,0 +1,113 @@
+/*
+ * Locks of the vendor sub libraries with process wide state for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _DIRP_VENDOR_LOCK_H_
+#define _DIRP_VENDOR_LOCK_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <mutex>
+
+#include "rjpeg_probe.h"
+
+typedef enum
+{
+    DIRP_LOCK_NONE = 0,                         /**< No lock, the handle is safe side by side */
+    DIRP_LOCK_CALLS,                            /**< Lock the temperature table calls one at a time */
+    DIRP_LOCK_HANDLE,                           /**< Lock the handle from create to destroy */
+} dirp_lock_scope_e;
+
+/*
+ * libdirp hands every R-JPEG to one vendor sub library, and two of them keep state in process globals:
+ *   libv_dirp, Zenmuse XT S (raw image in APP4) : builds a 32 KB temperature table in one process wide
+ *     pointer and frees it without clearing the pointer, inside dirp_create_from_rjpeg,
+ *     dirp_set_measurement_params, dirp_measure and dirp_measure_ex. Two of these calls at once on
+ *     XT S handles free the table twice and abort with "double free or corruption".
+ *   libv_girp, M30 series with a "girp" APP4 header : keeps the whole handle, raw image and parameters
+ *     included, in globals. A second handle created before the first is destroyed overwrites it, so
+ *     the first one measures the wrong image or crashes, even with each call locked on its own.
+ * H20 series R-JPEGs, also decoded by libv_dirp, and all libv_iirp R-JPEGs are safe side by side.
+ * dji_irp_race reproduces both failures.
+ * Take scope() of the R-JPEG once, then build a dirp_vendor_lock of DIRP_LOCK_HANDLE around the whole
+ * handle and one of DIRP_LOCK_CALLS around each of the four table calls; each only locks when scope()
+ * matches it. Unrecognized R-JPEGs are held for the whole handle.
+ */
+class dirp_vendor_lock
+{
+public:
+    static dirp_lock_scope_e scope(const uint8_t *data, size_t size)
+    {
+        rjpeg_probe_info_t probe_info;
+
+        memset(&probe_info, 0, sizeof(probe_info));
+        if (DIRP_SUCCESS != rjpeg_probe::probe_buffer(data, size, &probe_info))
+        {
+            return DIRP_LOCK_HANDLE;
+        }
+        if ((JPEG_MARKER_APP0 + 4) == probe_info.raw_marker)
+        {
+            return DIRP_LOCK_CALLS;
+        }
+
+        /* Only the girp layout reports curve version 2 */
+        return (0x2 == probe_info.version.curve) ? DIRP_LOCK_HANDLE : DIRP_LOCK_NONE;
+    }
+
+    /* Locks the mutex of held when scope is held, otherwise does nothing */
+    dirp_vendor_lock(dirp_lock_scope_e scope, dirp_lock_scope_e held)
+        : m_mutex(((DIRP_LOCK_NONE != held) && (scope == held)) ? &prv_mutex(held) : nullptr)
+    {
+        if (nullptr != m_mutex)
+        {
+            m_mutex->lock();
+        }
+    }
+
+    ~dirp_vendor_lock(void)
+    {
+        if (nullptr != m_mutex)
+        {
+            m_mutex->unlock();
+        }
+    }
+
+    dirp_vendor_lock(const dirp_vendor_lock &) = delete;
+    dirp_vendor_lock &operator=(const dirp_vendor_lock &) = delete;
+
+private:
+    /* One mutex per sub library, the table calls of libv_dirp never wait for a libv_girp handle */
+    static std::mutex &prv_mutex(dirp_lock_scope_e held)
+    {
+        static std::mutex calls_mutex;
+        static std::mutex handle_mutex;
+        return (DIRP_LOCK_CALLS == held) ? calls_mutex : handle_mutex;
+    }
+
+    std::mutex     *m_mutex;
+};
+
+#endif /* _DIRP_VENDOR_LOCK_H_ */
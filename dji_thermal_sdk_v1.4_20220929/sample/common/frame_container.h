@@ -0,0 +1,356 @@
+/*
+ * Packed multi-frame output container for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _FRAME_CONTAINER_H_
+#define _FRAME_CONTAINER_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define FRAME_CONTAINER_ALIGN                   (4096)      /* Frame data starts on a page boundary */
+#define FRAME_CONTAINER_CHUNK_SLOTS             (1024)      /* Index slots allocated at once */
+#define FRAME_CONTAINER_CHUNK_COUNT             (4096)      /* Max frames : CHUNK_SLOTS * CHUNK_COUNT */
+
+/*
+ * One file holding the output buffers of a whole run, little endian :
+ *   header   | page 0, magic "DJIFRMC1", version, alignment, frame count, index and name table offsets
+ *   frames   | each frame starts on a FRAME_CONTAINER_ALIGN boundary, row major pixels
+ *   index    | frame_t[frame count], sorted by source number
+ *   names    | source paths, referenced by name_offset and name_size of the index
+ *   trailer  | copy of the header fields, so the index is also found from the file end
+ * Workers reserve the space of a frame with one atomic add and write it with pwrite, so frames
+ * of different threads never wait for each other. Header, index and trailer are written by close(),
+ * a container without them was not closed and its frames are not indexed.
+ * A reader maps the file and finds frame i at index_offset + i * sizeof(frame_t).
+ */
+class frame_container
+{
+public:
+    enum
+    {
+        dtype_uint8 = 1,
+        dtype_uint16,
+        dtype_int16,
+        dtype_float32,
+        dtype_float16,
+    };
+
+    enum
+    {
+        gps_latitude  = 1 << 0,
+        gps_longitude = 1 << 1,
+        gps_altitude  = 1 << 2,
+    };
+
+    typedef struct
+    {
+        uint64_t    offset;                     /* Byte offset of the first pixel */
+        uint64_t    size;                       /* Pixel bytes */
+        uint32_t    number;                     /* Source number in directory walk order */
+        uint32_t    width;
+        uint32_t    height;
+        uint16_t    channels;
+        uint16_t    dtype;
+        double      latitude;                   /* Degrees, north positive */
+        double      longitude;                  /* Degrees, east positive */
+        double      altitude;                   /* Meters, above sea level positive */
+        uint32_t    gps;                        /* gps_* bits of the valid fields */
+        uint32_t    name_offset;                /* Into the name table */
+        uint32_t    name_size;
+        uint32_t    reserved;
+    } frame_t;
+
+    typedef struct
+    {
+        char        magic[8];
+        uint32_t    version;
+        uint32_t    align;
+        uint64_t    frame_count;
+        uint64_t    index_offset;
+        uint64_t    names_offset;
+        uint64_t    names_size;
+    } header_t;
+
+    frame_container(void)
+    {
+        for (int32_t i = 0; i < FRAME_CONTAINER_CHUNK_COUNT; i++)
+        {
+            m_chunks[i] = nullptr;
+        }
+    }
+
+    ~frame_container(void)
+    {
+        close();
+        for (int32_t i = 0; i < FRAME_CONTAINER_CHUNK_COUNT; i++)
+        {
+            delete[] m_chunks[i].load();
+        }
+    }
+
+    frame_container(const frame_container &) = delete;
+    frame_container &operator=(const frame_container &) = delete;
+
+    bool open(const std::string &path)
+    {
+        m_path = path;
+#ifdef _WIN32
+        m_file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        return (INVALID_HANDLE_VALUE != m_file);
+#else
+        m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        return (m_fd >= 0);
+#endif
+    }
+
+    /* Element type code of a manifest dtype name, 0 when unknown */
+    static uint16_t dtype_code(const char *dtype)
+    {
+        if (0 == strcmp(dtype, "uint8"))    return dtype_uint8;
+        if (0 == strcmp(dtype, "uint16"))   return dtype_uint16;
+        if (0 == strcmp(dtype, "int16"))    return dtype_int16;
+        if (0 == strcmp(dtype, "float32"))  return dtype_float32;
+        if (0 == strcmp(dtype, "float16"))  return dtype_float16;
+        return 0;
+    }
+
+    /*
+     * Store the pixels of one frame, described by frame with offset, size and name fields left out.
+     * Safe to call from any number of threads. Returns the frame offset, or 0 on a write error.
+     */
+    uint64_t append(const uint8_t *data, size_t size, const frame_t &frame, const std::string &source)
+    {
+        uint64_t slot_index = m_slot_count++;
+        slot_t *slot = prv_slot(slot_index);
+        if (nullptr == slot)
+        {
+            m_failed = true;
+            return 0;
+        }
+
+        uint64_t offset = m_end.fetch_add(prv_align(size));
+        slot->frame        = frame;
+        slot->frame.offset = offset;
+        slot->frame.size   = size;
+        slot->source       = source;
+
+        if (!prv_write(offset, data, size))
+        {
+            slot->frame.size = 0;               /* Not listed in the index */
+            m_failed = true;
+            return 0;
+        }
+
+        m_bytes += size;
+        return offset;
+    }
+
+    /* Write index, name table, header and trailer, after every append returned */
+    bool close(void)
+    {
+        if (!prv_is_open())
+        {
+            return !m_failed;
+        }
+
+        std::vector<const slot_t *> slots;
+        uint64_t slot_count = std::min<uint64_t>(m_slot_count.load(), (uint64_t)FRAME_CONTAINER_CHUNK_SLOTS * FRAME_CONTAINER_CHUNK_COUNT);
+        for (uint64_t i = 0; i < slot_count; i++)
+        {
+            const slot_t *slot = prv_slot(i);
+            if (slot->frame.size > 0)
+            {
+                slots.push_back(slot);
+            }
+        }
+        std::sort(slots.begin(), slots.end(), [](const slot_t *a, const slot_t *b) { return a->frame.number < b->frame.number; });
+
+        std::vector<frame_t> index;
+        std::string names;
+        for (const slot_t *slot : slots)
+        {
+            frame_t frame = slot->frame;
+            frame.name_offset = (uint32_t)names.size();
+            frame.name_size   = (uint32_t)slot->source.size();
+            names += slot->source;
+            index.push_back(frame);
+        }
+
+        header_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "DJIFRMC1", sizeof(header.magic));
+        header.version      = 1;
+        header.align        = FRAME_CONTAINER_ALIGN;
+        header.frame_count  = index.size();
+        header.index_offset = m_end.load();
+        header.names_offset = header.index_offset + index.size() * sizeof(frame_t);
+        header.names_size   = names.size();
+
+        bool written = prv_write(header.index_offset, (const uint8_t *)index.data(), index.size() * sizeof(frame_t)) &&
+                       prv_write(header.names_offset, (const uint8_t *)names.data(), names.size()) &&
+                       prv_write(header.names_offset + names.size(), (const uint8_t *)&header, sizeof(header)) &&
+                       prv_write(0, (const uint8_t *)&header, sizeof(header));
+        m_failed = m_failed || !written;
+        m_frame_count = index.size();
+
+#ifdef _WIN32
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        ::close(m_fd);
+        m_fd = -1;
+#endif
+
+        return !m_failed;
+    }
+
+    const std::string &path(void) const
+    {
+        return m_path;
+    }
+
+    uint64_t frame_count(void) const
+    {
+        return m_frame_count;
+    }
+
+    uint64_t frame_bytes(void) const
+    {
+        return m_bytes;
+    }
+
+private:
+    typedef struct
+    {
+        frame_t     frame;
+        std::string source;
+    } slot_t;
+
+    static uint64_t prv_align(uint64_t size)
+    {
+        return (size + FRAME_CONTAINER_ALIGN - 1) & ~(uint64_t)(FRAME_CONTAINER_ALIGN - 1);
+    }
+
+    /* Index slots live in chunks that are allocated on first use, the first thread to publish one wins */
+    slot_t *prv_slot(uint64_t slot_index)
+    {
+        uint64_t chunk_index = slot_index / FRAME_CONTAINER_CHUNK_SLOTS;
+        if (chunk_index >= FRAME_CONTAINER_CHUNK_COUNT)
+        {
+            return nullptr;
+        }
+
+        slot_t *chunk = m_chunks[chunk_index].load(std::memory_order_acquire);
+        if (nullptr == chunk)
+        {
+            slot_t *fresh = new slot_t[FRAME_CONTAINER_CHUNK_SLOTS]();
+            if (m_chunks[chunk_index].compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel))
+            {
+                chunk = fresh;
+            }
+            else
+            {
+                delete[] fresh;
+            }
+        }
+
+        return &chunk[slot_index % FRAME_CONTAINER_CHUNK_SLOTS];
+    }
+
+    bool prv_is_open(void) const
+    {
+#ifdef _WIN32
+        return (INVALID_HANDLE_VALUE != m_file);
+#else
+        return (m_fd >= 0);
+#endif
+    }
+
+    /* Positioned write, which leaves no shared file position for threads to contend on */
+    bool prv_write(uint64_t offset, const uint8_t *data, size_t size)
+    {
+        while (size > 0)
+        {
+#ifdef _WIN32
+            OVERLAPPED overlapped;
+            DWORD written = 0;
+            memset(&overlapped, 0, sizeof(overlapped));
+            overlapped.Offset     = (DWORD)offset;
+            overlapped.OffsetHigh = (DWORD)(offset >> 32);
+            if (!WriteFile(m_file, data, (DWORD)std::min<size_t>(size, 1u << 30), &written, &overlapped) || (0 == written))
+            {
+                return false;
+            }
+#else
+            ssize_t written = pwrite(m_fd, data, size, (off_t)offset);
+            if (written <= 0)
+            {
+                if ((written < 0) && (EINTR == errno))
+                {
+                    continue;
+                }
+                return false;
+            }
+#endif
+            data   += written;
+            size   -= written;
+            offset += written;
+        }
+
+        return true;
+    }
+
+    std::string             m_path;
+#ifdef _WIN32
+    HANDLE                  m_file = INVALID_HANDLE_VALUE;
+#else
+    int                     m_fd = -1;
+#endif
+    std::atomic<uint64_t>   m_end {FRAME_CONTAINER_ALIGN};      /* Page 0 holds the header */
+    std::atomic<uint64_t>   m_slot_count {0};
+    std::atomic<uint64_t>   m_bytes {0};
+    std::atomic<bool>       m_failed {false};
+    std::atomic<slot_t *>   m_chunks[FRAME_CONTAINER_CHUNK_COUNT];
+    uint64_t                m_frame_count = 0;
+};
+
+#endif /* _FRAME_CONTAINER_H_ */
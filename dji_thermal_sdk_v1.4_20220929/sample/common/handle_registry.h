@@ -0,0 +1,283 @@
+/*
+ * Generation checked handle registry for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _HANDLE_REGISTRY_H_
+#define _HANDLE_REGISTRY_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <new>
+#include <type_traits>
+
+#define HANDLE_REGISTRY_SLAB_SHIFT              (6)         /* 64 slots per slab */
+#define HANDLE_REGISTRY_SLAB_COUNT              (1024)      /* Up to 65535 live handles */
+#define HANDLE_REGISTRY_INDEX_BITS              (16)
+
+/*
+ * Fixed capacity table of T instances addressed by opaque handles.
+ *
+ * Instances live in slabs of 64 slots, allocated on first use and kept until the registry
+ * is destroyed, so a context is built in place instead of going through the heap per handle.
+ * A handle packs the slot index with the slot generation, which is bumped by every create()
+ * and destroy(). get() on a destroyed or recycled handle fails instead of returning another
+ * instance, and destroy() on the same handle succeeds only once.
+ *
+ * create() and destroy() are lock free: released slots go to a Treiber stack whose head
+ * carries an ABA tag, fresh slots are claimed with an atomic counter.
+ */
+template <typename T>
+class handle_registry
+{
+public:
+    typedef uintptr_t handle_t;
+
+    handle_registry(void)
+        : m_free_head(((uint64_t)0 << 32) | SLOT_NONE), m_used(0)
+    {
+        for (uint32_t i = 0; i < HANDLE_REGISTRY_SLAB_COUNT; i++)
+        {
+            m_slabs[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~handle_registry(void)
+    {
+        for (uint32_t i = 0; i < HANDLE_REGISTRY_SLAB_COUNT; i++)
+        {
+            slot_t *slab = m_slabs[i].load(std::memory_order_relaxed);
+            if (nullptr == slab)
+            {
+                continue;
+            }
+            for (uint32_t j = 0; j < SLAB_SIZE; j++)
+            {
+                if (slab[j].generation.load(std::memory_order_relaxed) & 1)
+                {
+                    slab[j].object()->~T();
+                }
+            }
+            delete[] slab;
+        }
+    }
+
+    handle_registry(const handle_registry &) = delete;
+    handle_registry &operator=(const handle_registry &) = delete;
+
+    /* Construct a T in a free slot, returns nullptr when all slots are in use */
+    T *create(handle_t *handle)
+    {
+        uint32_t index = pop_free();
+        if (SLOT_NONE == index)
+        {
+            index = m_used.fetch_add(1, std::memory_order_relaxed);
+            if (index >= CAPACITY)
+            {
+                m_used.fetch_sub(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+        }
+
+        slot_t *s = slot(index, true);
+        if (nullptr == s)
+        {
+            return nullptr;                                     /* Out of memory, the index is not reused */
+        }
+
+        T *object = new (s->object()) T();
+        uint32_t generation = s->generation.load(std::memory_order_relaxed) + 1;    /* Odd : in use */
+        s->generation.store(generation, std::memory_order_release);
+
+        *handle = encode(index, generation);
+        return object;
+    }
+
+    /* Instance of a live handle, nullptr for stale, foreign or null handles */
+    T *get(handle_t handle) const
+    {
+        uint32_t index = 0;
+        uint32_t generation = 0;
+        if (!decode(handle, &index, &generation))
+        {
+            return nullptr;
+        }
+
+        slot_t *s = slot(index, false);
+        if ((nullptr == s) || !match(s->generation.load(std::memory_order_acquire), generation))
+        {
+            return nullptr;
+        }
+        return s->object();
+    }
+
+    /* Destroy the instance of a live handle, false if it is stale or already destroyed */
+    bool destroy(handle_t handle)
+    {
+        uint32_t index = 0;
+        uint32_t generation = 0;
+        if (!decode(handle, &index, &generation))
+        {
+            return false;
+        }
+
+        slot_t *s = slot(index, false);
+        if (nullptr == s)
+        {
+            return false;
+        }
+
+        /* Only one caller moves the slot from this live generation to the next free one */
+        uint32_t current = s->generation.load(std::memory_order_acquire);
+        if (!match(current, generation) ||
+            !s->generation.compare_exchange_strong(current, current + 1, std::memory_order_acq_rel))
+        {
+            return false;
+        }
+
+        s->object()->~T();
+        push_free(index);
+        return true;
+    }
+
+private:
+    static const uint32_t SLAB_SIZE = 1u << HANDLE_REGISTRY_SLAB_SHIFT;
+    static const uint32_t CAPACITY  = SLAB_SIZE * HANDLE_REGISTRY_SLAB_COUNT - 1;        /* Index + 1 fits the index bits */
+    static const uint32_t SLOT_NONE = 0xFFFFFFFFu;
+
+    /* Handles keep the generation bits that fit next to the index in a pointer */
+    static const uint32_t GENERATION_BITS = (sizeof(handle_t) * 8 - HANDLE_REGISTRY_INDEX_BITS < 32) ?
+                                            (uint32_t)(sizeof(handle_t) * 8 - HANDLE_REGISTRY_INDEX_BITS) : 32;
+
+    struct slot_t
+    {
+        typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+        std::atomic<uint32_t>   generation;
+        std::atomic<uint32_t>   next;
+
+        slot_t(void) : generation(0), next(SLOT_NONE) {}
+
+        T *object(void)
+        {
+            return reinterpret_cast<T *>(&storage);
+        }
+    };
+
+    static uint32_t generation_mask(void)
+    {
+        return (uint32_t)((1ull << GENERATION_BITS) - 1);
+    }
+
+    static bool match(uint32_t slot_generation, uint32_t handle_generation)
+    {
+        return (slot_generation & 1) && ((slot_generation & generation_mask()) == handle_generation);
+    }
+
+    /* Index is stored plus one, so no valid handle is zero */
+    static handle_t encode(uint32_t index, uint32_t generation)
+    {
+        return ((handle_t)(generation & generation_mask()) << HANDLE_REGISTRY_INDEX_BITS) | (handle_t)(index + 1);
+    }
+
+    static bool decode(handle_t handle, uint32_t *index, uint32_t *generation)
+    {
+        uint32_t slot_number = (uint32_t)(handle & ((1u << HANDLE_REGISTRY_INDEX_BITS) - 1));
+        if ((0 == slot_number) || (slot_number > CAPACITY))
+        {
+            return false;
+        }
+        *index      = slot_number - 1;
+        *generation = (uint32_t)(handle >> HANDLE_REGISTRY_INDEX_BITS) & generation_mask();
+        return true;
+    }
+
+    slot_t *slot(uint32_t index, bool allocate) const
+    {
+        std::atomic<slot_t *> &entry = m_slabs[index >> HANDLE_REGISTRY_SLAB_SHIFT];
+        slot_t *slab = entry.load(std::memory_order_acquire);
+        if ((nullptr == slab) && allocate)
+        {
+            slot_t *fresh = new (std::nothrow) slot_t[SLAB_SIZE];
+            if (nullptr == fresh)
+            {
+                return nullptr;
+            }
+            if (entry.compare_exchange_strong(slab, fresh, std::memory_order_acq_rel))
+            {
+                slab = fresh;
+            }
+            else
+            {
+                delete[] fresh;                                 /* Another thread installed it first */
+            }
+        }
+        return slab ? &slab[index & (SLAB_SIZE - 1)] : nullptr;
+    }
+
+    /* Head packs the top slot index with a tag bumped on every push, against ABA */
+    void push_free(uint32_t index)
+    {
+        slot_t *s = slot(index, false);
+        if (nullptr == s)
+        {
+            return;
+        }
+        uint64_t head = m_free_head.load(std::memory_order_relaxed);
+        uint64_t next_head = 0;
+        do
+        {
+            s->next.store((uint32_t)head, std::memory_order_relaxed);
+            next_head = (((head >> 32) + 1) << 32) | index;
+        } while (!m_free_head.compare_exchange_weak(head, next_head, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    uint32_t pop_free(void)
+    {
+        uint64_t head = m_free_head.load(std::memory_order_acquire);
+        uint64_t next_head = 0;
+        do
+        {
+            uint32_t index = (uint32_t)head;
+            if (SLOT_NONE == index)
+            {
+                return SLOT_NONE;
+            }
+            slot_t *s = slot(index, false);
+            if (nullptr == s)
+            {
+                return SLOT_NONE;
+            }
+            next_head = (head & 0xFFFFFFFF00000000ull) | s->next.load(std::memory_order_relaxed);
+        } while (!m_free_head.compare_exchange_weak(head, next_head, std::memory_order_acquire, std::memory_order_acquire));
+
+        return (uint32_t)head;
+    }
+
+    mutable std::atomic<slot_t *>   m_slabs[HANDLE_REGISTRY_SLAB_COUNT];
+    std::atomic<uint64_t>           m_free_head;
+    std::atomic<uint32_t>           m_used;
+};
+
+#endif /* _HANDLE_REGISTRY_H_ */
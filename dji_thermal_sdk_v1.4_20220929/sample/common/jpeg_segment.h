@@ -0,0 +1,116 @@
+/*
+ * JPEG marker segment walker for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _JPEG_SEGMENT_H_
+#define _JPEG_SEGMENT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define JPEG_MARKER_SOI                         (0xD8)
+#define JPEG_MARKER_SOS                         (0xDA)
+#define JPEG_MARKER_EOI                         (0xD9)
+#define JPEG_MARKER_APP0                        (0xE0)
+#define JPEG_MARKER_APP1                        (0xE1)
+
+/*
+ * Walk the marker segments in front of the entropy coded data (SOS) of a JPEG stream.
+ * fn(marker, payload, payload_size) is called for every segment, payload excludes the
+ * two length bytes. Returning false from fn stops the walk.
+ * Only the header bytes are touched, so data may be just the first few KB of a file.
+ * Return false if data does not start with SOI or a segment is cut off before SOS.
+ */
+template <typename F>
+static inline bool jpeg_segment_walk(const uint8_t *data, size_t size, F fn)
+{
+    if ((nullptr == data) || (size < 4) || (0xFF != data[0]) || (JPEG_MARKER_SOI != data[1]))
+    {
+        return false;
+    }
+
+    size_t pos = 2;
+    while (pos + 4 <= size)
+    {
+        if (0xFF != data[pos])
+        {
+            return false;
+        }
+
+        uint8_t marker = data[pos + 1];
+        if (0xFF == marker)
+        {
+            pos++;                                      /* Fill byte */
+            continue;
+        }
+        if ((JPEG_MARKER_SOS == marker) || (JPEG_MARKER_EOI == marker))
+        {
+            return true;
+        }
+
+        size_t length = ((size_t)data[pos + 2] << 8) | data[pos + 3];
+        if ((length < 2) || (pos + 2 + length > size))
+        {
+            return false;
+        }
+        if (!fn(marker, data + pos + 4, length - 2))
+        {
+            return true;
+        }
+
+        pos += 2 + length;
+    }
+
+    return false;
+}
+
+/*
+ * Locate the TIFF structure of the EXIF APP1 segment.
+ * Return false if there is no EXIF segment.
+ */
+static inline bool jpeg_exif_find(const uint8_t *data, size_t size, const uint8_t **tiff, size_t *tiff_size)
+{
+    static const char exif_id[6] = {'E', 'x', 'i', 'f', 0, 0};
+    bool found = false;
+
+    jpeg_segment_walk(data, size, [&](uint8_t marker, const uint8_t *payload, size_t payload_size)
+    {
+        if ((JPEG_MARKER_APP1 == marker) && (payload_size > sizeof(exif_id)) &&
+            (0 == memcmp(payload, exif_id, sizeof(exif_id))))
+        {
+            *tiff       = payload + sizeof(exif_id);
+            *tiff_size  = payload_size - sizeof(exif_id);
+            found       = true;
+            return false;
+        }
+        return true;
+    });
+
+    return found;
+}
+
+#endif /* _JPEG_SEGMENT_H_ */
@@ -0,0 +1,58 @@
+/*
+ * JSON string quoting for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _JSON_STRING_H_
+#define _JSON_STRING_H_
+
+#include <stdio.h>
+#include <string>
+
+/* Quoted JSON string of text, with quotes, backslashes and control characters escaped */
+static inline std::string json_quote(const std::string &text)
+{
+    std::string out = "\"";
+    for (char c : text)
+    {
+        if      ('"' == c)  out += "\\\"";
+        else if ('\\' == c) out += "\\\\";
+        else if ('\n' == c) out += "\\n";
+        else if ('\t' == c) out += "\\t";
+        else if ((unsigned char)c < 0x20)
+        {
+            char hex[8];
+            snprintf(hex, sizeof(hex), "\\u%04x", (unsigned char)c);
+            out += hex;
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+#endif /* _JSON_STRING_H_ */
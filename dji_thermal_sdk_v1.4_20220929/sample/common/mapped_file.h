@@ -0,0 +1,187 @@
+/*
+ * Read-only memory mapped input files for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Maps a whole file read-only, so its bytes can be handed to dirp_create_from_rjpeg()
+ * without copying them into a heap buffer first.
+ * The mapping is advised for sequential access, the SDK parses the R-JPEG front to back.
+ * Objects are movable, the mapping is released by close() or the destructor.
+ */
+class mapped_file
+{
+public:
+    mapped_file(void)
+    {
+    }
+
+    ~mapped_file(void)
+    {
+        close();
+    }
+
+    mapped_file(mapped_file &&other)
+        : m_data(other.m_data), m_size(other.m_size)
+    {
+        other.m_data = nullptr;
+        other.m_size = 0;
+    }
+
+    mapped_file &operator=(mapped_file &&other)
+    {
+        if (this != &other)
+        {
+            close();
+            m_data = other.m_data;
+            m_size = other.m_size;
+            other.m_data = nullptr;
+            other.m_size = 0;
+        }
+        return *this;
+    }
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    /* Map path, an empty file or any failure leaves the object closed */
+    bool open(const char *path)
+    {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                  FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (INVALID_HANDLE_VALUE == file)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER size;
+        HANDLE mapping = NULL;
+        if (GetFileSizeEx(file, &size) && (size.QuadPart > 0))
+        {
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        }
+        if (NULL != mapping)
+        {
+            m_data = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            m_size = m_data ? (size_t)size.QuadPart : 0;
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        struct stat info;
+        if ((0 == fstat(fd, &info)) && (info.st_size > 0))
+        {
+            void *data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (MAP_FAILED != data)
+            {
+                madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+                m_data = (const uint8_t *)data;
+                m_size = (size_t)info.st_size;
+            }
+        }
+        ::close(fd);
+#endif
+        return nullptr != m_data;
+    }
+
+    void close(void)
+    {
+        if (nullptr != m_data)
+        {
+#ifdef _WIN32
+            UnmapViewOfFile(m_data);
+#else
+            munmap((void *)m_data, m_size);
+#endif
+        }
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    bool is_open(void) const
+    {
+        return nullptr != m_data;
+    }
+
+    const uint8_t *data(void) const
+    {
+        return m_data;
+    }
+
+    size_t size(void) const
+    {
+        return m_size;
+    }
+
+    /*
+     * Ask the kernel to start reading path into the page cache in the background,
+     * so the file is resident by the time it is mapped. Errors are ignored.
+     */
+    static void prefetch(const char *path)
+    {
+#if defined(_WIN32) || defined(__APPLE__)
+        (void)path;
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd >= 0)
+        {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+            ::close(fd);
+        }
+#endif
+    }
+
+private:
+    const uint8_t  *m_data = nullptr;
+    size_t          m_size = 0;
+};
+
+#endif /* _MAPPED_FILE_H_ */
@@ -0,0 +1,95 @@
+/*
+ * JSON lines manifest of converted files for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _OUTPUT_MANIFEST_H_
+#define _OUTPUT_MANIFEST_H_
+
+#include <stdint.h>
+#include <string>
+#include <mutex>
+#include <fstream>
+
+#include "json_string.h"
+
+/*
+ * One JSON object per line and per output file, written as soon as the file is complete :
+ *   {"source":"a/DJI_0001_R.JPG","output":"o/a/DJI_0001_R.raw","width":640,"height":512,
+ *    "dtype":"float32","channels":1,"offset":0}
+ * offset is the byte offset of the row major pixel data in the output file, so a loader can
+ * map every output without probing its R-JPEG again. Lines follow completion order; when a resumed
+ * run appends to a manifest, the last line of a source wins.
+ */
+class output_manifest
+{
+public:
+    typedef struct
+    {
+        std::string source;
+        std::string output;
+        int32_t     width;
+        int32_t     height;
+        const char *dtype;
+        int32_t     channels;
+        uint64_t    offset;
+    } entry_t;
+
+    bool open(const std::string &path, bool append)
+    {
+        m_stream.open(path.c_str(), append ? (std::ios::binary | std::ios::app) : (std::ios::binary | std::ios::trunc));
+        return m_stream.is_open();
+    }
+
+    void add(const entry_t &entry)
+    {
+        std::string line = "{\"source\":" + json_quote(entry.source) + ",\"output\":" + json_quote(entry.output) +
+                           ",\"width\":" + std::to_string(entry.width) + ",\"height\":" + std::to_string(entry.height) +
+                           ",\"dtype\":\"" + entry.dtype + "\",\"channels\":" + std::to_string(entry.channels) +
+                           ",\"offset\":" + std::to_string(entry.offset) + "}\n";
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stream << line;
+        m_count++;
+    }
+
+    void close(void)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stream.close();
+    }
+
+    uint64_t count(void) const
+    {
+        return m_count;
+    }
+
+private:
+    std::ofstream   m_stream;
+    std::mutex      m_mutex;
+    uint64_t        m_count = 0;
+};
+
+#endif /* _OUTPUT_MANIFEST_H_ */
@@ -0,0 +1,313 @@
+/*
+ * Content-addressed on-disk result cache for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _RESULT_CACHE_H_
+#define _RESULT_CACHE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+
+#include "content_hash.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <direct.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#endif
+
+#define RESULT_CACHE_ENTRY_SUFFIX               ".bin"
+
+/*
+ * Output files keyed by the hash of the input bytes and of everything else that decides the output.
+ * The salt given to the constructor carries the conversion parameters and SDK version, so a changed
+ * option or library never returns a stale entry. Entries are hard links to the output files where the
+ * file system allows it, and copies otherwise; a hit links the entry back to the requested output path.
+ * Each hit refreshes the entry time, trim() removes the least recently used entries above the size cap.
+ */
+class result_cache
+{
+public:
+    result_cache(const std::string &dir, uint64_t cap_bytes, const std::string &salt)
+        : m_dir(dir), m_cap_bytes(cap_bytes), m_seed(content_hash::hash64(salt.data(), salt.size(), 0))
+    {
+    }
+
+    /* Create the cache directory if needed */
+    bool open(void)
+    {
+#ifdef _WIN32
+        int status = _mkdir(m_dir.c_str());
+#else
+        int status = mkdir(m_dir.c_str(), 0755);
+#endif
+        return (0 == status) || (EEXIST == errno);
+    }
+
+    /* Entry name of one input, the input size is kept next to the hash to make collisions even less likely */
+    std::string key(const uint8_t *data, size_t size) const
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "%016llx-%llu", (unsigned long long)content_hash::hash64(data, size, m_seed),
+                 (unsigned long long)size);
+        return std::string(name);
+    }
+
+    /*
+     * Place the cached result of key at output_path, returns false on a miss.
+     * The entry is linked or copied under a private name and renamed over output_path only on a hit,
+     * so a miss leaves the previous output in place until a new one is written.
+     */
+    bool lookup(const std::string &key, const std::string &output_path)
+    {
+        std::string entry = prv_entry_path(key);
+        std::string temp  = prv_temp_path(output_path);
+
+        remove(temp.c_str());
+        if ((!prv_link(entry, temp) && !prv_copy(entry, temp)) || !prv_replace(temp, output_path))
+        {
+            remove(temp.c_str());
+            m_misses++;
+            return false;
+        }
+        /* rename() keeps both names when output_path already is a link to the entry */
+        remove(temp.c_str());
+
+        /* The entry time is the LRU order */
+#ifdef _WIN32
+        _utime(entry.c_str(), nullptr);
+#else
+        utime(entry.c_str(), nullptr);
+#endif
+        m_hits++;
+        return true;
+    }
+
+    /* Keep the freshly written output_path as the result of key */
+    void store(const std::string &key, const std::string &output_path)
+    {
+        std::string entry = prv_entry_path(key);
+
+        if (!prv_link(output_path, entry))
+        {
+            if (prv_exists(entry))
+            {
+                return;
+            }
+
+            /* Copy under a private name first, so other threads never see a partial entry */
+            std::string temp = prv_temp_path(entry);
+            if (!prv_copy(output_path, temp) || (0 != rename(temp.c_str(), entry.c_str())))
+            {
+                remove(temp.c_str());
+                return;
+            }
+        }
+        m_stores++;
+    }
+
+    /* Remove the least recently used entries until the cache fits its size cap, returns the remaining size */
+    uint64_t trim(void)
+    {
+        std::vector<entry_info_t> entries;
+        uint64_t total = 0;
+
+        prv_scan(entries);
+        for (const entry_info_t &info : entries)
+        {
+            total += info.size;
+        }
+
+        std::sort(entries.begin(), entries.end(), [](const entry_info_t &a, const entry_info_t &b)
+        {
+            return a.time < b.time;
+        });
+
+        for (size_t i = 0; (i < entries.size()) && (total > m_cap_bytes); i++)
+        {
+            if (0 == remove((m_dir + "/" + entries[i].name).c_str()))
+            {
+                total -= entries[i].size;
+                m_evictions++;
+            }
+        }
+
+        return total;
+    }
+
+    uint64_t hits(void) const       { return m_hits.load(); }
+    uint64_t misses(void) const     { return m_misses.load(); }
+    uint64_t stores(void) const     { return m_stores.load(); }
+    uint64_t evictions(void) const  { return m_evictions.load(); }
+    uint64_t cap_bytes(void) const  { return m_cap_bytes; }
+
+    double hit_rate(void) const
+    {
+        uint64_t total = hits() + misses();
+        return (total > 0) ? (double)hits() / total : 0;
+    }
+
+private:
+    typedef struct
+    {
+        std::string name;
+        uint64_t    size;
+        int64_t     time;
+    } entry_info_t;
+
+    std::string prv_entry_path(const std::string &key) const
+    {
+        return m_dir + "/" + key + RESULT_CACHE_ENTRY_SUFFIX;
+    }
+
+    /* Name private to the calling thread next to path */
+    static std::string prv_temp_path(const std::string &path)
+    {
+        return path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    }
+
+    /* Rename from over to, replacing an existing to */
+    static bool prv_replace(const std::string &from, const std::string &to)
+    {
+#ifdef _WIN32
+        return (0 != MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING));
+#else
+        return (0 == rename(from.c_str(), to.c_str()));
+#endif
+    }
+
+    static bool prv_link(const std::string &from, const std::string &to)
+    {
+#ifdef _WIN32
+        return (0 != CreateHardLinkA(to.c_str(), from.c_str(), nullptr));
+#else
+        return (0 == link(from.c_str(), to.c_str()));
+#endif
+    }
+
+    static bool prv_exists(const std::string &path)
+    {
+        std::ifstream fs(path.c_str(), std::ios::binary);
+        return fs.is_open();
+    }
+
+    static bool prv_copy(const std::string &from, const std::string &to)
+    {
+        std::ifstream fs_i(from.c_str(), std::ios::binary);
+        if (!fs_i.is_open())
+        {
+            return false;
+        }
+
+        std::ofstream fs_o(to.c_str(), std::ios::binary);
+        if (!fs_o.is_open())
+        {
+            return false;
+        }
+
+        fs_o << fs_i.rdbuf();
+        fs_o.close();
+
+        return !fs_o.fail();
+    }
+
+    static bool prv_is_entry(const std::string &name)
+    {
+        size_t suffix_size = sizeof(RESULT_CACHE_ENTRY_SUFFIX) - 1;
+        return (name.size() > suffix_size) && (0 == name.compare(name.size() - suffix_size, suffix_size, RESULT_CACHE_ENTRY_SUFFIX));
+    }
+
+    void prv_scan(std::vector<entry_info_t> &entries) const
+    {
+#ifdef _WIN32
+        WIN32_FIND_DATAA info;
+        HANDLE find = FindFirstFileA((m_dir + "\\*" RESULT_CACHE_ENTRY_SUFFIX).c_str(), &info);
+        if (INVALID_HANDLE_VALUE == find)
+        {
+            return;
+        }
+        do
+        {
+            if (!(info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && prv_is_entry(info.cFileName))
+            {
+                entry_info_t entry;
+                entry.name = info.cFileName;
+                entry.size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+                entry.time = ((int64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+                entries.push_back(entry);
+            }
+        } while (FindNextFileA(find, &info));
+        FindClose(find);
+#else
+        DIR *dir = opendir(m_dir.c_str());
+        struct dirent *ptr;
+        if (nullptr == dir)
+        {
+            return;
+        }
+        while (nullptr != (ptr = readdir(dir)))
+        {
+            struct stat info;
+            if (!prv_is_entry(ptr->d_name) || (0 != fstatat(dirfd(dir), ptr->d_name, &info, 0)) || !S_ISREG(info.st_mode))
+            {
+                continue;
+            }
+            entry_info_t entry;
+            entry.name = ptr->d_name;
+            entry.size = (uint64_t)info.st_size;
+            entry.time = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+            entries.push_back(entry);
+        }
+        closedir(dir);
+#endif
+    }
+
+    std::string             m_dir;
+    uint64_t                m_cap_bytes;
+    uint64_t                m_seed;
+    std::atomic<uint64_t>   m_hits      {0};
+    std::atomic<uint64_t>   m_misses    {0};
+    std::atomic<uint64_t>   m_stores    {0};
+    std::atomic<uint64_t>   m_evictions {0};
+};
+
+#endif /* _RESULT_CACHE_H_ */
@@ -0,0 +1,373 @@
+/*
+ * Header-only R-JPEG probe for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _RJPEG_PROBE_H_
+#define _RJPEG_PROBE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "dirp_api.h"
+#include "jpeg_segment.h"
+#include "tiff_writer.h"
+
+#define RJPEG_PROBE_HEAD_SIZE                   (4096)
+#define RJPEG_PROBE_EXIF_MAX                    (65536)
+
+#define RJPEG_PROBE_APP4_HEAD_SIZE              (256)
+
+#define EXIF_TAG_MODEL                          (0x0110)
+
+typedef struct
+{
+    dirp_resolution_t       resolution;         /**< Same as dirp_get_rjpeg_resolution */
+    dirp_rjpeg_version_t    version;            /**< Same as dirp_get_rjpeg_version */
+    char                    camera_model[64];   /**< EXIF IFD0 Model, empty if absent */
+    uint8_t                 raw_marker;         /**< JPEG marker of the segments holding the RAW16 image */
+    uint8_t                 raw_shift;          /**< Right shift from stored RAW16 to dirp_get_original_raw values */
+    uint64_t                bytes_read;         /**< Bytes actually read from the source */
+} rjpeg_probe_info_t;
+
+/*
+ * Read resolution, versions and camera model of an R-JPEG from its APP segments only.
+ *
+ * The raw thermal image is stored in a run of APP3 segments (APP4 for XT S), so only the
+ * segment lengths are needed to know its size. The segments themselves are skipped, which
+ * keeps the I/O to the first few KB plus a 4 byte marker read per segment.
+ * The image aspect ratio is taken from the SOF of the visible JPEG preview.
+ */
+class rjpeg_probe
+{
+public:
+    static int32_t probe_buffer(const uint8_t *data, size_t size, rjpeg_probe_info_t *info)
+    {
+        buffer_source source(data, size);
+        return probe(source, info);
+    }
+
+    static int32_t probe_file(const char *path, rjpeg_probe_info_t *info)
+    {
+        file_source source(path);
+        if (!source.is_open())
+        {
+            return DIRP_ERROR_INVALID_PARAMS;
+        }
+        return probe(source, info);
+    }
+
+private:
+    class buffer_source
+    {
+    public:
+        buffer_source(const uint8_t *data, size_t size) : m_data(data), m_size(size), m_bytes_read(0) {}
+
+        bool read(uint64_t offset, void *dst, size_t size)
+        {
+            if ((nullptr == m_data) || (offset + size > m_size))
+            {
+                return false;
+            }
+            memcpy(dst, m_data + offset, size);
+            m_bytes_read += size;
+            return true;
+        }
+
+        uint64_t bytes_read(void) const { return m_bytes_read; }
+
+    private:
+        const uint8_t  *m_data;
+        size_t          m_size;
+        uint64_t        m_bytes_read;
+    };
+
+    /* Unbuffered reads, the first RJPEG_PROBE_HEAD_SIZE bytes are fetched once and cached */
+    class file_source
+    {
+    public:
+        explicit file_source(const char *path) : m_file(fopen(path, "rb")), m_bytes_read(0)
+        {
+            if (m_file)
+            {
+                setvbuf(m_file, nullptr, _IONBF, 0);
+                m_head.resize(RJPEG_PROBE_HEAD_SIZE);
+                m_head.resize(fread(m_head.data(), 1, m_head.size(), m_file));
+                m_bytes_read = m_head.size();
+            }
+        }
+
+        ~file_source()
+        {
+            if (m_file)
+            {
+                fclose(m_file);
+            }
+        }
+
+        bool is_open(void) const { return nullptr != m_file; }
+
+        bool read(uint64_t offset, void *dst, size_t size)
+        {
+            if (offset < m_head.size())
+            {
+                size_t cached = (size_t)(m_head.size() - offset);
+                cached = (cached < size) ? cached : size;
+                memcpy(dst, m_head.data() + offset, cached);
+                offset += cached;
+                size -= cached;
+                dst = (uint8_t *)dst + cached;
+            }
+            if (0 == size)
+            {
+                return true;
+            }
+            if ((0 != fseek(m_file, (long)offset, SEEK_SET)) || (size != fread(dst, 1, size, m_file)))
+            {
+                return false;
+            }
+            m_bytes_read += size;
+            return true;
+        }
+
+        uint64_t bytes_read(void) const { return m_bytes_read; }
+
+    private:
+        FILE                   *m_file;
+        std::vector<uint8_t>    m_head;
+        uint64_t                m_bytes_read;
+    };
+
+    static bool is_sof(uint8_t marker)
+    {
+        return (marker >= 0xC0) && (marker <= 0xCF) && (marker != 0xC4) && (marker != 0xC8) && (marker != 0xCC);
+    }
+
+    template <typename S>
+    static void read_camera_model(S &source, uint64_t offset, size_t size, rjpeg_probe_info_t *info)
+    {
+        static const char exif_id[6] = {'E', 'x', 'i', 'f', 0, 0};
+        std::vector<uint8_t> exif;
+
+        /* IFD0 is at the start of EXIF, only fall back to the whole segment when Model points further */
+        size_t read_size = (size < RJPEG_PROBE_HEAD_SIZE) ? size : RJPEG_PROBE_HEAD_SIZE;
+        while (true)
+        {
+            exif.resize(read_size);
+            if (!source.read(offset, exif.data(), exif.size()) || (exif.size() <= sizeof(exif_id)) ||
+                (0 != memcmp(exif.data(), exif_id, sizeof(exif_id))))
+            {
+                return;
+            }
+
+            tiff_reader reader(exif.data() + sizeof(exif_id), exif.size() - sizeof(exif_id));
+            std::vector<tiff_entry_t> ifd0;
+            if (reader.valid() && reader.read_ifd(reader.first_ifd(), ifd0))
+            {
+                for (size_t i = 0; i < ifd0.size(); i++)
+                {
+                    if ((EXIF_TAG_MODEL == ifd0[i].tag) && (TIFF_TYPE_ASCII == ifd0[i].type))
+                    {
+                        size_t length = ifd0[i].value.size();
+                        if (length >= sizeof(info->camera_model))
+                        {
+                            length = sizeof(info->camera_model) - 1;
+                        }
+                        memcpy(info->camera_model, ifd0[i].value.data(), length);
+                        info->camera_model[length] = '\0';
+                        return;
+                    }
+                }
+            }
+
+            if ((read_size >= size) || (size > RJPEG_PROBE_EXIF_MAX))
+            {
+                return;
+            }
+            read_size = size;
+        }
+    }
+
+    template <typename S>
+    static int32_t probe(S &source, rjpeg_probe_info_t *info)
+    {
+        if (nullptr == info)
+        {
+            return DIRP_ERROR_POINTER_NULL;
+        }
+        memset(info, 0, sizeof(*info));
+
+        uint8_t  head[8] = {0};
+        uint64_t app3_size = 0;
+        uint64_t app4_size = 0;
+        uint64_t app4_first_size = 0;
+        uint8_t  app4_head[RJPEG_PROBE_APP4_HEAD_SIZE] = {0};
+        uint32_t sof_width = 0;
+        uint32_t sof_height = 0;
+
+        if (!source.read(0, head, 2) || (0xFF != head[0]) || (JPEG_MARKER_SOI != head[1]))
+        {
+            return DIRP_ERROR_RJPEG_PARSE;
+        }
+
+        uint64_t pos = 2;
+        while (source.read(pos, head, 4))
+        {
+            uint8_t marker = head[1];
+            if (0xFF != head[0])
+            {
+                return DIRP_ERROR_RJPEG_PARSE;
+            }
+            if (0xFF == marker)
+            {
+                pos++;                                  /* Fill byte */
+                continue;
+            }
+            if ((JPEG_MARKER_SOS == marker) || (JPEG_MARKER_EOI == marker))
+            {
+                break;
+            }
+
+            uint32_t length = ((uint32_t)head[2] << 8) | head[3];
+            if (length < 2)
+            {
+                return DIRP_ERROR_RJPEG_PARSE;
+            }
+            uint64_t payload = pos + 4;
+            uint32_t payload_size = length - 2;
+
+            if ((JPEG_MARKER_APP1 == marker) && ('\0' == info->camera_model[0]))
+            {
+                read_camera_model(source, payload, payload_size, info);
+            }
+            else if ((JPEG_MARKER_APP0 + 3) == marker)
+            {
+                app3_size += payload_size;
+            }
+            else if ((JPEG_MARKER_APP0 + 4) == marker)
+            {
+                if (0 == app4_size)
+                {
+                    app4_first_size = payload_size;
+                    source.read(payload, app4_head, (payload_size < sizeof(app4_head)) ? payload_size : sizeof(app4_head));
+                }
+                app4_size += payload_size;
+            }
+            else if (is_sof(marker) && (payload_size >= 5) && source.read(payload, head, 5))
+            {
+                sof_height = ((uint32_t)head[1] << 8) | head[2];
+                sof_width  = ((uint32_t)head[3] << 8) | head[4];
+            }
+
+            pos = payload + payload_size;
+        }
+        info->bytes_read = source.bytes_read();
+
+        /*
+         * Layout families, versions are the values dirp_get_rjpeg_version reports for them:
+         *   raw in APP3, APP4 header "aa 55 12 06"        : Zenmuse H20 series  0x1   / 0x103 / 0x1
+         *   raw in APP3, APP4 header "ff d2 d1 ff iirp"   : M30 series, M3T, H20N [153] / 0x1 / 0x1
+         *   raw in APP3, APP4 header "ff d2 d1 ff girp"   : M30 series (newer)  0x0   / 0x0   / 0x2
+         *   raw in APP3, 224 bytes APP4 header            : M2EA                0x100 / 0x1   / 0x1
+         *   raw in APP4, curve LUT in APP3                : Zenmuse XT S        0x1   / 0x1   / 0x1
+         * The iirp and M2EA families store 14-bit raw values shifted left by 2.
+         */
+        static const uint8_t header_h20[4]  = {0xAA, 0x55, 0x12, 0x06};
+        static const uint8_t header_iirp[8] = {0xFF, 0xD2, 0xD1, 0xFF, 'i', 'i', 'r', 'p'};
+        static const uint8_t header_girp[8] = {0xFF, 0xD2, 0xD1, 0xFF, 'g', 'i', 'r', 'p'};
+        uint64_t raw_size = 0;
+
+        if ((app3_size > app4_size) && (app4_first_size > 0))
+        {
+            raw_size = app3_size;
+            info->raw_marker = JPEG_MARKER_APP0 + 3;
+            if (0 == memcmp(app4_head, header_h20, sizeof(header_h20)))
+            {
+                info->version.rjpeg  = 0x1;
+                info->version.header = 0x103;
+                info->version.curve  = 0x1;
+            }
+            else if ((app4_first_size >= 157) && (0 == memcmp(app4_head, header_iirp, sizeof(header_iirp))))
+            {
+                /* Unaligned little endian version field, e.g. 0x200 or 0x10200 */
+                info->version.rjpeg  = (uint32_t)app4_head[153] | ((uint32_t)app4_head[154] << 8) |
+                                       ((uint32_t)app4_head[155] << 16) | ((uint32_t)app4_head[156] << 24);
+                info->version.header = 0x1;
+                info->version.curve  = 0x1;
+                info->raw_shift      = 2;
+            }
+            else if ((app4_first_size >= sizeof(header_girp)) && (0 == memcmp(app4_head, header_girp, sizeof(header_girp))))
+            {
+                info->version.rjpeg  = 0x0;
+                info->version.header = 0x0;
+                info->version.curve  = 0x2;
+            }
+            else if (224 == app4_first_size)
+            {
+                info->version.rjpeg  = 0x100;
+                info->version.header = 0x1;
+                info->version.curve  = 0x1;
+                info->raw_shift      = 2;
+            }
+            else
+            {
+                return DIRP_ERROR_INVALID_HEADER;
+            }
+        }
+        else if ((app4_size > app3_size) && (app3_size > 0))
+        {
+            raw_size = app4_size;
+            info->raw_marker     = JPEG_MARKER_APP0 + 4;
+            info->version.rjpeg  = 0x1;
+            info->version.header = 0x1;
+            info->version.curve  = 0x1;
+        }
+        else
+        {
+            return DIRP_ERROR_INVALID_RAW;
+        }
+
+        /* RAW16 pixel count with the aspect ratio of the preview, which may be upscaled */
+        uint64_t pixels = raw_size / sizeof(uint16_t);
+        if ((0 == sof_width) || (0 == sof_height))
+        {
+            return DIRP_ERROR_RJPEG_PARSE;
+        }
+        uint64_t width = (uint64_t)(sqrt((double)pixels * sof_width / sof_height) + 0.5);
+        if ((0 == width) || (0 != pixels % width))
+        {
+            return DIRP_ERROR_INVALID_RAW;
+        }
+        info->resolution.width  = (int32_t)width;
+        info->resolution.height = (int32_t)(pixels / width);
+
+        return DIRP_SUCCESS;
+    }
+};
+
+#endif /* _RJPEG_PROBE_H_ */
@@ -0,0 +1,426 @@
+/*
+ * Append-only checkpoint journal of batch runs for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _RUN_JOURNAL_H_
+#define _RUN_JOURNAL_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define RUN_JOURNAL_SYNC_RECORDS                (64)        /* Records written per fsync at most */
+#define RUN_JOURNAL_SYNC_MS                     (1000)      /* Max age of an unsynced record */
+
+/*
+ * One line per finished input : status, size, modification time, options digest, source path and
+ * output path, separated by tabs with tabs, new lines and backslashes in paths escaped.
+ * The options digest identifies everything besides the source that decides the output, so a run
+ * with other options, or writing elsewhere, converts a journaled file again.
+ * Records are buffered and written with one write and fsync per batch, so a crash loses at most
+ * the last second or RUN_JOURNAL_SYNC_RECORDS files, which are simply converted again. The outputs
+ * named by a batch are synced together right before it, so a journaled output survives a power loss;
+ * a record whose output fails to sync is dropped. The batch is written outside the append lock.
+ * A torn last line, and lines of older journals without a digest, are ignored when the journal is loaded.
+ */
+class run_journal
+{
+public:
+    typedef struct
+    {
+        int32_t     status;
+        uint64_t    size;
+        int64_t     mtime_ns;
+        std::string options;                    /* Set by append() */
+        std::string source;
+        std::string output;
+    } record_t;
+
+    run_journal(void)
+    {
+    }
+
+    ~run_journal(void)
+    {
+        close();
+    }
+
+    /*
+     * Open for appending. With resume the records of earlier runs are loaded, otherwise the journal is restarted.
+     * options is the digest of the conversion options of this run, records of other options are never done.
+     */
+    bool open(const std::string &path, bool resume, const std::string &options)
+    {
+        m_options = options;
+        if (resume)
+        {
+            prv_load(path);
+        }
+
+#ifdef _WIN32
+        m_fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY | (resume ? 0 : _O_TRUNC), _S_IREAD | _S_IWRITE);
+#else
+        m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (resume ? 0 : O_TRUNC), 0644);
+#endif
+        m_last_sync = std::chrono::steady_clock::now();
+
+        return (m_fd >= 0);
+    }
+
+    /* Called before the outputs of each batch are synced, e.g. to flush a report all records name */
+    void set_before_sync(const std::function<bool(void)> &before_sync)
+    {
+        m_before_sync = before_sync;
+    }
+
+    void close(void)
+    {
+        if (m_fd >= 0)
+        {
+            std::vector<pending_t> batch;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                batch.swap(m_pending);
+            }
+            prv_sync(batch);
+
+            std::lock_guard<std::mutex> lock(m_sync_mutex);
+#ifdef _WIN32
+            _close(m_fd);
+#else
+            ::close(m_fd);
+#endif
+            m_fd = -1;
+        }
+    }
+
+    /* Size and modification time identify the version of a source file */
+    static bool file_state(const std::string &path, uint64_t *size, int64_t *mtime_ns)
+    {
+#ifdef _WIN32
+        struct _stat64 info;
+        if (0 != _stat64(path.c_str(), &info))
+        {
+            return false;
+        }
+        *mtime_ns = (int64_t)info.st_mtime * 1000000000;
+#else
+        struct stat info;
+        if (0 != stat(path.c_str(), &info))
+        {
+            return false;
+        }
+#ifdef __APPLE__
+        *mtime_ns = (int64_t)info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+        *mtime_ns = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+#endif
+        *size = (uint64_t)info.st_size;
+        return true;
+    }
+
+    /*
+     * True when an earlier run converted this version of source successfully with the options of this run
+     * into output, and output is still there
+     */
+    bool is_done(const std::string &source, uint64_t size, int64_t mtime_ns, const std::string &output)
+    {
+        std::unordered_map<std::string, record_t>::const_iterator it = m_done.find(source);
+        uint64_t output_size = 0;
+        int64_t output_mtime = 0;
+
+        if ((m_done.end() == it) || (it->second.size != size) || (it->second.mtime_ns != mtime_ns) ||
+            (it->second.options != m_options) || (it->second.output != output) ||
+            !file_state(output, &output_size, &output_mtime))
+        {
+            return false;
+        }
+        m_skipped++;
+
+        return true;
+    }
+
+    /* Write the data of a finished output to the disk, so its record never outlives it */
+    static bool sync_file(const std::string &path)
+    {
+#ifdef _WIN32
+        int fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        bool synced = (0 == _commit(fd));
+        _close(fd);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        bool synced = (0 == fsync(fd));
+        ::close(fd);
+#endif
+        return synced;
+    }
+
+    /* With sync_output the output file of the record is synced with its batch, before the record is written */
+    void append(const record_t &record, bool sync_output)
+    {
+        pending_t pending;
+        pending.line = std::to_string(record.status) + "\t" + std::to_string(record.size) + "\t" +
+                       std::to_string(record.mtime_ns) + "\t" + prv_escape(m_options) + "\t" +
+                       prv_escape(record.source) + "\t" + prv_escape(record.output) + "\n";
+        if (sync_output)
+        {
+            pending.output = record.output;
+        }
+
+        std::vector<pending_t> batch;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pending.push_back(std::move(pending));
+            m_appended++;
+            if ((m_pending.size() >= RUN_JOURNAL_SYNC_RECORDS) ||
+                (std::chrono::steady_clock::now() - m_last_sync >= std::chrono::milliseconds(RUN_JOURNAL_SYNC_MS)))
+            {
+                batch.swap(m_pending);
+                m_last_sync = std::chrono::steady_clock::now();
+            }
+        }
+        prv_sync(batch);
+    }
+
+    size_t loaded_count(void) const     { return m_done.size(); }
+    uint64_t skipped_count(void) const  { return m_skipped.load(); }
+    uint64_t appended_count(void) const { return m_appended; }
+    uint64_t sync_count(void) const     { return m_syncs; }
+    uint64_t dropped_count(void) const  { return m_dropped; }
+
+private:
+    typedef struct
+    {
+        std::string line;
+        std::string output;                     /* Synced before line is written, empty for none */
+    } pending_t;
+
+    /* Sync the outputs of a batch, then write and sync its records. Batches of several threads take turns */
+    void prv_sync(const std::vector<pending_t> &batch)
+    {
+        if (batch.empty())
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_sync_mutex);
+        if (m_fd < 0)
+        {
+            return;
+        }
+
+        bool before_synced = !m_before_sync || m_before_sync();
+        std::vector<bool> synced = prv_sync_outputs(batch);
+        std::string content;
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            if (before_synced && synced[i])
+            {
+                content += batch[i].line;
+            }
+            else
+            {
+                m_dropped++;
+            }
+        }
+
+#ifdef _WIN32
+        _write(m_fd, content.data(), (unsigned int)content.size());
+        _commit(m_fd);
+#else
+        size_t written = 0;
+        while (written < content.size())
+        {
+            ssize_t count = write(m_fd, content.data() + written, content.size() - written);
+            if (count <= 0)
+            {
+                break;
+            }
+            written += (size_t)count;
+        }
+        fsync(m_fd);
+#endif
+        m_syncs++;
+    }
+
+    /* On Linux the write back of all outputs is started first, so the fsync calls mostly find clean pages */
+    static std::vector<bool> prv_sync_outputs(const std::vector<pending_t> &batch)
+    {
+        std::vector<bool> synced(batch.size(), true);
+#if defined(__linux__)
+        std::vector<int> fds(batch.size(), -1);
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            if (!batch[i].output.empty())
+            {
+                fds[i] = ::open(batch[i].output.c_str(), O_RDONLY | O_CLOEXEC);
+                synced[i] = (fds[i] >= 0);
+                if (synced[i])
+                {
+                    sync_file_range(fds[i], 0, 0, SYNC_FILE_RANGE_WRITE);
+                }
+            }
+        }
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            if (fds[i] >= 0)
+            {
+                synced[i] = (0 == fsync(fds[i]));
+                ::close(fds[i]);
+            }
+        }
+#else
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            if (!batch[i].output.empty())
+            {
+                synced[i] = sync_file(batch[i].output);
+            }
+        }
+#endif
+        return synced;
+    }
+
+    static std::string prv_escape(const std::string &text)
+    {
+        std::string out;
+        for (char c : text)
+        {
+            if      ('\\' == c) out += "\\\\";
+            else if ('\t' == c) out += "\\t";
+            else if ('\n' == c) out += "\\n";
+            else                out += c;
+        }
+        return out;
+    }
+
+    static std::string prv_unescape(const std::string &text)
+    {
+        std::string out;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            if (('\\' == text[i]) && (i + 1 < text.size()))
+            {
+                char c = text[++i];
+                out += ('t' == c) ? '\t' : ('n' == c) ? '\n' : c;
+            }
+            else
+            {
+                out += text[i];
+            }
+        }
+        return out;
+    }
+
+    /* Later records of a source replace earlier ones, only successful conversions are kept */
+    void prv_load(const std::string &path)
+    {
+        std::ifstream fs(path.c_str(), std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+        size_t start = 0;
+
+        for (size_t end = content.find('\n'); std::string::npos != end; start = end + 1, end = content.find('\n', start))
+        {
+            std::vector<std::string> fields;
+            size_t field_start = start;
+            for (size_t i = start; i <= end; i++)
+            {
+                if ((i == end) || ('\t' == content[i]))
+                {
+                    fields.push_back(content.substr(field_start, i - field_start));
+                    field_start = i + 1;
+                }
+            }
+            if (6 != fields.size())
+            {
+                continue;
+            }
+
+            record_t record;
+            try
+            {
+                record.status   = std::stoi(fields[0]);
+                record.size     = std::stoull(fields[1]);
+                record.mtime_ns = std::stoll(fields[2]);
+            }
+            catch (...)
+            {
+                continue;
+            }
+            record.options = prv_unescape(fields[3]);
+            record.source  = prv_unescape(fields[4]);
+            record.output  = prv_unescape(fields[5]);
+
+            if (0 == record.status)
+            {
+                m_done[record.source] = record;
+            }
+            else
+            {
+                m_done.erase(record.source);
+            }
+        }
+    }
+
+    std::string                                 m_options;
+    std::unordered_map<std::string, record_t>   m_done;
+    std::atomic<uint64_t>                       m_skipped {0};
+    std::mutex                                  m_mutex;
+    std::vector<pending_t>                      m_pending;
+    uint64_t                                    m_appended = 0;
+    std::chrono::steady_clock::time_point       m_last_sync;
+    std::mutex                                  m_sync_mutex;       /* Held while a batch is written, after m_mutex is released */
+    std::function<bool(void)>                   m_before_sync;
+    uint64_t                                    m_syncs = 0;
+    uint64_t                                    m_dropped = 0;
+    int                                         m_fd = -1;
+};
+
+#endif /* _RUN_JOURNAL_H_ */
@@ -0,0 +1,175 @@
+/*
+ * Request and reply format of the dji_irp conversion daemon for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _SERVE_PROTOCOL_H_
+#define _SERVE_PROTOCOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#define SERVE_PROTOCOL_VERSION                  (1)
+#define SERVE_MAX_DATA_SIZE                     (256u << 20)    /* Largest R-JPEG accepted in one request */
+#define SERVE_POLL_MS                           (200)           /* Period of the stop flag check while waiting */
+
+/* serve_request_t.flags */
+#define SERVE_FLAG_FLOAT32                      (1u << 0)       /* measure : FLOAT32 Celsius instead of INT16 deci-Celsius */
+#define SERVE_FLAG_STRECH                       (1u << 1)       /* process : FLOAT32 strech only instead of RGB */
+
+/* serve_request_t.params, same bits as TC_PARAM_* of thermal_convert.h */
+#define SERVE_PARAM_DISTANCE                    (1u << 0)
+#define SERVE_PARAM_HUMIDITY                    (1u << 1)
+#define SERVE_PARAM_EMISSIVITY                  (1u << 2)
+#define SERVE_PARAM_REFLECTION                  (1u << 3)
+
+/* serve_reply_t.dtype, same codes as frame_container */
+#define SERVE_DTYPE_UINT8                       (1)
+#define SERVE_DTYPE_UINT16                      (2)
+#define SERVE_DTYPE_INT16                       (3)
+#define SERVE_DTYPE_FLOAT32                     (4)
+
+/*
+ * A connection carries any number of request / reply pairs, little endian :
+ *   request  | serve_request_t, then data_size bytes of R-JPEG
+ *   reply    | serve_reply_t, then data_size bytes of row major output pixels
+ * A reply with a non zero status carries no pixels. A request with a wrong magic, version
+ * or size is answered with DIRP_ERROR_INVALID_PARAMS and the connection is closed.
+ */
+typedef struct
+{
+    char        magic[4];                       /* "DIRQ" */
+    uint32_t    version;                        /* SERVE_PROTOCOL_VERSION */
+    uint32_t    action;                         /* 0: extract | 1: measure | 2: process */
+    uint32_t    flags;                          /* SERVE_FLAG_* */
+    uint32_t    params;                         /* SERVE_PARAM_* bits of the fields below to override */
+    float       distance;
+    float       humidity;
+    float       emissivity;
+    float       reflection;
+    int32_t     palette;                        /* process : dirp_pseudo_color_e, negative keeps the R-JPEG value */
+    int32_t     brightness;                     /* process : [0,100], negative keeps the R-JPEG value */
+    uint32_t    data_size;                      /* R-JPEG bytes following the request */
+} serve_request_t;
+
+typedef struct
+{
+    char        magic[4];                       /* "DIRS" */
+    int32_t     status;                         /* dirp_ret_code_e */
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    channels;
+    uint32_t    dtype;                          /* SERVE_DTYPE_* */
+    uint32_t    data_size;                      /* Output bytes following the reply */
+    uint32_t    elapsed_us;                     /* Time the daemon spent on the request */
+} serve_reply_t;
+
+static_assert(sizeof(serve_request_t) == 48, "serve_request_t layout is part of the protocol");
+static_assert(sizeof(serve_reply_t) == 32, "serve_reply_t layout is part of the protocol");
+
+#ifndef _WIN32
+/*
+ * Blocking transfers of whole messages on a connected stream socket.
+ * Waiting for data wakes up every SERVE_POLL_MS to check *stop, so workers of a stopping
+ * daemon do not hang on idle clients.
+ */
+class serve_socket
+{
+public:
+    static bool recv_all(int fd, void *data, size_t size, const volatile sig_atomic_t *stop)
+    {
+        uint8_t *cursor = (uint8_t *)data;
+
+        while (size > 0)
+        {
+            struct pollfd poll_fd = {fd, POLLIN, 0};
+            int ready = poll(&poll_fd, 1, SERVE_POLL_MS);
+            if (ready < 0)
+            {
+                if (EINTR == errno)
+                {
+                    continue;
+                }
+                return false;
+            }
+            if (0 == ready)
+            {
+                if ((nullptr != stop) && *stop)
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            ssize_t received = recv(fd, cursor, size, 0);
+            if (received <= 0)
+            {
+                if ((received < 0) && (EINTR == errno))
+                {
+                    continue;
+                }
+                return false;
+            }
+            cursor += received;
+            size   -= received;
+        }
+
+        return true;
+    }
+
+    /* A client that went away makes this return false instead of raising SIGPIPE */
+    static bool send_all(int fd, const void *data, size_t size)
+    {
+        const uint8_t *cursor = (const uint8_t *)data;
+
+        while (size > 0)
+        {
+            ssize_t sent = send(fd, cursor, size, MSG_NOSIGNAL);
+            if (sent <= 0)
+            {
+                if ((sent < 0) && (EINTR == errno))
+                {
+                    continue;
+                }
+                return false;
+            }
+            cursor += sent;
+            size   -= sent;
+        }
+
+        return true;
+    }
+};
+#endif
+
+#endif /* _SERVE_PROTOCOL_H_ */
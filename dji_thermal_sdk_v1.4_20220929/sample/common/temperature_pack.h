@@ -0,0 +1,143 @@
+/*
+ * Half float packing of temperature images for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _TEMPERATURE_PACK_H_
+#define _TEMPERATURE_PACK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "color_mapping.h"
+
+#if defined(COLOR_MAPPING_X86) && defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
+/*
+ * Converts FLOAT32 Celsius images to IEEE half floats, which halves the output and keeps a step
+ * of 1/32 degree up to 64 C and 1/16 degree up to 128 C, finer than the 0.1 C of dirp_measure.
+ * Rounding is to nearest even, out of range values become infinity, as the F16C instruction does,
+ * so the AVX2 kernel and the scalar tail give identical bits.
+ */
+class temperature_pack
+{
+public:
+    /* Convert count pixels of src into dst */
+    static void to_float16(const float *src, size_t count, uint16_t *dst)
+    {
+        size_t done = 0;
+#ifdef COLOR_MAPPING_X86
+        static const bool f16c = f16c_supported();
+        if (f16c)
+        {
+            done = to_float16_f16c(src, count, dst);
+        }
+#endif
+        for (size_t i = done; i < count; i++)
+        {
+            dst[i] = half_from_float(src[i]);
+        }
+    }
+
+    /* The AVX2 kernel needs F16C too, which every AVX2 CPU has so far */
+    static bool f16c_supported(void)
+    {
+        if (color_mapping_isa_avx2 != color_mapping::best_isa())
+        {
+            return false;
+        }
+#if defined(COLOR_MAPPING_X86) && defined(__GNUC__)
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (0 != (ecx & bit_F16C));
+#elif defined(COLOR_MAPPING_X86)
+        int32_t info[4];
+        __cpuid(info, 1);
+        return (0 != (info[2] & (1 << 29)));
+#else
+        return false;
+#endif
+    }
+
+    static uint16_t half_from_float(float value)
+    {
+        const uint32_t f32_infinity = 255u << 23;
+        const uint32_t f16_overflow = (127u + 16) << 23;       /* 65536, rounds to infinity from 65520 on */
+        const uint32_t denorm_magic = ((127u - 15) + (23 - 10) + 1) << 23;
+        uint32_t bits = 0;
+        uint16_t half = 0;
+
+        memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = bits & 0x80000000u;
+        bits ^= sign;
+
+        if (bits >= f16_overflow)
+        {
+            half = (bits > f32_infinity) ? 0x7E00 : 0x7C00;    /* NaN stays NaN */
+        }
+        else if (bits < (113u << 23))
+        {
+            /* Half subnormal or zero, adding the magic number makes the FPU round the mantissa */
+            float magic = 0;
+            float shifted = 0;
+            memcpy(&magic, &denorm_magic, sizeof(magic));
+            memcpy(&shifted, &bits, sizeof(shifted));
+            shifted += magic;
+            memcpy(&bits, &shifted, sizeof(bits));
+            half = (uint16_t)(bits - denorm_magic);
+        }
+        else
+        {
+            uint32_t mantissa_odd = (bits >> 13) & 1;
+            bits += ((uint32_t)(15 - 127) << 23) + 0xFFF + mantissa_odd;
+            half = (uint16_t)(bits >> 13);
+        }
+
+        return half | (uint16_t)(sign >> 16);
+    }
+
+private:
+#ifdef COLOR_MAPPING_X86
+    COLOR_MAPPING_TARGET("avx2,f16c")
+    static size_t to_float16_f16c(const float *src, size_t count, uint16_t *dst)
+    {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            __m256  low   = _mm256_loadu_ps(src + i);
+            __m256  high  = _mm256_loadu_ps(src + i + 8);
+            __m128i low16  = _mm256_cvtps_ph(low,  _MM_FROUND_TO_NEAREST_INT);
+            __m128i high16 = _mm256_cvtps_ph(high, _MM_FROUND_TO_NEAREST_INT);
+            _mm256_storeu_si256((__m256i *)(dst + i), _mm256_insertf128_si256(_mm256_castsi128_si256(low16), high16, 1));
+        }
+
+        return i;
+    }
+#endif
+};
+
+#endif /* _TEMPERATURE_PACK_H_ */
@@ -0,0 +1,566 @@
+/*
+ * Temperature statistics of whole frames and polygon ROIs for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _TEMPERATURE_STATS_H_
+#define _TEMPERATURE_STATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "color_mapping.h"
+#include "json_string.h"
+
+/* Polygon in pixel coordinates, a pixel belongs to it when its center is inside (even-odd rule) */
+typedef struct
+{
+    std::string         name;
+    std::vector<float>  points;             /* x0, y0, x1, y1, ... */
+} stats_roi_t;
+
+/* What to report for every region, shared by all images of a run */
+typedef struct
+{
+    std::vector<stats_roi_t>    rois;
+    std::vector<float>          percentiles;        /* In [0, 100], ascending */
+    int32_t                     hist_bins;          /* 0 : no histogram */
+    float                       hist_low;
+    float                       hist_high;
+    bool                        json;               /* JSON lines instead of CSV */
+} stats_options_t;
+
+/* Statistics of one region, min and max come with the coordinates of their first pixel in row order */
+typedef struct
+{
+    uint64_t                pixels;
+    float                   min;
+    float                   max;
+    double                  mean;
+    double                  std;
+    int32_t                 min_x, min_y;
+    int32_t                 max_x, max_y;
+    std::vector<float>      percentiles;
+    std::vector<uint32_t>   histogram;
+} stats_region_t;
+
+/*
+ * Reduces a FLOAT32 temperature frame in memory, as filled by dirp_measure_ex, to per region statistics.
+ * A region is a list of row spans, the whole frame is one span. Min, max, sum and sum of squares of each
+ * span are reduced with the widest SIMD kernel color_mapping picks for the CPU, sums in double precision.
+ * Percentiles are exact, interpolated linearly between order statistics like numpy.percentile.
+ */
+class temperature_stats
+{
+public:
+    explicit temperature_stats(const stats_options_t &options)
+        : m_options(options), m_isa(color_mapping::best_isa())
+    {
+    }
+
+    /* Fill regions with the whole frame followed by every ROI of the options */
+    void compute(const float *frame, int32_t width, int32_t height, std::vector<stats_region_t> &regions)
+    {
+        std::vector<span_t> spans;
+
+        regions.resize(1 + m_options.rois.size());
+
+        spans.push_back(span_t{0, (uint64_t)width * height});
+        prv_region(frame, width, spans, regions[0]);
+
+        for (size_t i = 0; i < m_options.rois.size(); i++)
+        {
+            prv_polygon_spans(m_options.rois[i].points, width, height, spans);
+            prv_region(frame, width, spans, regions[1 + i]);
+        }
+    }
+
+    /* Header line of the CSV report */
+    static std::string csv_header(const stats_options_t &options)
+    {
+        std::string header = "source,width,height";
+
+        prv_csv_region_header(options, "frame", header);
+        for (size_t i = 0; i < options.rois.size(); i++)
+        {
+            prv_csv_region_header(options, options.rois[i].name, header);
+        }
+
+        return header + "\n";
+    }
+
+    /* One report row without the leading source field, CSV fields or JSON members */
+    static std::string format(const stats_options_t &options, int32_t width, int32_t height, const std::vector<stats_region_t> &regions)
+    {
+        std::ostringstream row;
+
+        row.precision(6);
+        if (!options.json)
+        {
+            row << width << "," << height;
+            for (size_t i = 0; i < regions.size(); i++)
+            {
+                prv_csv_region(options, regions[i], row);
+            }
+            return row.str();
+        }
+
+        row << "\"width\":" << width << ",\"height\":" << height << ",\"regions\":{";
+        for (size_t i = 0; i < regions.size(); i++)
+        {
+            row << ((0 == i) ? "\"frame\":" : (",\"" + options.rois[i - 1].name + "\":"));
+            prv_json_region(options, regions[i], row);
+        }
+        row << "}";
+
+        return row.str();
+    }
+
+private:
+    typedef struct
+    {
+        uint64_t    offset;
+        uint64_t    count;
+    } span_t;
+
+    typedef struct
+    {
+        float       min;
+        float       max;
+        double      sum;
+        double      sum_sq;
+    } reduce_t;
+
+    /* Row spans of the pixels whose centers lie inside the polygon */
+    static void prv_polygon_spans(const std::vector<float> &points, int32_t width, int32_t height, std::vector<span_t> &spans)
+    {
+        size_t vertex_count = points.size() / 2;
+        std::vector<float> crossings;
+
+        spans.clear();
+        for (int32_t y = 0; y < height; y++)
+        {
+            float yc = y + 0.5f;
+
+            crossings.clear();
+            for (size_t i = 0, j = vertex_count - 1; i < vertex_count; j = i++)
+            {
+                float x0 = points[j * 2], y0 = points[j * 2 + 1];
+                float x1 = points[i * 2], y1 = points[i * 2 + 1];
+                if ((y0 <= yc) != (y1 <= yc))
+                {
+                    crossings.push_back(x0 + (yc - y0) * (x1 - x0) / (y1 - y0));
+                }
+            }
+            std::sort(crossings.begin(), crossings.end());
+
+            for (size_t i = 0; i + 1 < crossings.size(); i += 2)
+            {
+                int32_t x_begin = std::max(0,     (int32_t)ceilf(crossings[i] - 0.5f));
+                int32_t x_end   = std::min(width, (int32_t)ceilf(crossings[i + 1] - 0.5f));
+                if (x_end > x_begin)
+                {
+                    spans.push_back(span_t{(uint64_t)y * width + x_begin, (uint64_t)(x_end - x_begin)});
+                }
+            }
+        }
+    }
+
+    void prv_region(const float *frame, int32_t width, const std::vector<span_t> &spans, stats_region_t &region)
+    {
+        reduce_t total = {INFINITY, -INFINITY, 0, 0};
+
+        region.pixels = 0;
+        for (const span_t &span : spans)
+        {
+            prv_reduce(frame + span.offset, span.count, total);
+            region.pixels += span.count;
+        }
+
+        region.percentiles.assign(m_options.percentiles.size(), NAN);
+        region.histogram.assign(m_options.hist_bins, 0);
+        if (0 == region.pixels)
+        {
+            region.min  = region.max  = NAN;
+            region.mean = region.std  = NAN;
+            region.min_x = region.min_y = region.max_x = region.max_y = -1;
+            return;
+        }
+
+        region.min  = total.min;
+        region.max  = total.max;
+        region.mean = total.sum / region.pixels;
+        region.std  = sqrt(std::max(0.0, total.sum_sq / region.pixels - region.mean * region.mean));
+
+        uint64_t min_offset = prv_find(frame, spans, region.min);
+        uint64_t max_offset = prv_find(frame, spans, region.max);
+        region.min_x = (int32_t)(min_offset % width);
+        region.min_y = (int32_t)(min_offset / width);
+        region.max_x = (int32_t)(max_offset % width);
+        region.max_y = (int32_t)(max_offset / width);
+
+        if (!m_options.percentiles.empty())
+        {
+            prv_percentiles(frame, spans, region);
+        }
+        if (m_options.hist_bins > 0)
+        {
+            prv_histogram(frame, spans, region);
+        }
+    }
+
+    void prv_reduce(const float *src, uint64_t count, reduce_t &acc) const
+    {
+        uint64_t done = 0;
+#ifdef COLOR_MAPPING_X86
+        if (color_mapping_isa_avx2 == m_isa)
+        {
+            done = prv_reduce_avx2(src, count, acc);
+        }
+        else if (color_mapping_isa_sse41 == m_isa)
+        {
+            done = prv_reduce_sse(src, count, acc);
+        }
+#endif
+        for (uint64_t i = done; i < count; i++)
+        {
+            acc.min     = std::min(acc.min, src[i]);
+            acc.max     = std::max(acc.max, src[i]);
+            acc.sum    += src[i];
+            acc.sum_sq += (double)src[i] * src[i];
+        }
+    }
+
+#ifdef COLOR_MAPPING_X86
+    COLOR_MAPPING_TARGET("sse4.1")
+    static uint64_t prv_reduce_sse(const float *src, uint64_t count, reduce_t &acc)
+    {
+        __m128  vmin = _mm_set1_ps(acc.min);
+        __m128  vmax = _mm_set1_ps(acc.max);
+        __m128d vsum = _mm_setzero_pd();
+        __m128d vsq  = _mm_setzero_pd();
+
+        uint64_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128  value = _mm_loadu_ps(src + i);
+            __m128d low   = _mm_cvtps_pd(value);
+            __m128d high  = _mm_cvtps_pd(_mm_movehl_ps(value, value));
+            vmin = _mm_min_ps(vmin, value);
+            vmax = _mm_max_ps(vmax, value);
+            vsum = _mm_add_pd(vsum, _mm_add_pd(low, high));
+            vsq  = _mm_add_pd(vsq,  _mm_add_pd(_mm_mul_pd(low, low), _mm_mul_pd(high, high)));
+        }
+
+        float  lanes_min[4], lanes_max[4];
+        double lanes_sum[2], lanes_sq[2];
+        _mm_storeu_ps(lanes_min, vmin);
+        _mm_storeu_ps(lanes_max, vmax);
+        _mm_storeu_pd(lanes_sum, vsum);
+        _mm_storeu_pd(lanes_sq,  vsq);
+        for (int32_t lane = 0; lane < 4; lane++)
+        {
+            acc.min = std::min(acc.min, lanes_min[lane]);
+            acc.max = std::max(acc.max, lanes_max[lane]);
+        }
+        acc.sum    += lanes_sum[0] + lanes_sum[1];
+        acc.sum_sq += lanes_sq[0]  + lanes_sq[1];
+
+        return i;
+    }
+
+    COLOR_MAPPING_TARGET("avx2")
+    static uint64_t prv_reduce_avx2(const float *src, uint64_t count, reduce_t &acc)
+    {
+        __m256  vmin = _mm256_set1_ps(acc.min);
+        __m256  vmax = _mm256_set1_ps(acc.max);
+        __m256d vsum = _mm256_setzero_pd();
+        __m256d vsq  = _mm256_setzero_pd();
+
+        uint64_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256  value = _mm256_loadu_ps(src + i);
+            __m256d low   = _mm256_cvtps_pd(_mm256_castps256_ps128(value));
+            __m256d high  = _mm256_cvtps_pd(_mm256_extractf128_ps(value, 1));
+            vmin = _mm256_min_ps(vmin, value);
+            vmax = _mm256_max_ps(vmax, value);
+            vsum = _mm256_add_pd(vsum, _mm256_add_pd(low, high));
+            vsq  = _mm256_add_pd(vsq,  _mm256_add_pd(_mm256_mul_pd(low, low), _mm256_mul_pd(high, high)));
+        }
+
+        float  lanes_min[8], lanes_max[8];
+        double lanes_sum[4], lanes_sq[4];
+        _mm256_storeu_ps(lanes_min, vmin);
+        _mm256_storeu_ps(lanes_max, vmax);
+        _mm256_storeu_pd(lanes_sum, vsum);
+        _mm256_storeu_pd(lanes_sq,  vsq);
+        for (int32_t lane = 0; lane < 8; lane++)
+        {
+            acc.min = std::min(acc.min, lanes_min[lane]);
+            acc.max = std::max(acc.max, lanes_max[lane]);
+        }
+        acc.sum    += lanes_sum[0] + lanes_sum[1] + lanes_sum[2] + lanes_sum[3];
+        acc.sum_sq += lanes_sq[0]  + lanes_sq[1]  + lanes_sq[2]  + lanes_sq[3];
+
+        return i;
+    }
+#endif
+
+    /* Frame offset of the first pixel of the region holding value */
+    static uint64_t prv_find(const float *frame, const std::vector<span_t> &spans, float value)
+    {
+        for (const span_t &span : spans)
+        {
+            const float *begin = frame + span.offset;
+            const float *found = std::find(begin, begin + span.count, value);
+            if (found != begin + span.count)
+            {
+                return span.offset + (found - begin);
+            }
+        }
+        return 0;
+    }
+
+    void prv_percentiles(const float *frame, const std::vector<span_t> &spans, stats_region_t &region)
+    {
+        m_scratch.clear();
+        for (const span_t &span : spans)
+        {
+            m_scratch.insert(m_scratch.end(), frame + span.offset, frame + span.offset + span.count);
+        }
+
+        /* Ascending ranks, so every nth_element only works on the part above the previous one */
+        std::vector<float>::iterator sorted = m_scratch.begin();
+        for (size_t i = 0; i < m_options.percentiles.size(); i++)
+        {
+            double position = m_options.percentiles[i] / 100.0 * (m_scratch.size() - 1);
+            uint64_t rank = (uint64_t)position;
+            std::vector<float>::iterator nth = m_scratch.begin() + rank;
+
+            std::nth_element(sorted, nth, m_scratch.end());
+            float value = *nth;
+            if ((position > rank) && (nth + 1 != m_scratch.end()))
+            {
+                float next = *std::min_element(nth + 1, m_scratch.end());
+                value += (float)((position - rank) * (next - value));
+            }
+            region.percentiles[i] = value;
+            sorted = nth;
+        }
+    }
+
+    /* Equal width bins over [hist_low, hist_high], values outside fall into the first or last bin */
+    void prv_histogram(const float *frame, const std::vector<span_t> &spans, stats_region_t &region) const
+    {
+        float scale = m_options.hist_bins / (m_options.hist_high - m_options.hist_low);
+        int32_t last = m_options.hist_bins - 1;
+
+        for (const span_t &span : spans)
+        {
+            const float *src = frame + span.offset;
+            for (uint64_t i = 0; i < span.count; i++)
+            {
+                float bin = (src[i] - m_options.hist_low) * scale;
+                region.histogram[(bin <= 0) ? 0 : std::min(last, (int32_t)bin)]++;
+            }
+        }
+    }
+
+    static void prv_csv_region_header(const stats_options_t &options, const std::string &name, std::string &header)
+    {
+        static const char *fields[] = {"pixels", "min", "max", "mean", "std", "min_x", "min_y", "max_x", "max_y"};
+
+        for (const char *field : fields)
+        {
+            header += "," + name + "_" + field;
+        }
+        for (float percentile : options.percentiles)
+        {
+            std::ostringstream field;
+            field << "," << name << "_p" << percentile;
+            header += field.str();
+        }
+        if (options.hist_bins > 0)
+        {
+            header += "," + name + "_histogram";
+        }
+    }
+
+    /* NaN of an empty region is an empty CSV field and a JSON null */
+    static void prv_value(std::ostream &out, double value, bool json)
+    {
+        if (!std::isnan(value))
+        {
+            out << value;
+        }
+        else if (json)
+        {
+            out << "null";
+        }
+    }
+
+    static void prv_csv_region(const stats_options_t &options, const stats_region_t &region, std::ostream &row)
+    {
+        row << "," << region.pixels;
+        row << ",";   prv_value(row, region.min,  false);
+        row << ",";   prv_value(row, region.max,  false);
+        row << ",";   prv_value(row, region.mean, false);
+        row << ",";   prv_value(row, region.std,  false);
+        row << "," << region.min_x << "," << region.min_y << "," << region.max_x << "," << region.max_y;
+        for (float value : region.percentiles)
+        {
+            row << ",";
+            prv_value(row, value, false);
+        }
+        if (options.hist_bins > 0)
+        {
+            row << ",";
+            for (size_t i = 0; i < region.histogram.size(); i++)
+            {
+                row << ((0 == i) ? "" : " ") << region.histogram[i];
+            }
+        }
+    }
+
+    static void prv_json_region(const stats_options_t &options, const stats_region_t &region, std::ostream &row)
+    {
+        row << "{\"pixels\":" << region.pixels;
+        row << ",\"min\":";   prv_value(row, region.min,  true);
+        row << ",\"max\":";   prv_value(row, region.max,  true);
+        row << ",\"mean\":";  prv_value(row, region.mean, true);
+        row << ",\"std\":";   prv_value(row, region.std,  true);
+        row << ",\"min_xy\":[" << region.min_x << "," << region.min_y << "]";
+        row << ",\"max_xy\":[" << region.max_x << "," << region.max_y << "]";
+        row << ",\"percentiles\":{";
+        for (size_t i = 0; i < region.percentiles.size(); i++)
+        {
+            row << ((0 == i) ? "" : ",") << "\"" << options.percentiles[i] << "\":";
+            prv_value(row, region.percentiles[i], true);
+        }
+        row << "}";
+        if (options.hist_bins > 0)
+        {
+            row << ",\"histogram\":[";
+            for (size_t i = 0; i < region.histogram.size(); i++)
+            {
+                row << ((0 == i) ? "" : ",") << region.histogram[i];
+            }
+            row << "]";
+        }
+        row << "}";
+    }
+
+    const stats_options_t  &m_options;
+    color_mapping_isa_e     m_isa;
+    std::vector<float>      m_scratch;
+};
+
+/*
+ * Report file of a stats run, one line per image in completion order.
+ * CSV starts with a header line, unless rows are appended to an existing report.
+ */
+class stats_report
+{
+public:
+    bool open(const std::string &path, const stats_options_t &options, bool append)
+    {
+        std::ifstream existing(path.c_str(), std::ios::binary | std::ios::ate);
+        bool has_rows = append && existing.is_open() && (existing.tellg() > 0);
+
+        m_json = options.json;
+        m_path = path;
+        m_stream.open(path.c_str(), append ? (std::ios::binary | std::ios::app) : (std::ios::binary | std::ios::trunc));
+        if (m_stream.is_open() && !m_json && !has_rows)
+        {
+            m_stream << temperature_stats::csv_header(options);
+        }
+
+        return m_stream.is_open();
+    }
+
+    /* row is the output of temperature_stats::format */
+    void add(const std::string &source, const char *row, size_t row_size)
+    {
+        std::string line = m_json ? ("{\"source\":" + json_quote(source) + "," + std::string(row, row_size) + "}\n")
+                                  : (prv_csv_quote(source) + "," + std::string(row, row_size) + "\n");
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stream << line;
+        m_count++;
+    }
+
+    /* Hand the rows added so far to the file system */
+    bool flush(void)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stream.flush();
+        return !m_stream.fail();
+    }
+
+    void close(void)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stream.close();
+    }
+
+    const std::string &path(void) const
+    {
+        return m_path;
+    }
+
+    uint64_t count(void) const
+    {
+        return m_count;
+    }
+
+private:
+    /* CSV field quoting, quotes are doubled */
+    static std::string prv_csv_quote(const std::string &text)
+    {
+        std::string out = "\"";
+        for (char c : text)
+        {
+            if ('"' == c)   out += "\"\"";
+            else            out += c;
+        }
+        return out + "\"";
+    }
+
+    std::ofstream   m_stream;
+    std::mutex      m_mutex;
+    std::string     m_path;
+    bool            m_json = false;
+    uint64_t        m_count = 0;
+};
+
+#endif /* _TEMPERATURE_STATS_H_ */
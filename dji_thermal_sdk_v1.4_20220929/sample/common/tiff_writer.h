@@ -0,0 +1,476 @@
+/*
+ * FLOAT32 TIFF writer for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _TIFF_WRITER_H_
+#define _TIFF_WRITER_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#define TIFF_TYPE_BYTE                          (1)
+#define TIFF_TYPE_ASCII                         (2)
+#define TIFF_TYPE_SHORT                         (3)
+#define TIFF_TYPE_LONG                          (4)
+#define TIFF_TYPE_RATIONAL                      (5)
+#define TIFF_TYPE_SBYTE                         (6)
+#define TIFF_TYPE_UNDEFINED                     (7)
+#define TIFF_TYPE_SSHORT                        (8)
+#define TIFF_TYPE_SLONG                         (9)
+#define TIFF_TYPE_SRATIONAL                     (10)
+#define TIFF_TYPE_FLOAT                         (11)
+#define TIFF_TYPE_DOUBLE                        (12)
+
+#define TIFF_TAG_IMAGE_WIDTH                    (256)
+#define TIFF_TAG_IMAGE_LENGTH                   (257)
+#define TIFF_TAG_BITS_PER_SAMPLE                (258)
+#define TIFF_TAG_COMPRESSION                    (259)
+#define TIFF_TAG_PHOTOMETRIC                    (262)
+#define TIFF_TAG_STRIP_OFFSETS                  (273)
+#define TIFF_TAG_SAMPLES_PER_PIXEL              (277)
+#define TIFF_TAG_ROWS_PER_STRIP                 (278)
+#define TIFF_TAG_STRIP_BYTE_COUNTS              (279)
+#define TIFF_TAG_PLANAR_CONFIG                  (284)
+#define TIFF_TAG_SAMPLE_FORMAT                  (339)
+#define TIFF_TAG_GPS_IFD                        (34853)
+#define TIFF_TAG_GDAL_METADATA                  (42112)
+
+#define TIFF_SAMPLE_FORMAT_INT                  (2)
+#define TIFF_SAMPLE_FORMAT_IEEEFP               (3)
+
+/* One IFD entry, value bytes are always little endian */
+typedef struct
+{
+    uint16_t                tag;
+    uint16_t                type;
+    uint32_t                count;
+    std::vector<uint8_t>    value;
+} tiff_entry_t;
+
+/* Byte size of one element of a field type, 0 for unknown types */
+static inline uint32_t tiff_type_size(uint16_t type)
+{
+    switch (type)
+    {
+        case TIFF_TYPE_BYTE:
+        case TIFF_TYPE_ASCII:
+        case TIFF_TYPE_SBYTE:
+        case TIFF_TYPE_UNDEFINED:   return 1;
+        case TIFF_TYPE_SHORT:
+        case TIFF_TYPE_SSHORT:      return 2;
+        case TIFF_TYPE_LONG:
+        case TIFF_TYPE_SLONG:
+        case TIFF_TYPE_FLOAT:       return 4;
+        case TIFF_TYPE_RATIONAL:
+        case TIFF_TYPE_SRATIONAL:
+        case TIFF_TYPE_DOUBLE:      return 8;
+        default:                    return 0;
+    }
+}
+
+/* Byte size of the integers the value is made of, which is what byte order applies to */
+static inline uint32_t tiff_type_word_size(uint16_t type)
+{
+    if ((TIFF_TYPE_RATIONAL == type) || (TIFF_TYPE_SRATIONAL == type))
+    {
+        return 4;
+    }
+    return tiff_type_size(type);
+}
+
+/*
+ * Minimal reader of the TIFF structure embedded in EXIF, in either byte order.
+ */
+class tiff_reader
+{
+public:
+    tiff_reader(const uint8_t *data, size_t size)
+        : m_data(data), m_size(size)
+    {
+        m_valid = (m_size >= 8) &&
+                  (((m_data[0] == 'I') && (m_data[1] == 'I')) || ((m_data[0] == 'M') && (m_data[1] == 'M')));
+        m_big_endian = m_valid && (m_data[0] == 'M');
+        m_valid = m_valid && (42 == read16(2));
+    }
+
+    bool valid(void) const
+    {
+        return m_valid;
+    }
+
+    uint32_t first_ifd(void) const
+    {
+        return read32(4);
+    }
+
+    /*
+     * Read all entries of the IFD at offset. Values stored out of line are copied,
+     * so the entries do not reference the source buffer.
+     */
+    bool read_ifd(uint32_t offset, std::vector<tiff_entry_t> &entries) const
+    {
+        if (!m_valid || ((size_t)offset + 2 > m_size))
+        {
+            return false;
+        }
+
+        uint16_t entry_count = read16(offset);
+        if ((size_t)offset + 2 + (size_t)entry_count * 12 > m_size)
+        {
+            return false;
+        }
+
+        for (uint16_t i = 0; i < entry_count; i++)
+        {
+            uint32_t pos = offset + 2 + i * 12;
+            tiff_entry_t entry;
+            entry.tag   = read16(pos);
+            entry.type  = read16(pos + 2);
+            entry.count = read32(pos + 4);
+
+            uint32_t type_size = tiff_type_size(entry.type);
+            if ((0 == type_size) || (entry.count > (uint32_t)(m_size / type_size)))
+            {
+                continue;                               /* Unknown type or corrupted count */
+            }
+
+            size_t value_size = (size_t)type_size * entry.count;
+            size_t value_pos  = (value_size <= 4) ? (pos + 8) : read32(pos + 8);
+            if (value_pos + value_size > m_size)
+            {
+                continue;
+            }
+
+            entry.value.assign(m_data + value_pos, m_data + value_pos + value_size);
+            if (m_big_endian)
+            {
+                uint32_t word = tiff_type_word_size(entry.type);
+                for (size_t w = 0; (word > 1) && (w < value_size); w += word)
+                {
+                    for (uint32_t b = 0; b < word / 2; b++)
+                    {
+                        uint8_t tmp = entry.value[w + b];
+                        entry.value[w + b] = entry.value[w + word - 1 - b];
+                        entry.value[w + word - 1 - b] = tmp;
+                    }
+                }
+            }
+            entries.push_back(entry);
+        }
+
+        return true;
+    }
+
+    /* Copy the GPS IFD referenced from IFD0. Return false if there is none. */
+    bool read_gps_ifd(std::vector<tiff_entry_t> &gps) const
+    {
+        std::vector<tiff_entry_t> ifd0;
+        if (!read_ifd(first_ifd(), ifd0))
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < ifd0.size(); i++)
+        {
+            if ((TIFF_TAG_GPS_IFD == ifd0[i].tag) && (4 == ifd0[i].value.size()))
+            {
+                uint32_t offset = 0;
+                memcpy(&offset, ifd0[i].value.data(), 4);   /* Already little endian */
+                return read_ifd(offset, gps) && !gps.empty();
+            }
+        }
+
+        return false;
+    }
+
+private:
+    uint16_t read16(size_t pos) const
+    {
+        if (pos + 2 > m_size) return 0;
+        return m_big_endian ? (uint16_t)((m_data[pos] << 8) | m_data[pos + 1])
+                            : (uint16_t)((m_data[pos + 1] << 8) | m_data[pos]);
+    }
+
+    uint32_t read32(size_t pos) const
+    {
+        if (pos + 4 > m_size) return 0;
+        return m_big_endian ? (((uint32_t)read16(pos) << 16) | read16(pos + 2))
+                            : (((uint32_t)read16(pos + 2) << 16) | read16(pos));
+    }
+
+    const uint8_t  *m_data;
+    size_t          m_size;
+    bool            m_valid;
+    bool            m_big_endian;
+};
+
+/* Sum of up to three unsigned rationals weighted 1, 1/60 and 1/3600, i.e. degrees, minutes and seconds */
+static inline bool tiff_gps_rational_sum(const tiff_entry_t &entry, double *value)
+{
+    static const double weights[3] = {1.0, 1.0 / 60.0, 1.0 / 3600.0};
+
+    if ((TIFF_TYPE_RATIONAL != entry.type) || (entry.count < 1) || (entry.count > 3))
+    {
+        return false;
+    }
+
+    *value = 0;
+    for (uint32_t i = 0; i < entry.count; i++)
+    {
+        uint32_t num = 0;
+        uint32_t den = 0;
+        memcpy(&num, entry.value.data() + i * 8, 4);
+        memcpy(&den, entry.value.data() + i * 8 + 4, 4);
+        if (0 == den)
+        {
+            return false;
+        }
+        *value += weights[i] * num / den;
+    }
+
+    return true;
+}
+
+/*
+ * Decimal latitude, longitude and altitude of the GPS IFD entries returned by read_gps_ifd.
+ * Bit 0, 1 and 2 of the result tell which of the three were found.
+ */
+static inline uint32_t tiff_gps_decimal(const std::vector<tiff_entry_t> &gps, double *latitude, double *longitude, double *altitude)
+{
+    uint32_t found = 0;
+    char lat_ref = 'N';
+    char lon_ref = 'E';
+    uint8_t alt_ref = 0;
+
+    for (size_t i = 0; i < gps.size(); i++)
+    {
+        const tiff_entry_t &entry = gps[i];
+        switch (entry.tag)
+        {
+            case 1:  if (!entry.value.empty()) lat_ref = (char)entry.value[0];                 break;
+            case 2:  if (tiff_gps_rational_sum(entry, latitude))  found |= 1 << 0;              break;
+            case 3:  if (!entry.value.empty()) lon_ref = (char)entry.value[0];                 break;
+            case 4:  if (tiff_gps_rational_sum(entry, longitude)) found |= 1 << 1;              break;
+            case 5:  if (!entry.value.empty()) alt_ref = entry.value[0];                       break;
+            case 6:  if (tiff_gps_rational_sum(entry, altitude))  found |= 1 << 2;              break;
+            default: break;
+        }
+    }
+
+    if ((found & (1 << 0)) && ('S' == lat_ref)) *latitude  = -*latitude;
+    if ((found & (1 << 1)) && ('W' == lon_ref)) *longitude = -*longitude;
+    if ((found & (1 << 2)) && (1 == alt_ref))   *altitude  = -*altitude;
+
+    return found;
+}
+
+/*
+ * Little endian single strip TIFF writer.
+ * Layout : header | IFD0 | GPS IFD | out of line values | pixel data
+ */
+class tiff_writer
+{
+public:
+    /*
+     * Encode a one channel FLOAT32 image with an optional GPS IFD into tiff_out.
+     * Pixels are host order, which is little endian on all supported platforms.
+     */
+    static void encode_float32(const float *pixels, uint32_t width, uint32_t height,
+                               const std::vector<tiff_entry_t> &gps, std::vector<uint8_t> &tiff_out)
+    {
+        encode_gray(pixels, width, height, 32, TIFF_SAMPLE_FORMAT_IEEEFP, gps, std::string(), tiff_out);
+    }
+
+    /* Same as encode_float32 with IEEE half float pixels, read by libtiff 4, GDAL and tifffile */
+    static void encode_float16(const uint16_t *pixels, uint32_t width, uint32_t height,
+                               const std::vector<tiff_entry_t> &gps, std::vector<uint8_t> &tiff_out)
+    {
+        encode_gray(pixels, width, height, 16, TIFF_SAMPLE_FORMAT_IEEEFP, gps, std::string(), tiff_out);
+    }
+
+    /*
+     * Encode a one channel INT16 image whose value is pixel * scale + offset, e.g. the deci-Celsius
+     * of dirp_measure with scale 0.1. Scale and offset are stored in the GDAL_METADATA tag, which
+     * GDAL and rasterio apply as the band scale and offset.
+     */
+    static void encode_int16_scaled(const int16_t *pixels, uint32_t width, uint32_t height, double scale, double offset,
+                                    const std::vector<tiff_entry_t> &gps, std::vector<uint8_t> &tiff_out)
+    {
+        char metadata[256];
+        snprintf(metadata, sizeof(metadata),
+                 "<GDALMetadata>\n"
+                 "  <Item name=\"SCALE\" sample=\"0\" role=\"scale\">%.15g</Item>\n"
+                 "  <Item name=\"OFFSET\" sample=\"0\" role=\"offset\">%.15g</Item>\n"
+                 "</GDALMetadata>\n", scale, offset);
+
+        encode_gray(pixels, width, height, 16, TIFF_SAMPLE_FORMAT_INT, gps, metadata, tiff_out);
+    }
+
+private:
+    /* One channel image of bits per sample, with the GDAL_METADATA tag when metadata is not empty */
+    static void encode_gray(const void *pixels, uint32_t width, uint32_t height, uint16_t bits, uint16_t sample_format,
+                            const std::vector<tiff_entry_t> &gps, const std::string &metadata, std::vector<uint8_t> &tiff_out)
+    {
+        std::vector<tiff_entry_t> ifd0;
+        uint32_t pixel_size = width * height * (bits / 8);
+
+        add_entry(ifd0, TIFF_TAG_IMAGE_WIDTH,       TIFF_TYPE_LONG,  width);
+        add_entry(ifd0, TIFF_TAG_IMAGE_LENGTH,      TIFF_TYPE_LONG,  height);
+        add_entry(ifd0, TIFF_TAG_BITS_PER_SAMPLE,   TIFF_TYPE_SHORT, bits);
+        add_entry(ifd0, TIFF_TAG_COMPRESSION,       TIFF_TYPE_SHORT, 1);
+        add_entry(ifd0, TIFF_TAG_PHOTOMETRIC,       TIFF_TYPE_SHORT, 1);
+        add_entry(ifd0, TIFF_TAG_STRIP_OFFSETS,     TIFF_TYPE_LONG,  0);    /* Patched below */
+        add_entry(ifd0, TIFF_TAG_SAMPLES_PER_PIXEL, TIFF_TYPE_SHORT, 1);
+        add_entry(ifd0, TIFF_TAG_ROWS_PER_STRIP,    TIFF_TYPE_LONG,  height);
+        add_entry(ifd0, TIFF_TAG_STRIP_BYTE_COUNTS, TIFF_TYPE_LONG,  pixel_size);
+        add_entry(ifd0, TIFF_TAG_PLANAR_CONFIG,     TIFF_TYPE_SHORT, 1);
+        add_entry(ifd0, TIFF_TAG_SAMPLE_FORMAT,     TIFF_TYPE_SHORT, sample_format);
+        size_t gps_entry = ifd0.size();
+        if (!gps.empty())
+        {
+            add_entry(ifd0, TIFF_TAG_GPS_IFD,       TIFF_TYPE_LONG,  0);    /* Patched below */
+        }
+        if (!metadata.empty())
+        {
+            tiff_entry_t entry;
+            entry.tag   = TIFF_TAG_GDAL_METADATA;
+            entry.type  = TIFF_TYPE_ASCII;
+            entry.count = (uint32_t)metadata.size() + 1;
+            entry.value.assign(metadata.c_str(), metadata.c_str() + entry.count);
+            ifd0.push_back(entry);
+        }
+
+        uint32_t ifd0_offset  = 8;
+        uint32_t gps_offset   = ifd0_offset + ifd_size(ifd0);
+        uint32_t extra_offset = gps_offset + (gps.empty() ? 0 : ifd_size(gps));
+        uint32_t extra_size   = out_of_line_size(ifd0) + out_of_line_size(gps);
+        uint32_t pixel_offset = (extra_offset + extra_size + 15) & ~15u;    /* Keep pixels aligned */
+
+        set_long(ifd0[5], pixel_offset);
+        if (!gps.empty())
+        {
+            set_long(ifd0[gps_entry], gps_offset);
+        }
+
+        tiff_out.assign(pixel_offset + pixel_size, 0);
+        uint8_t *out = tiff_out.data();
+        out[0] = 'I';
+        out[1] = 'I';
+        put16(out + 2, 42);
+        put32(out + 4, ifd0_offset);
+
+        write_ifd(out, ifd0_offset, ifd0, extra_offset);
+        if (!gps.empty())
+        {
+            write_ifd(out, gps_offset, gps, extra_offset);
+        }
+
+        memcpy(out + pixel_offset, pixels, pixel_size);
+    }
+
+    static void put16(uint8_t *p, uint16_t v)
+    {
+        p[0] = (uint8_t)v;
+        p[1] = (uint8_t)(v >> 8);
+    }
+
+    static void put32(uint8_t *p, uint32_t v)
+    {
+        put16(p, (uint16_t)v);
+        put16(p + 2, (uint16_t)(v >> 16));
+    }
+
+    static void set_long(tiff_entry_t &entry, uint32_t value)
+    {
+        put32(entry.value.data(), value);
+    }
+
+    static void add_entry(std::vector<tiff_entry_t> &ifd, uint16_t tag, uint16_t type, uint32_t value)
+    {
+        tiff_entry_t entry;
+        entry.tag   = tag;
+        entry.type  = type;
+        entry.count = 1;
+        entry.value.resize(tiff_type_size(type));
+        if (TIFF_TYPE_SHORT == type)
+        {
+            put16(entry.value.data(), (uint16_t)value);
+        }
+        else
+        {
+            put32(entry.value.data(), value);
+        }
+        ifd.push_back(entry);
+    }
+
+    static uint32_t ifd_size(const std::vector<tiff_entry_t> &ifd)
+    {
+        return 2 + (uint32_t)ifd.size() * 12 + 4;
+    }
+
+    /* Bytes of the values that do not fit in their entry, each padded to an even size */
+    static uint32_t out_of_line_size(const std::vector<tiff_entry_t> &ifd)
+    {
+        uint32_t size = 0;
+        for (size_t i = 0; i < ifd.size(); i++)
+        {
+            if (ifd[i].value.size() > 4)
+            {
+                size += (uint32_t)((ifd[i].value.size() + 1) & ~(size_t)1);
+            }
+        }
+        return size;
+    }
+
+    /* Entries must be sorted by tag. Out of line values are appended at extra_offset. */
+    static void write_ifd(uint8_t *out, uint32_t offset, const std::vector<tiff_entry_t> &ifd, uint32_t &extra_offset)
+    {
+        put16(out + offset, (uint16_t)ifd.size());
+        for (size_t i = 0; i < ifd.size(); i++)
+        {
+            uint8_t *p = out + offset + 2 + i * 12;
+            put16(p, ifd[i].tag);
+            put16(p + 2, ifd[i].type);
+            put32(p + 4, ifd[i].count);
+            if (ifd[i].value.size() <= 4)
+            {
+                memcpy(p + 8, ifd[i].value.data(), ifd[i].value.size());
+            }
+            else
+            {
+                put32(p + 8, extra_offset);
+                memcpy(out + extra_offset, ifd[i].value.data(), ifd[i].value.size());
+                extra_offset += (uint32_t)((ifd[i].value.size() + 1) & ~(size_t)1);
+            }
+        }
+        put32(out + offset + 2 + ifd.size() * 12, 0);   /* No next IFD */
+    }
+};
+
+#endif /* _TIFF_WRITER_H_ */
@@ -0,0 +1,256 @@
+/*
+ * Per thread stage timers with Chrome trace export for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _TRACE_RECORDER_H_
+#define _TRACE_RECORDER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#define TRACE_BUFFER_EVENTS                     (1 << 18)   /* Events kept per thread, 8 MB */
+
+#define TRACE_CONCAT_INNER(a, b)                a##b
+#define TRACE_CONCAT(a, b)                      TRACE_CONCAT_INNER(a, b)
+
+/* Time the rest of the enclosing block as stage name, a string literal */
+#define TRACE_SCOPE(name)                       trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+/* Same as TRACE_SCOPE, the event also carries the number of the file it works on */
+#define TRACE_SCOPE_FILE(name, number)          trace_scope TRACE_CONCAT(trace_scope_, __LINE__)(name, number)
+
+/*
+ * Records complete events ("ph":"X") of the Chrome trace event format into one buffer per thread,
+ * so recording takes no lock. When tracing is off a scope costs one relaxed load and a branch.
+ * A buffer keeps the last TRACE_BUFFER_EVENTS events of its thread and counts the older ones it
+ * overwrites, so a --watch or --serve run of any length traces its recent past in bounded memory.
+ * write() is called once the traced threads are done, it names every thread as set by
+ * thread_name() and writes a file chrome://tracing or https://ui.perfetto.dev loads.
+ */
+class trace_recorder
+{
+public:
+    static trace_recorder &instance(void)
+    {
+        static trace_recorder recorder;
+        return recorder;
+    }
+
+    static bool enabled(void)
+    {
+        return instance().m_enabled.load(std::memory_order_relaxed);
+    }
+
+    static int64_t now_ns(void)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void start(void)
+    {
+        m_origin = now_ns();
+        m_enabled.store(true, std::memory_order_relaxed);
+    }
+
+    /* Label the calling thread in the trace, e.g. "worker" 3, the first label of a thread is kept */
+    void thread_name(const char *name, int32_t index = -1)
+    {
+        if (!enabled())
+        {
+            return;
+        }
+
+        buffer_t *buffer = prv_thread_buffer();
+        if (!buffer->named)
+        {
+            buffer->name  = (index >= 0) ? std::string(name) + " " + std::to_string(index) : std::string(name);
+            buffer->named = true;
+        }
+    }
+
+    void add(const char *name, int64_t start_ns, int64_t end_ns, int64_t file)
+    {
+        event_t event = {name, start_ns, end_ns - start_ns, file};
+        buffer_t *buffer = prv_thread_buffer();
+
+        if (buffer->events.size() < TRACE_BUFFER_EVENTS)
+        {
+            buffer->events.push_back(event);
+            return;
+        }
+
+        buffer->events[buffer->oldest] = event;
+        buffer->oldest = (buffer->oldest + 1) % TRACE_BUFFER_EVENTS;
+        buffer->dropped++;
+    }
+
+    /* Number of events recorded so far, only meaningful once the traced threads are done */
+    uint64_t event_count(void)
+    {
+        std::lock_guard<std::mutex> lock(m_buffers_mutex);
+        uint64_t count = 0;
+        for (const std::unique_ptr<buffer_t> &buffer : m_buffers)
+        {
+            count += buffer->events.size();
+        }
+        return count;
+    }
+
+    /* Number of events overwritten by newer ones in full buffers */
+    uint64_t dropped_count(void)
+    {
+        std::lock_guard<std::mutex> lock(m_buffers_mutex);
+        uint64_t count = 0;
+        for (const std::unique_ptr<buffer_t> &buffer : m_buffers)
+        {
+            count += buffer->dropped;
+        }
+        return count;
+    }
+
+    bool write(const std::string &path)
+    {
+        FILE *file = fopen(path.c_str(), "w");
+        if (nullptr == file)
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_buffers_mutex);
+        const char *separator = "\n";
+
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        for (const std::unique_ptr<buffer_t> &buffer : m_buffers)
+        {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                    separator, buffer->tid, buffer->name.c_str());
+            separator = ",\n";
+
+            for (size_t i=0; i<buffer->events.size(); i++)
+            {
+                const event_t &event = buffer->events[(buffer->oldest + i) % buffer->events.size()];
+                fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                        event.name, buffer->tid, (event.start_ns - m_origin) / 1000.0, event.duration_ns / 1000.0);
+                if (event.file >= 0)
+                {
+                    fprintf(file, ",\"args\":{\"file\":%lld}", (long long)event.file);
+                }
+                fputc('}', file);
+            }
+        }
+        fprintf(file, "\n]}\n");
+
+        return (0 == fclose(file));
+    }
+
+private:
+    typedef struct
+    {
+        const char     *name;
+        int64_t         start_ns;
+        int64_t         duration_ns;
+        int64_t         file;                       /* -1 : no file */
+    } event_t;
+
+    typedef struct
+    {
+        uint32_t                tid;
+        std::string             name;
+        bool                    named;
+        std::vector<event_t>    events;
+        size_t                  oldest;             /* Index of the oldest event once events is full */
+        uint64_t                dropped;
+    } buffer_t;
+
+    trace_recorder(void)
+    {
+    }
+
+    buffer_t *prv_thread_buffer(void)
+    {
+        static thread_local buffer_t *buffer = nullptr;
+
+        if (nullptr == buffer)
+        {
+            std::unique_ptr<buffer_t> fresh(new buffer_t);
+            buffer = fresh.get();
+
+            std::lock_guard<std::mutex> lock(m_buffers_mutex);
+            fresh->tid     = (uint32_t)m_buffers.size() + 1;
+            fresh->name    = "thread " + std::to_string(fresh->tid);
+            fresh->named   = false;
+            fresh->oldest  = 0;
+            fresh->dropped = 0;
+            m_buffers.push_back(std::move(fresh));
+        }
+
+        return buffer;
+    }
+
+    std::atomic<bool>                       m_enabled {false};
+    int64_t                                 m_origin = 0;
+
+    std::mutex                              m_buffers_mutex;
+    std::vector<std::unique_ptr<buffer_t>>  m_buffers;
+};
+
+class trace_scope
+{
+public:
+    explicit trace_scope(const char *name, int64_t file = -1)
+    {
+        if (trace_recorder::enabled())
+        {
+            m_name  = name;
+            m_file  = file;
+            m_start = trace_recorder::now_ns();
+        }
+    }
+
+    ~trace_scope(void)
+    {
+        if (nullptr != m_name)
+        {
+            trace_recorder::instance().add(m_name, m_start, trace_recorder::now_ns(), m_file);
+        }
+    }
+
+    trace_scope(const trace_scope &) = delete;
+    trace_scope &operator=(const trace_scope &) = delete;
+
+private:
+    const char     *m_name = nullptr;
+    int64_t         m_file = -1;
+    int64_t         m_start = 0;
+};
+
+#endif /* _TRACE_RECORDER_H_ */
@@ -0,0 +1,250 @@
+/*
+ * Work stealing thread pool for DJI Thermal SDK samples.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _WORK_STEALING_POOL_H_
+#define _WORK_STEALING_POOL_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Every worker owns a deque. Tasks submitted by a task are pushed and popped at the back of the
+ * owner's deque (LIFO, cache warm). Tasks submitted from outside the pool are spread round-robin
+ * over per worker inboxes that run first in, first out, so a producer streaming work in sees it
+ * started in submission order. Idle workers steal the oldest task of a victim, inbox first.
+ */
+class work_stealing_pool
+{
+public:
+    typedef std::function<void(int32_t)> task_t;     /* Argument is the worker index */
+
+    explicit work_stealing_pool(int32_t num_workers)
+        : m_queues(num_workers < 1 ? 1 : num_workers)
+    {
+        for (size_t i = 0; i < m_queues.size(); i++)
+        {
+            m_queues[i].reset(new worker_queue_t());
+        }
+        for (size_t i = 0; i < m_queues.size(); i++)
+        {
+            m_threads.push_back(std::thread(&work_stealing_pool::worker_loop, this, (int32_t)i));
+        }
+    }
+
+    ~work_stealing_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleep_mutex);
+            m_stop = true;
+        }
+        m_sleep_cv.notify_all();
+
+        for (size_t i = 0; i < m_threads.size(); i++)
+        {
+            m_threads[i].join();
+        }
+    }
+
+    /* Parse "auto" or a positive worker count. Return 0 on malformed input. */
+    static int32_t parse_thread_count(const std::string &value)
+    {
+        if ("auto" == value)
+        {
+            int32_t count = (int32_t)std::thread::hardware_concurrency();
+            return (count > 0) ? count : 4;
+        }
+
+        int32_t count = 0;
+        try
+        {
+            count = std::stoi(value);
+        }
+        catch (...)
+        {
+            return 0;
+        }
+
+        return (count > 0) ? count : 0;
+    }
+
+    int32_t size(void) const
+    {
+        return (int32_t)m_queues.size();
+    }
+
+    uint64_t steal_count(void) const
+    {
+        return m_steals.load();
+    }
+
+    void submit(task_t task)
+    {
+        int32_t index = current_worker_index();
+        bool external = (index < 0);
+        if (external)
+        {
+            index = (int32_t)(m_next_queue.fetch_add(1) % m_queues.size());
+        }
+
+        m_pending.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+            (external ? m_queues[index]->inbox : m_queues[index]->tasks).push_back(std::move(task));
+        }
+        m_queued.fetch_add(1);
+
+        {
+            std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        }
+        m_sleep_cv.notify_one();
+    }
+
+    /* Block until every submitted task, including tasks submitted by tasks, has finished */
+    void wait_idle(void)
+    {
+        wait_pending(0);
+    }
+
+    /* Block until at most limit submitted tasks are unfinished, lets a producer bound the queued work */
+    void wait_pending(int64_t limit)
+    {
+        std::unique_lock<std::mutex> lock(m_done_mutex);
+        m_wait_limit.store(limit);
+        m_done_cv.wait(lock, [this, limit] { return m_pending.load() <= limit; });
+    }
+
+private:
+    typedef struct
+    {
+        std::mutex          mutex;
+        std::deque<task_t>  tasks;                  /* Submitted by tasks of this worker */
+        std::deque<task_t>  inbox;                  /* Submitted from outside the pool */
+    } worker_queue_t;
+
+    static int32_t &current_worker_index(void)
+    {
+        static thread_local int32_t index = -1;
+        return index;
+    }
+
+    bool pop_local(int32_t index, task_t &task)
+    {
+        worker_queue_t &queue = *m_queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else if (!queue.inbox.empty())
+        {
+            task = std::move(queue.inbox.front());
+            queue.inbox.pop_front();
+        }
+        else
+        {
+            return false;
+        }
+        m_queued.fetch_sub(1);
+        return true;
+    }
+
+    bool steal(int32_t thief, task_t &task)
+    {
+        size_t count = m_queues.size();
+        for (size_t i = 1; i < count; i++)
+        {
+            worker_queue_t &queue = *m_queues[(thief + i) % count];
+            std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+            if (!lock.owns_lock() || (queue.inbox.empty() && queue.tasks.empty()))
+            {
+                continue;
+            }
+            std::deque<task_t> &victim = queue.inbox.empty() ? queue.tasks : queue.inbox;
+            task = std::move(victim.front());
+            victim.pop_front();
+            m_queued.fetch_sub(1);
+            m_steals.fetch_add(1);
+            return true;
+        }
+        return false;
+    }
+
+    void worker_loop(int32_t index)
+    {
+        current_worker_index() = index;
+
+        for (;;)
+        {
+            task_t task;
+            if (pop_local(index, task) || steal(index, task))
+            {
+                task(index);
+                if (m_pending.fetch_sub(1) - 1 <= m_wait_limit.load())
+                {
+                    std::lock_guard<std::mutex> lock(m_done_mutex);
+                    m_done_cv.notify_all();
+                }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_sleep_mutex);
+            if (m_stop && (0 == m_queued.load()))
+            {
+                break;
+            }
+            /* A try-lock steal may have skipped a busy victim, so never sleep while work is queued */
+            m_sleep_cv.wait(lock, [this] { return m_stop || (m_queued.load() > 0); });
+        }
+    }
+
+    std::vector<std::unique_ptr<worker_queue_t>>    m_queues;
+    std::vector<std::thread>                        m_threads;
+
+    std::atomic<uint64_t>                           m_next_queue {0};
+    std::atomic<uint64_t>                           m_steals {0};
+    std::atomic<int64_t>                            m_queued {0};
+    std::atomic<int64_t>                            m_pending {0};
+    std::atomic<int64_t>                            m_wait_limit {0};
+
+    std::mutex                                      m_sleep_mutex;
+    std::condition_variable                         m_sleep_cv;
+    bool                                            m_stop = false;
+
+    std::mutex                                      m_done_mutex;
+    std::condition_variable                         m_done_cv;
+};
+
+#endif /* _WORK_STEALING_POOL_H_ */
@@ -28,11 +28,14 @@
 #include <sstream>
 #include <iterator>
 #include <vector>
+#include <chrono>
 #include <string.h>
+#include <math.h>
 #include <sys/stat.h>
 
 #include "dirp_api.h"
 #include "argagg.hpp"
+#include "color_mapping.h"
 
 #ifdef _WIN32
 #include <io.h>
@@ -113,6 +116,12 @@ static argagg::parser argparser {{
         "lutout", {"-l", "--lutout"},
         "palette pseudo color LUT file save path", 1,
     },
+    {
+        "bench", {"--bench"},
+        "color mapping microbenchmark rounds" "\r\n"
+        "        " "compares the per-pixel write path with every supported SIMD kernel" "\r\n"
+        "        " "(default=\"0\")", 1,
+    },
 }};
 
 int argparse_init(int argc, char *argv[])
@@ -208,6 +217,16 @@ string argparse_get_lut_out_path(void)
     return string("");
 }
 
+int32_t argparse_get_bench_rounds(void)
+{
+    if (args["bench"])
+    {
+        return args["bench"].as<int32_t>();
+    }
+
+    return 0;
+}
+
 dirp_pseudo_color_e argparse_get_pseudo_color(void)
 {
     string pseudo_color_name;
@@ -253,12 +272,100 @@ dirp_verbose_level_e argparse_get_verbose_level(void)
     else                                return DIRP_VERBOSE_LEVEL_NONE;
 }
 
-int32_t prv_process_color_mapping(dirp_isp_pseudo_color_lut_t *pseudo_color_lut, float *src_data, int32_t src_size)
+/* Original color mapping, three 1-byte writes per pixel, kept as the benchmark reference */
+static void prv_color_mapping_per_pixel(const uint8_t *lut_r, const uint8_t *lut_g, const uint8_t *lut_b,
+                                        const float *src_data, int32_t width, int32_t height, ofstream &ofstream)
 {
 #if !defined(MIN)
 #define MIN(a,b)    ((a) < (b) ? (a) : (b))
 #endif
 
+    uint8_t  black_rgb[3] = {0,0,0};
+
+    for (int i=0; i<height; i++)
+    {
+        for (int j=0; j<width; j++)
+        {
+            if ((src_data[i * width + j] >= 0.0f) && (src_data[i * width + j] <= 256.0f))
+            {
+                uint8_t index = (uint8_t)MIN(floor(src_data[i * width + j]), DIRP_PSEUDO_COLOR_LUT_DEPTH - 1);
+
+                ofstream.write((const char *)&lut_r[index], sizeof(uint8_t));
+                ofstream.write((const char *)&lut_g[index], sizeof(uint8_t));
+                ofstream.write((const char *)&lut_b[index], sizeof(uint8_t));
+            }
+            else
+            {
+                ofstream.write((const char *)&black_rgb[0], 3 * sizeof(uint8_t));
+            }
+        }
+    }
+}
+
+/*
+ * Time the per-pixel write path against each SIMD kernel followed by a single write,
+ * on the same stretch image and output file, and check that all outputs are identical.
+ */
+static int32_t prv_color_mapping_bench(const color_mapping &mapper, const uint8_t *lut_r, const uint8_t *lut_g, const uint8_t *lut_b,
+                                       const float *src_data, int32_t width, int32_t height, int32_t rounds,
+                                       const string &output_file_path)
+{
+    size_t frame_size = (size_t)width * height * 3;
+    vector<uint8_t> reference(frame_size);
+    vector<uint8_t> frame(frame_size + COLOR_MAPPING_FRAME_PADDING);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int32_t r=0; r<rounds; r++)
+    {
+        ofstream ofstream(output_file_path.c_str(), ios::binary);
+        prv_color_mapping_per_pixel(lut_r, lut_g, lut_b, src_data, width, height, ofstream);
+    }
+    double reference_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / rounds;
+
+    ifstream fs_i_ref(output_file_path.c_str(), ios::binary);
+    fs_i_ref.read((char *)reference.data(), frame_size);
+    if (!fs_i_ref)
+    {
+        cout << "ERROR: read back " << output_file_path.c_str() << " failed" << endl;
+        return -1;
+    }
+
+    cout << "Color mapping bench : " << width << " * " << height << ", " << rounds << " rounds" << endl;
+    cout << "    per-pixel write : " << reference_ms << " ms/frame" << endl;
+
+    int32_t ret = DIRP_SUCCESS;
+    for (int32_t i=0; i<=color_mapping::best_isa(); i++)
+    {
+        color_mapping_isa_e isa = (color_mapping_isa_e)i;
+        double map_ms = 0;
+
+        start = chrono::steady_clock::now();
+        for (int32_t r=0; r<rounds; r++)
+        {
+            chrono::steady_clock::time_point map_start = chrono::steady_clock::now();
+            mapper.map(src_data, (size_t)width * height, frame.data(), isa);
+            map_ms += chrono::duration<double, milli>(chrono::steady_clock::now() - map_start).count();
+
+            ofstream ofstream(output_file_path.c_str(), ios::binary);
+            ofstream.write((const char *)frame.data(), frame_size);
+        }
+        double total_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / rounds;
+
+        bool identical = (0 == memcmp(frame.data(), reference.data(), frame_size));
+        cout << "    " << color_mapping::isa_name(isa) << " + bulk write : " << total_ms << " ms/frame (map "
+             << map_ms / rounds << " ms), speedup " << ((total_ms > 0) ? reference_ms / total_ms : 0) << "x, output "
+             << (identical ? "identical" : "DIFFERENT") << endl;
+        if (!identical)
+        {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+int32_t prv_process_color_mapping(dirp_isp_pseudo_color_lut_t *pseudo_color_lut, float *src_data, int32_t src_size)
+{
     int32_t ret = DIRP_SUCCESS;
 
     int32_t width = 0;
@@ -281,12 +388,31 @@ int32_t prv_process_color_mapping(dirp_isp_pseudo_color_lut_t *pseudo_color_lut,
     dirp_pseudo_color_e pseudo_color = argparse_get_pseudo_color();
     cout << "Color mapping pseudo type : " << pseudo_color << endl;
 
-    uint8_t  black_rgb[3] = {0,0,0};
     uint8_t *lut_r = &pseudo_color_lut->red  [pseudo_color][0];
     uint8_t *lut_g = &pseudo_color_lut->green[pseudo_color][0];
     uint8_t *lut_b = &pseudo_color_lut->blue [pseudo_color][0];
+    color_mapping mapper(lut_r, lut_g, lut_b);
 
     string output_file_path = argparse_get_output_path();
+    int32_t bench_rounds = argparse_get_bench_rounds();
+    if (bench_rounds > 0)
+    {
+        ret = prv_color_mapping_bench(mapper, lut_r, lut_g, lut_b, src_data, width, height, bench_rounds, output_file_path);
+        if (DIRP_SUCCESS != ret)
+        {
+            cout << "ERROR: color mapping kernels do not match the per-pixel path" << endl;
+            return ret;
+        }
+    }
+
+    /* Map the whole frame in memory, then write it at once */
+    color_mapping_isa_e isa = color_mapping::best_isa();
+    cout << "Color mapping kernel : " << color_mapping::isa_name(isa) << endl;
+
+    size_t frame_size = (size_t)width * height * 3;
+    vector<uint8_t> frame(frame_size + COLOR_MAPPING_FRAME_PADDING);
+    mapper.map(src_data, (size_t)width * height, frame.data(), isa);
+
     ofstream ofstream(output_file_path.c_str(), ios::binary);
     if (!ofstream.is_open())
     {
@@ -295,24 +421,7 @@ int32_t prv_process_color_mapping(dirp_isp_pseudo_color_lut_t *pseudo_color_lut,
         goto ERR_PCM_RET;
     }
 
-    for (int i=0; i<height; i++)
-    {
-        for (int j=0; j<width; j++)
-        {
-            if ((src_data[i * width + j] >= 0.0f) && (src_data[i * width + j] <= 256.0f))
-            {
-                uint8_t index = (uint8_t)MIN(floor(src_data[i * width + j]), DIRP_PSEUDO_COLOR_LUT_DEPTH - 1);
-
-                ofstream.write((const char *)&lut_r[index], sizeof(uint8_t));
-                ofstream.write((const char *)&lut_g[index], sizeof(uint8_t));
-                ofstream.write((const char *)&lut_b[index], sizeof(uint8_t));
-            }
-            else
-            {
-                ofstream.write((const char *)&black_rgb[0], 3 * sizeof(uint8_t));
-            }
-        }
-    }
+    ofstream.write((const char *)frame.data(), frame_size);
 
 ERR_PCM_RET:
     if (ofstream.is_open())
@@ -28,11 +28,15 @@
 #include <sstream>
 #include <iterator>
 #include <vector>
+#include <chrono>
 #include <string.h>
 #include <sys/stat.h>
 
 #include "dirp_api.h"
 #include "argagg.hpp"
+#include "rjpeg_probe.h"
+#include "mapped_file.h"
+#include "trace_recorder.h"
 
 #ifdef _WIN32
 #include <io.h>
@@ -40,6 +44,19 @@
 #include <sys/io.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <thread>
+#include <mutex>
+#include <map>
+#include <memory>
+#include <math.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "bounded_queue.h"
+#include "dirp_vendor_lock.h"
+#include "serve_protocol.h"
+#include "work_stealing_pool.h"
 #endif
 
 using namespace std;
@@ -93,14 +110,31 @@ static argagg::parser argparser {{
         "        " "0: none      | 1: logger_file_name.txt" "\r\n"
         "        " "(default=\"none\")", 1,
     },
+    {
+        "trace", {"--trace"},
+        "time every stage per thread and write a Chrome trace event file" "\r\n"
+        "        " "argument : file path, e.g. out.json, load it in chrome://tracing or ui.perfetto.dev" "\r\n"
+        "        " "(default=\"none\")", 1,
+    },
     {
         "source", {"-s", "--source"},
         "source file path", 1,
     },
+    {
+        "io", {"--io"},
+        "R-JPEG input file access method" "\r\n"
+        "        " "0: read      | 1: mmap" "\r\n"
+        "        " "mmap passes the mapped file to the SDK without a copy" "\r\n"
+        "        " "(default=\"read\")", 1,
+    },
     {
         "action", {"-a", "--action"},
-        "action name " "\r\n"
-        "        " "(possible values=\"extract\", \"measure\", \"process\")", 1,
+        "action name, or a comma separated list run on one decoded R-JPEG" "\r\n"
+        "        " "(possible values=\"extract\", \"measure\", \"process\")" "\r\n"
+        "        " "e.g. \"extract,measure,process\" saves [output]_extract.raw, ..." "\r\n"
+        "        " "names are not trimmed, an unknown name fails the run" "\r\n"
+        "        " "\"probe\" prints resolution, versions and camera model from the R-JPEG header only" "\r\n"
+        "        " "(default=\"process\")", 1,
     },
     {
         "output", {"-o", "--output"},
@@ -175,6 +209,29 @@ static argagg::parser argparser {{
         "        " "argument rage : [-40.0,500.0]" "\r\n"
         "        " "(default=\"23.0\")", 1,
     },
+    {
+        "sweep", {"--sweep"},
+        "(action[measure] usage) measure once per parameter set into a multi-band output" "\r\n"
+        "        " "argument format : [key]=[v1]/[v2]/...,[key]=...;[next grid]" "\r\n"
+        "        " "[key] : distance, humidity, emissivity or reflection" "\r\n"
+        "        " "a grid yields every combination of its values, keys not listed keep" "\r\n"
+        "        " "the values of the R-JPEG and the options above" "\r\n"
+        "        " "(default=\"off\")", 1,
+    },
+    {
+        "serve", {"--serve"},
+        "run as a conversion daemon on a Unix domain socket, the SDK is loaded once" "\r\n"
+        "        " "argument : socket path, e.g. /tmp/dji_irp.sock" "\r\n"
+        "        " "requests carry R-JPEG bytes with action and parameters, replies carry" "\r\n"
+        "        " "the output buffer, see common/serve_protocol.h; SIGINT or SIGTERM stops it" "\r\n"
+        "        " "(default=\"off\")", 1,
+    },
+    {
+        "threads", {"-t", "--threads"},
+        "(--serve usage) worker thread count, each answers one request at a time" "\r\n"
+        "        " "[N] positive number | auto: one per CPU core" "\r\n"
+        "        " "(default=\"auto\")", 1,
+    },
 }};
 
 static dirp_isotherm_t s_isotherm =  {false, 30.0f, 25.0f};
@@ -232,6 +289,16 @@ string argparse_get_logger_file(void)
     return string("none");
 }
 
+string argparse_get_trace_file(void)
+{
+    if (args["trace"])
+    {
+        return args["trace"].as<string>();
+    }
+
+    return string("none");
+}
+
 int32_t argparse_get_measurement_params(dirp_measurement_params_t *measurement_params, bool *modified)
 {
     int32_t ret = DIRP_SUCCESS;
@@ -269,6 +336,89 @@ int32_t argparse_get_measurement_params(dirp_measurement_params_t *measurement_p
     return ret;
 }
 
+bool argparse_is_sweep(void)
+{
+    return args["sweep"] && ("off" != args["sweep"].as<string>());
+}
+
+static float *prv_measurement_param_field(dirp_measurement_params_t *measurement_params, const string &key)
+{
+    if      ("distance"   == key)   return &measurement_params->distance;
+    else if ("humidity"   == key)   return &measurement_params->humidity;
+    else if ("emissivity" == key)   return &measurement_params->emissivity;
+    else if ("reflection" == key)   return &measurement_params->reflection;
+    else                            return nullptr;
+}
+
+/* Expand --sweep grids into parameter sets, keys a grid does not list keep the base values */
+int32_t argparse_get_sweep_params(const dirp_measurement_params_t &base, vector<dirp_measurement_params_t> &sweep_params)
+{
+    stringstream grids(args["sweep"].as<string>());
+    string grid;
+
+    sweep_params.clear();
+    while (getline(grids, grid, ';'))
+    {
+        vector<dirp_measurement_params_t> grid_params(1, base);
+        stringstream fields(grid);
+        string field;
+
+        while (getline(fields, field, ','))
+        {
+            size_t equal = field.find('=');
+            dirp_measurement_params_t probe = base;
+            if ((string::npos == equal) || (nullptr == prv_measurement_param_field(&probe, field.substr(0, equal))))
+            {
+                cout << "ERROR: invalid sweep field \"" << field << "\"" << endl;
+                return -1;
+            }
+            string key = field.substr(0, equal);
+
+            vector<float> values;
+            stringstream value_list(field.substr(equal + 1));
+            string value;
+            while (getline(value_list, value, '/'))
+            {
+                char *end = nullptr;
+                float number = strtof(value.c_str(), &end);
+                if (value.empty() || ('\0' != *end))
+                {
+                    cout << "ERROR: invalid sweep value \"" << value << "\" of " << key << endl;
+                    return -1;
+                }
+                values.push_back(number);
+            }
+            if (values.empty())
+            {
+                cout << "ERROR: sweep field " << key << " has no value" << endl;
+                return -1;
+            }
+
+            vector<dirp_measurement_params_t> expanded;
+            for (size_t i=0; i<grid_params.size(); i++)
+            {
+                for (size_t j=0; j<values.size(); j++)
+                {
+                    dirp_measurement_params_t params = grid_params[i];
+                    *prv_measurement_param_field(&params, key) = values[j];
+                    expanded.push_back(params);
+                }
+            }
+            grid_params.swap(expanded);
+        }
+
+        sweep_params.insert(sweep_params.end(), grid_params.begin(), grid_params.end());
+    }
+
+    if (sweep_params.empty())
+    {
+        cout << "ERROR: sweep has no parameter set" << endl;
+        return -1;
+    }
+
+    return DIRP_SUCCESS;
+}
+
 int32_t argparse_get_enhancement_params(dirp_enhancement_params_t *enhancement_params, bool *modified)
 {
     int32_t ret = DIRP_SUCCESS;
@@ -408,23 +558,58 @@ dirp_verbose_level_e argparse_get_verbose_level(void)
     else                                return DIRP_VERBOSE_LEVEL_NONE;
 }
 
-dirp_action_type_e argparse_get_action_type(void)
+/* dirp_action_type_num for an unknown name */
+dirp_action_type_e argparse_get_action_type_by_name(const string &action_name)
 {
-    string action_name;
+    if      ("extract" == action_name)  return dirp_action_type_extract;
+    else if ("measure" == action_name)  return dirp_action_type_measure;
+    else if ("process" == action_name)  return dirp_action_type_process;
+    else                                return dirp_action_type_num;
+}
+
+bool argparse_is_probe(void)
+{
+    return args["action"] && ("probe" == args["action"].as<string>());
+}
+
+/*
+ * Return a bit mask of requested actions, bit N stands for dirp_action_type_e value N.
+ * Zero when a name of the list is unknown, including empty names and "probe" inside a list.
+ */
+uint32_t argparse_get_action_types(void)
+{
+    string action_names;
+    uint32_t action_types = 0;
 
     if (args["action"])
     {
-        action_name = args["action"].as<string>();
+        action_names = args["action"].as<string>();
     }
     else
     {
-        action_name = "process";
+        action_names = "process";
     }
 
-    if      ("extract" == action_name)  return dirp_action_type_extract;
-    else if ("measure" == action_name)  return dirp_action_type_measure;
-    else if ("process" == action_name)  return dirp_action_type_process;
-    else                                return dirp_action_type_process;
+    stringstream ss(action_names);
+    string action_name;
+
+    while (getline(ss, action_name, ','))
+    {
+        dirp_action_type_e action_type = argparse_get_action_type_by_name(action_name);
+        if (dirp_action_type_num == action_type)
+        {
+            cout << "ERROR: unknown action name \"" << action_name.c_str() << "\"" << endl;
+            return 0;
+        }
+        action_types |= (1u << action_type);
+    }
+    if (action_names.empty() || (',' == action_names.back()))
+    {
+        cout << "ERROR: empty action name in \"" << action_names.c_str() << "\"" << endl;
+        return 0;
+    }
+
+    return action_types;
 }
 
 dirp_measure_format_e argparse_get_measure_format(void)
@@ -471,6 +656,26 @@ dirp_pseudo_color_e argparse_get_pseudo_color(dirp_pseudo_color_e pseudo_color_o
     return pseudo_color_new;
 }
 
+bool argparse_is_mmap_input(void)
+{
+    if (args["io"])
+    {
+        return ("mmap" == args["io"].as<string>());
+    }
+
+    return false;
+}
+
+bool argparse_is_serve(void)
+{
+    return args["serve"] && ("off" != args["serve"].as<string>());
+}
+
+string argparse_get_serve_path(void)
+{
+    return args["serve"].as<string>();
+}
+
 bool argparse_is_strech_only(void)
 {
     string strech_only;
@@ -519,6 +724,30 @@ ERR_RJPEG_INFO_PRINT_RET:
     return ret;
 }
 
+int32_t prv_rjpeg_probe_print(const string &rjpeg_file_path)
+{
+    rjpeg_probe_info_t probe_info;
+
+    int32_t ret = rjpeg_probe::probe_file(rjpeg_file_path.c_str(), &probe_info);
+    if (DIRP_SUCCESS != ret)
+    {
+        cout << "ERROR: probe R-JPEG file failed" << endl;
+        return ret;
+    }
+
+    cout << "R-JPEG version information" << endl;
+    cout << "    R-JPEG version : 0x" << hex << probe_info.version.rjpeg  << dec << endl;
+    cout << "    header version : 0x" << hex << probe_info.version.header << dec << endl;
+    cout << " curve LUT version : 0x" << hex << probe_info.version.curve  << dec << endl;
+    cout << "R-JPEG resolution size" << endl;
+    cout << "      image  width : " << probe_info.resolution.width  << endl;
+    cout << "      image height : " << probe_info.resolution.height << endl;
+    cout << "R-JPEG camera model : " << probe_info.camera_model << endl;
+    cout << "R-JPEG probe read " << probe_info.bytes_read << " bytes" << endl;
+
+    return DIRP_SUCCESS;
+}
+
 int32_t prv_isp_config(DIRP_HANDLE dirp_handle)
 {
     int32_t ret = DIRP_SUCCESS;
@@ -665,15 +894,13 @@ ERR_MEASUREMENT_CONFIG_RET:
     return ret;
 }
 
-int32_t prv_get_rjpeg_output_size(const dirp_action_type_e action_type, const dirp_resolution_t *resolution)
+int32_t prv_get_output_size(const dirp_action_type_e action_type, const dirp_resolution_t *resolution,
+                            dirp_measure_format_e measure_format, bool strech_only)
 {
     int32_t image_width     = resolution->width;
     int32_t image_height    = resolution->height;
     int32_t image_size      = 0;
 
-    dirp_measure_format_e   measure_format  = argparse_get_measure_format();
-    bool                    strech_only     = argparse_is_strech_only();
-
     switch (action_type)
     {
         case dirp_action_type_extract:
@@ -704,7 +931,156 @@ int32_t prv_get_rjpeg_output_size(const dirp_action_type_e action_type, const di
     return image_size;
 }
 
-int32_t prv_action_run(DIRP_HANDLE dirp_handle)
+int32_t prv_get_rjpeg_output_size(const dirp_action_type_e action_type, const dirp_resolution_t *resolution)
+{
+    return prv_get_output_size(action_type, resolution, argparse_get_measure_format(), argparse_is_strech_only());
+}
+
+const char *prv_get_action_name(dirp_action_type_e action_type)
+{
+    switch (action_type)
+    {
+        case dirp_action_type_extract:  return "extract";
+        case dirp_action_type_measure:  return "measure";
+        default:                        return "process";
+    }
+}
+
+/* Insert the action name before the extension when one run saves several outputs */
+string prv_get_action_output_path(const string &output_file_path, dirp_action_type_e action_type, bool multiple)
+{
+    if (!multiple)
+    {
+        return output_file_path;
+    }
+
+    size_t dot = output_file_path.find_last_of('.');
+    size_t sep = output_file_path.find_last_of("/\\");
+    if ((string::npos == dot) || ((string::npos != sep) && (dot < sep)))
+    {
+        return output_file_path + "_" + prv_get_action_name(action_type);
+    }
+
+    return output_file_path.substr(0, dot) + "_" + prv_get_action_name(action_type) + output_file_path.substr(dot);
+}
+
+/*
+ * Measure the decoded R-JPEG once per --sweep parameter set on the same DIRP handle.
+ * Bands are stacked in one output file in sweep order, their parameters are listed in <output>.csv.
+ * The measurement parameters in effect before the sweep are restored for the following actions.
+ */
+int32_t prv_measure_sweep_run(DIRP_HANDLE dirp_handle, const string &output_file_path)
+{
+    int32_t ret = DIRP_SUCCESS;
+    int32_t band_size = 0;
+    dirp_resolution_t rjpeg_resolution = {0};
+    dirp_measurement_params_t base_params = {0};
+    vector<dirp_measurement_params_t> sweep_params;
+    vector<uint8_t> bands;
+    dirp_measure_format_e measure_format = argparse_get_measure_format();
+    chrono::steady_clock::time_point start;
+    double elapsed = 0;
+    string index_file_path = output_file_path + ".csv";
+    ofstream fs_o_index;
+
+    ret = dirp_get_measurement_params(dirp_handle, &base_params);
+    if (DIRP_SUCCESS != ret)
+    {
+        cout << "ERROR: call dirp_get_measurement_params failed" << endl;
+        return ret;
+    }
+
+    ret = argparse_get_sweep_params(base_params, sweep_params);
+    if (DIRP_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    ret = dirp_get_rjpeg_resolution(dirp_handle, &rjpeg_resolution);
+    if (DIRP_SUCCESS != ret)
+    {
+        cout << "ERROR: call dirp_get_rjpeg_resolution failed" << endl;
+        return ret;
+    }
+
+    band_size = prv_get_rjpeg_output_size(dirp_action_type_measure, &rjpeg_resolution);
+    bands.resize((size_t)band_size * sweep_params.size());
+    cout << "Run measurement sweep of " << sweep_params.size() << " parameter sets" << endl;
+
+    start = chrono::steady_clock::now();
+    for (size_t i=0; i<sweep_params.size(); i++)
+    {
+        const dirp_measurement_params_t &params = sweep_params[i];
+        uint8_t *band = bands.data() + (size_t)band_size * i;
+
+        ret = dirp_set_measurement_params(dirp_handle, &params);
+        if (DIRP_SUCCESS != ret)
+        {
+            cout << "ERROR: band " << i << " distance " << params.distance << " humidity " << params.humidity
+                 << " emissivity " << params.emissivity << " reflection " << params.reflection
+                 << " rejected by dirp_set_measurement_params" << endl;
+            goto ERR_SWEEP_RET;
+        }
+
+        if (dirp_measure_format_float32 == measure_format)
+        {
+            TRACE_SCOPE("dirp_measure_ex");
+            ret = dirp_measure_ex(dirp_handle, (float *)band, band_size);
+        }
+        else
+        {
+            TRACE_SCOPE("dirp_measure");
+            ret = dirp_measure(dirp_handle, (int16_t *)band, band_size);
+        }
+        if (DIRP_SUCCESS != ret)
+        {
+            cout << "ERROR: call dirp_measure[_ex] failed for band " << i << endl;
+            goto ERR_SWEEP_RET;
+        }
+    }
+    elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Measured " << sweep_params.size() << " bands in " << elapsed << " ms ("
+         << elapsed / sweep_params.size() << " ms/band)" << endl;
+
+    {
+        TRACE_SCOPE("write");
+        ofstream fs_o_bands(output_file_path.c_str(), ios::binary);
+        if (!fs_o_bands.is_open())
+        {
+            cout << "ERROR: create ofstream failed" << endl;
+            ret = -1;
+            goto ERR_SWEEP_RET;
+        }
+        fs_o_bands.write((const char *)bands.data(), bands.size());
+    }
+    cout << "Save " << sweep_params.size() << " band image file as : " << output_file_path.c_str() << endl;
+
+    fs_o_index.open(index_file_path.c_str());
+    if (!fs_o_index.is_open())
+    {
+        cout << "ERROR: create ofstream failed" << endl;
+        ret = -1;
+        goto ERR_SWEEP_RET;
+    }
+    fs_o_index << "band,distance,humidity,emissivity,reflection" << endl;
+    for (size_t i=0; i<sweep_params.size(); i++)
+    {
+        fs_o_index << i << "," << sweep_params[i].distance << "," << sweep_params[i].humidity << ","
+                   << sweep_params[i].emissivity << "," << sweep_params[i].reflection << endl;
+    }
+    cout << "Save band parameter list as : " << index_file_path.c_str() << endl;
+
+ERR_SWEEP_RET:
+    /* Later actions see the parameters configured before the sweep */
+    if (DIRP_SUCCESS != dirp_set_measurement_params(dirp_handle, &base_params))
+    {
+        cout << "ERROR: restore measurement parameters failed" << endl;
+    }
+
+    return ret;
+}
+
+int32_t prv_action_run(DIRP_HANDLE dirp_handle, dirp_action_type_e action_type, const string &output_file_path)
 {
     int32_t ret = DIRP_SUCCESS;
     int32_t out_size = 0;
@@ -712,8 +1088,6 @@ int32_t prv_action_run(DIRP_HANDLE dirp_handle)
     void *raw_out = nullptr;
     dirp_measure_format_e measure_format = argparse_get_measure_format();
     bool strech_only = argparse_is_strech_only();
-    dirp_action_type_e action_type = argparse_get_action_type();
-    string output_file_path = argparse_get_output_path();
 
     cout << "Run action " << (int)action_type << endl;
 
@@ -752,25 +1126,32 @@ int32_t prv_action_run(DIRP_HANDLE dirp_handle)
     switch(action_type)
     {
         case dirp_action_type_extract:
+        {
+            TRACE_SCOPE("dirp_get_original_raw");
             ret = dirp_get_original_raw(dirp_handle, (uint16_t *)raw_out, out_size);
             break;
+        }
         case dirp_action_type_measure:
             if (dirp_measure_format_float32 == measure_format)
             {
+                TRACE_SCOPE("dirp_measure_ex");
                 ret = dirp_measure_ex(dirp_handle, (float *)raw_out, out_size);
             }
             else
             {
+                TRACE_SCOPE("dirp_measure");
                 ret = dirp_measure(dirp_handle, (int16_t *)raw_out, out_size);
             }
             break;
         case dirp_action_type_process:
             if (strech_only)
             {
+                TRACE_SCOPE("dirp_process_strech");
                 ret = dirp_process_strech(dirp_handle, (float *)raw_out, out_size);
             }
             else
             {
+                TRACE_SCOPE("dirp_process");
                 ret = dirp_process(dirp_handle, (uint8_t *)raw_out, out_size);
             }
             break;
@@ -780,7 +1161,10 @@ int32_t prv_action_run(DIRP_HANDLE dirp_handle)
         cout << "ERROR: call dirp_get_[original_raw/measure/proess] failed" << endl;
         goto ERR_ACT_RET;
     }
-    ofstream.write((const char *)raw_out, out_size);
+    {
+        TRACE_SCOPE("write");
+        ofstream.write((const char *)raw_out, out_size);
+    }
 
     cout << "Save image file as : " << output_file_path.c_str() << endl;
 
@@ -804,6 +1188,497 @@ ERR_ACT_RET:
     return ret;
 }
 
+#ifndef _WIN32
+#define SERVE_LATENCY_BUCKETS_PER_OCTAVE        (8)
+#define SERVE_LATENCY_BUCKETS                   (SERVE_LATENCY_BUCKETS_PER_OCTAVE * 40)
+
+static volatile sig_atomic_t s_serve_stop = 0;
+
+/*
+ * Request latency of the daemon in log spaced microsecond buckets, 8 per octave, so a daemon
+ * running for days keeps a fixed size record and percentiles are within 9% of the exact value.
+ */
+typedef struct
+{
+    mutex       lock;
+    uint64_t    buckets[SERVE_LATENCY_BUCKETS];
+    uint64_t    requests;
+    uint64_t    failed;
+} serve_stats_t;
+
+int32_t argparse_get_thread_count(void)
+{
+    if (args["threads"])
+    {
+        return work_stealing_pool::parse_thread_count(args["threads"].as<string>());
+    }
+
+    return work_stealing_pool::parse_thread_count("auto");
+}
+
+static void prv_serve_signal_handler(int signal_number)
+{
+    (void)signal_number;
+    s_serve_stop = 1;
+}
+
+static void prv_serve_stats_add(serve_stats_t *stats, uint32_t elapsed_us, bool failed)
+{
+    int32_t bucket = (int32_t)(log2((double)elapsed_us + 1) * SERVE_LATENCY_BUCKETS_PER_OCTAVE);
+    bucket = min(bucket, SERVE_LATENCY_BUCKETS - 1);
+
+    lock_guard<mutex> lock(stats->lock);
+    stats->buckets[bucket]++;
+    stats->requests++;
+    stats->failed += failed ? 1 : 0;
+}
+
+/* Upper bound of the bucket holding the given percentile, in milliseconds */
+static double prv_serve_stats_percentile(const serve_stats_t *stats, double percentile)
+{
+    uint64_t rank = (uint64_t)ceil(stats->requests * percentile / 100.0);
+    uint64_t count = 0;
+
+    for (int32_t i=0; i<SERVE_LATENCY_BUCKETS; i++)
+    {
+        count += stats->buckets[i];
+        if ((count >= rank) && (count > 0))
+        {
+            return (exp2((double)(i + 1) / SERVE_LATENCY_BUCKETS_PER_OCTAVE) - 1) / 1000.0;
+        }
+    }
+
+    return 0;
+}
+
+int32_t prv_serve_measurement_config(DIRP_HANDLE dirp_handle, const serve_request_t &request, dirp_lock_scope_e lock_scope)
+{
+    int32_t ret = DIRP_SUCCESS;
+    dirp_measurement_params_t measurement_params = {0};
+
+    if (0 == request.params)
+    {
+        return DIRP_SUCCESS;
+    }
+
+    ret = dirp_get_measurement_params(dirp_handle, &measurement_params);
+    if (DIRP_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    if (request.params & SERVE_PARAM_DISTANCE)      measurement_params.distance   = request.distance;
+    if (request.params & SERVE_PARAM_HUMIDITY)      measurement_params.humidity   = request.humidity;
+    if (request.params & SERVE_PARAM_EMISSIVITY)    measurement_params.emissivity = request.emissivity;
+    if (request.params & SERVE_PARAM_REFLECTION)    measurement_params.reflection = request.reflection;
+
+    dirp_vendor_lock lock(lock_scope, DIRP_LOCK_CALLS);
+    return dirp_set_measurement_params(dirp_handle, &measurement_params);
+}
+
+int32_t prv_serve_isp_config(DIRP_HANDLE dirp_handle, const serve_request_t &request)
+{
+    int32_t ret = DIRP_SUCCESS;
+    dirp_enhancement_params_t enhancement_params = {0};
+
+    if (request.palette >= 0)
+    {
+        ret = dirp_set_pseudo_color(dirp_handle, (dirp_pseudo_color_e)request.palette);
+        if (DIRP_SUCCESS != ret)
+        {
+            return ret;
+        }
+    }
+
+    if (request.brightness >= 0)
+    {
+        ret = dirp_get_enhancement_params(dirp_handle, &enhancement_params);
+        if (DIRP_SUCCESS != ret)
+        {
+            return ret;
+        }
+        enhancement_params.brightness = request.brightness;
+        ret = dirp_set_enhancement_params(dirp_handle, &enhancement_params);
+    }
+
+    return ret;
+}
+
+/* Decode one R-JPEG and run the requested action into out_data, reply describes the output */
+int32_t prv_serve_action_run(const serve_request_t &request, const vector<uint8_t> &rjpeg_data,
+                             vector<uint8_t> &out_data, serve_reply_t *reply)
+{
+    int32_t ret = DIRP_SUCCESS;
+    int32_t out_size = 0;
+    DIRP_HANDLE dirp_handle = nullptr;
+    dirp_resolution_t rjpeg_resolution = {0};
+    dirp_action_type_e action_type = (dirp_action_type_e)request.action;
+    dirp_measure_format_e measure_format = (request.flags & SERVE_FLAG_FLOAT32) ?
+                                           dirp_measure_format_float32 : dirp_measure_format_int16;
+    bool strech_only = (0 != (request.flags & SERVE_FLAG_STRECH));
+    dirp_lock_scope_e lock_scope = dirp_vendor_lock::scope(rjpeg_data.data(), rjpeg_data.size());
+    dirp_vendor_lock handle_lock(lock_scope, DIRP_LOCK_HANDLE);
+
+    {
+        TRACE_SCOPE("dirp_create_from_rjpeg");
+        dirp_vendor_lock lock(lock_scope, DIRP_LOCK_CALLS);
+        ret = dirp_create_from_rjpeg(rjpeg_data.data(), (int32_t)rjpeg_data.size(), &dirp_handle);
+    }
+    if (DIRP_SUCCESS != ret)
+    {
+        goto ERR_SERVE_ACTION_RET;
+    }
+
+    ret = dirp_get_rjpeg_resolution(dirp_handle, &rjpeg_resolution);
+    if (DIRP_SUCCESS != ret)
+    {
+        goto ERR_SERVE_ACTION_RET;
+    }
+
+    if (dirp_action_type_process == action_type)
+    {
+        TRACE_SCOPE("isp config");
+        ret = prv_serve_isp_config(dirp_handle, request);
+        if (DIRP_SUCCESS != ret)
+        {
+            goto ERR_SERVE_ACTION_RET;
+        }
+    }
+
+    if (dirp_action_type_extract != action_type)
+    {
+        TRACE_SCOPE("measurement config");
+        ret = prv_serve_measurement_config(dirp_handle, request, lock_scope);
+        if (DIRP_SUCCESS != ret)
+        {
+            goto ERR_SERVE_ACTION_RET;
+        }
+    }
+
+    out_size = prv_get_output_size(action_type, &rjpeg_resolution, measure_format, strech_only);
+    out_data.resize(out_size);
+
+    reply->width    = rjpeg_resolution.width;
+    reply->height   = rjpeg_resolution.height;
+    reply->channels = 1;
+    switch (action_type)
+    {
+        case dirp_action_type_extract:
+        {
+            TRACE_SCOPE("dirp_get_original_raw");
+            reply->dtype = SERVE_DTYPE_UINT16;
+            ret = dirp_get_original_raw(dirp_handle, (uint16_t *)out_data.data(), out_size);
+            break;
+        }
+        case dirp_action_type_measure:
+            if (dirp_measure_format_float32 == measure_format)
+            {
+                TRACE_SCOPE("dirp_measure_ex");
+                reply->dtype = SERVE_DTYPE_FLOAT32;
+                dirp_vendor_lock lock(lock_scope, DIRP_LOCK_CALLS);
+                ret = dirp_measure_ex(dirp_handle, (float *)out_data.data(), out_size);
+            }
+            else
+            {
+                TRACE_SCOPE("dirp_measure");
+                reply->dtype = SERVE_DTYPE_INT16;
+                dirp_vendor_lock lock(lock_scope, DIRP_LOCK_CALLS);
+                ret = dirp_measure(dirp_handle, (int16_t *)out_data.data(), out_size);
+            }
+            break;
+        default:
+            if (strech_only)
+            {
+                TRACE_SCOPE("dirp_process_strech");
+                reply->dtype = SERVE_DTYPE_FLOAT32;
+                ret = dirp_process_strech(dirp_handle, (float *)out_data.data(), out_size);
+            }
+            else
+            {
+                TRACE_SCOPE("dirp_process");
+                reply->dtype    = SERVE_DTYPE_UINT8;
+                reply->channels = 3;
+                ret = dirp_process(dirp_handle, (uint8_t *)out_data.data(), out_size);
+            }
+            break;
+    }
+    if (DIRP_SUCCESS == ret)
+    {
+        reply->data_size = out_size;
+    }
+
+ERR_SERVE_ACTION_RET:
+    if (dirp_handle)
+    {
+        TRACE_SCOPE("dirp_destroy");
+        dirp_destroy(dirp_handle);
+    }
+
+    return ret;
+}
+
+/*
+ * Answer one request of a connection whose socket is readable.
+ * Returns false when the connection should be closed: the client closed it, sent a bad header
+ * or the daemon stops, otherwise it goes back to the idle set of the accept loop.
+ */
+bool prv_serve_request(int client_fd, vector<uint8_t> &rjpeg_data, vector<uint8_t> &out_data, serve_stats_t *stats)
+{
+    serve_request_t request;
+    serve_reply_t reply;
+
+    if (!serve_socket::recv_all(client_fd, &request, sizeof(request), &s_serve_stop))
+    {
+        return false;
+    }
+
+    memset(&reply, 0, sizeof(reply));
+    memcpy(reply.magic, "DIRS", sizeof(reply.magic));
+
+    if ((0 != memcmp(request.magic, "DIRQ", sizeof(request.magic))) || (SERVE_PROTOCOL_VERSION != request.version) ||
+        (request.action >= dirp_action_type_num) || (0 == request.data_size) || (request.data_size > SERVE_MAX_DATA_SIZE))
+    {
+        reply.status = DIRP_ERROR_INVALID_PARAMS;
+        serve_socket::send_all(client_fd, &reply, sizeof(reply));
+        prv_serve_stats_add(stats, 0, true);
+        return false;
+    }
+
+    rjpeg_data.resize(request.data_size);
+    {
+        TRACE_SCOPE("recv");
+        if (!serve_socket::recv_all(client_fd, rjpeg_data.data(), rjpeg_data.size(), &s_serve_stop))
+        {
+            return false;
+        }
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    reply.status = prv_serve_action_run(request, rjpeg_data, out_data, &reply);
+    reply.elapsed_us = (uint32_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    prv_serve_stats_add(stats, reply.elapsed_us, DIRP_SUCCESS != reply.status);
+
+    TRACE_SCOPE("send");
+    if (!serve_socket::send_all(client_fd, &reply, sizeof(reply)) ||
+        !serve_socket::send_all(client_fd, out_data.data(), reply.data_size))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Accept connections on a Unix domain socket and hand their requests to a fixed set of worker threads.
+ * The main thread polls the listening socket and every idle connection, a connection is queued for
+ * the workers only once its next request arrives and comes back to the idle set after the reply,
+ * so idle clients never hold a worker. The SDK, its sub libraries and the API version check are loaded once for the daemon lifetime,
+ * each request only pays decoding and the action itself.
+ */
+int32_t prv_serve_run(const string &socket_path, int32_t thread_count)
+{
+    int32_t ret = DIRP_SUCCESS;
+    int listen_fd = -1;
+    struct sockaddr_un address;
+    struct stat socket_info;
+    vector<thread> workers;
+    serve_stats_t stats;
+    bounded_queue<int> connections((size_t)thread_count * 4);
+    int wake_pipe[2] = {-1, -1};
+    mutex returned_lock;
+    vector<int> returned;
+    vector<int> idle;
+    vector<struct pollfd> poll_fds;
+    bool queue_full = false;
+
+    memset(stats.buckets, 0, sizeof(stats.buckets));
+    stats.requests = 0;
+    stats.failed   = 0;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+    {
+        cout << "ERROR: socket path " << socket_path << " is longer than " << sizeof(address.sun_path) - 1 << " bytes" << endl;
+        return -1;
+    }
+    memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+
+    /* A socket left behind by a daemon that was killed is replaced, any other file is kept */
+    if ((0 == lstat(socket_path.c_str(), &socket_info)) && S_ISSOCK(socket_info.st_mode))
+    {
+        unlink(socket_path.c_str());
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+    {
+        cout << "ERROR: create socket failed" << endl;
+        return -1;
+    }
+    if ((0 != bind(listen_fd, (struct sockaddr *)&address, sizeof(address))) || (0 != listen(listen_fd, 64)))
+    {
+        cout << "ERROR: listen on " << socket_path << " failed : " << strerror(errno) << endl;
+        close(listen_fd);
+        return -1;
+    }
+
+    /* Workers write one byte per finished request, the accept loop then picks up returned connections */
+    if (0 != pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK))
+    {
+        cout << "ERROR: create wake pipe failed : " << strerror(errno) << endl;
+        close(listen_fd);
+        unlink(socket_path.c_str());
+        return -1;
+    }
+
+    signal(SIGINT,  prv_serve_signal_handler);
+    signal(SIGTERM, prv_serve_signal_handler);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int32_t i=0; i<thread_count; i++)
+    {
+        workers.emplace_back([&connections, &stats, &returned_lock, &returned, &wake_pipe, i]()
+        {
+            trace_recorder::instance().thread_name("worker", i);
+            vector<uint8_t> rjpeg_data;
+            vector<uint8_t> out_data;
+            int client_fd = -1;
+            char wake = 0;
+
+            while (connections.pop(client_fd))
+            {
+                if (prv_serve_request(client_fd, rjpeg_data, out_data, &stats))
+                {
+                    lock_guard<mutex> lock(returned_lock);
+                    returned.push_back(client_fd);
+                }
+                else
+                {
+                    close(client_fd);
+                }
+
+                /* A failed write means the pipe is full and a wake up is already pending */
+                ssize_t written = write(wake_pipe[1], &wake, 1);
+                (void)written;
+            }
+        });
+    }
+    cout << "Serve on " << socket_path << " with " << thread_count << " worker threads" << endl;
+
+    while (!s_serve_stop)
+    {
+        {
+            lock_guard<mutex> lock(returned_lock);
+            idle.insert(idle.end(), returned.begin(), returned.end());
+            returned.clear();
+        }
+
+        /* While the queue is full only a finished request can make room, so wait for that alone */
+        poll_fds.clear();
+        poll_fds.push_back({wake_pipe[0], POLLIN, 0});
+        if (!queue_full)
+        {
+            poll_fds.push_back({listen_fd, POLLIN, 0});
+            for (int client_fd : idle)
+            {
+                poll_fds.push_back({client_fd, POLLIN, 0});
+            }
+        }
+        if (poll(poll_fds.data(), poll_fds.size(), SERVE_POLL_MS) <= 0)
+        {
+            continue;
+        }
+
+        if (0 != poll_fds[0].revents)
+        {
+            char drain[64];
+            while (read(wake_pipe[0], drain, sizeof(drain)) > 0)
+            {
+            }
+            queue_full = false;
+        }
+        if (poll_fds.size() < 2)
+        {
+            continue;
+        }
+
+        /* A readable connection has its next request or a hang up, either way a worker handles it */
+        size_t kept = 0;
+        for (size_t i=2; i<poll_fds.size(); i++)
+        {
+            int client_fd = idle[i - 2];
+            if ((0 == poll_fds[i].revents) || queue_full || !connections.try_push(move(client_fd)))
+            {
+                queue_full = queue_full || (0 != poll_fds[i].revents);
+                idle[kept++] = idle[i - 2];
+            }
+        }
+        idle.resize(kept);
+
+        if (0 != (poll_fds[1].revents & POLLIN))
+        {
+            int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client_fd >= 0)
+            {
+                idle.push_back(client_fd);
+            }
+        }
+    }
+
+    /* Queued requests are still answered, idle connections are closed */
+    connections.close();
+    for (thread &worker : workers)
+    {
+        worker.join();
+    }
+    for (int client_fd : idle)
+    {
+        close(client_fd);
+    }
+    for (int client_fd : returned)
+    {
+        close(client_fd);
+    }
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    close(listen_fd);
+    unlink(socket_path.c_str());
+
+    cout << "Served " << stats.requests << " requests, " << stats.failed << " failed" << endl;
+    if (stats.requests > 0)
+    {
+        cout << "Request latency p50 " << prv_serve_stats_percentile(&stats, 50) << " ms, p99 "
+             << prv_serve_stats_percentile(&stats, 99) << " ms" << endl;
+    }
+
+    return ret;
+}
+#endif
+
+int32_t prv_trace_report(const string &trace_file)
+{
+    if ("none" == trace_file)
+    {
+        return DIRP_SUCCESS;
+    }
+
+    trace_recorder &recorder = trace_recorder::instance();
+    if (!recorder.write(trace_file))
+    {
+        cout << "ERROR: write trace file " << trace_file.c_str() << " failed" << endl;
+        return -1;
+    }
+
+    cout << "Trace : " << recorder.event_count() << " events written to " << trace_file.c_str() << endl;
+    if (recorder.dropped_count() > 0)
+    {
+        cout << "Trace : " << recorder.dropped_count() << " older events dropped, each thread keeps its last "
+             << TRACE_BUFFER_EVENTS << endl;
+    }
+    return DIRP_SUCCESS;
+}
+
 int main(int argc, char *argv[])
 {
     int ret = 0;
@@ -838,19 +1713,6 @@ int main(int argc, char *argv[])
         return 0;
     }
 
-    /* Get source file information */
-    string rjpeg_file_path = argparse_get_source_path();
-#ifdef _WIN32
-    ret = _access(rjpeg_file_path.c_str(), 0);
-#else
-    ret = access(rjpeg_file_path.c_str(), 0);
-#endif
-    if (0 != ret)
-    {
-        cout << "ERROR: source file " << rjpeg_file_path.c_str() << " not exist" << endl;
-        return ret;
-    }
-
     /* Adjust logger method */
     string logger_file = argparse_get_logger_file();
     if ("none" != logger_file)
@@ -862,6 +1724,14 @@ int main(int argc, char *argv[])
     dirp_verbose_level_e verbose_level = argparse_get_verbose_level();
     dirp_set_verbose_level(verbose_level);
 
+    /* Record per stage timings of every thread */
+    string trace_file = argparse_get_trace_file();
+    if ("none" != trace_file)
+    {
+        trace_recorder::instance().start();
+        trace_recorder::instance().thread_name("main");
+    }
+
     /* Get DIRP API version number */
     ret = dirp_get_api_version(&api_version);
     {
@@ -874,34 +1744,110 @@ int main(int argc, char *argv[])
     cout << "DIRP API version number : 0x"  << hex << api_version.api << dec << endl;
     cout << "DIRP API magic version  : "    << api_version.magic << endl;
 
-    /* Get action type */
-    dirp_action_type_e action_type = argparse_get_action_type();
+    /* Daemon mode takes its R-JPEG data and parameters from the requests */
+    if (argparse_is_serve())
+    {
+#ifdef _WIN32
+        cout << "ERROR: --serve needs Unix domain sockets, it is not supported on Windows" << endl;
+        return -1;
+#else
+        int32_t thread_count = argparse_get_thread_count();
+        if (thread_count <= 0)
+        {
+            cout << "ERROR: invalid worker thread count" << endl;
+            return -1;
+        }
+        ret = prv_serve_run(argparse_get_serve_path(), thread_count);
+        if (DIRP_SUCCESS != prv_trace_report(trace_file))
+        {
+            ret = -1;
+        }
+        return ret;
+#endif
+    }
+
+    /* Get source file information */
+    string rjpeg_file_path = argparse_get_source_path();
+#ifdef _WIN32
+    ret = _access(rjpeg_file_path.c_str(), 0);
+#else
+    ret = access(rjpeg_file_path.c_str(), 0);
+#endif
+    if (0 != ret)
+    {
+        cout << "ERROR: source file " << rjpeg_file_path.c_str() << " not exist" << endl;
+        return ret;
+    }
+
+    /* Probe only reads the R-JPEG header, no DIRP handle is created */
+    if (argparse_is_probe())
+    {
+        cout << "R-JPEG file path : " << rjpeg_file_path.c_str() << endl;
+        ret = prv_rjpeg_probe_print(rjpeg_file_path);
+        cout << "Test done with return code " << ret << endl;
+        return ret;
+    }
+
+    /* Get action types */
+    uint32_t action_types = argparse_get_action_types();
+    if (0 == action_types)
+    {
+        return -1;
+    }
+    bool multiple_actions = (0 != (action_types & (action_types - 1)));
+    string output_file_path = argparse_get_output_path();
 
     ifstream fs_i_rjpeg;
+    mapped_file rjpeg_mapping;
+    int32_t  rjpeg_size = 0;
+    uint8_t *rjpeg_data = nullptr;
+    const uint8_t *rjpeg_input = nullptr;
     cout << "R-JPEG file path : " << rjpeg_file_path.c_str() << endl;
 
-    /* Load R-JPEG data to buffer */
+    if (argparse_is_mmap_input())
+    {
+        /* Map R-JPEG file, the SDK reads the mapped pages directly */
+        if (!rjpeg_mapping.open(rjpeg_file_path.c_str()))
+        {
+            cout << "ERROR: mmap " << rjpeg_file_path.c_str() << " failed" << endl;
+            ret = -1;
+            goto ERR_FILE_OPEN;
+        }
+        rjpeg_size  = (int32_t)rjpeg_mapping.size();
+        rjpeg_input = rjpeg_mapping.data();
+    }
+    else
+    {
+        /* Load R-JPEG data to buffer */
 #ifdef _WIN32
-    struct _stat rjpeg_file_info;
-    _stat(rjpeg_file_path.c_str(), &rjpeg_file_info);
+        struct _stat rjpeg_file_info;
+        _stat(rjpeg_file_path.c_str(), &rjpeg_file_info);
 #else
-    struct stat rjpeg_file_info;
-    stat(rjpeg_file_path.c_str(), &rjpeg_file_info);
+        struct stat rjpeg_file_info;
+        stat(rjpeg_file_path.c_str(), &rjpeg_file_info);
 #endif
-    int32_t  rjpeg_size = (uint32_t)rjpeg_file_info.st_size;
-    uint8_t *rjpeg_data = (uint8_t *)malloc(rjpeg_size);
-    if (nullptr == rjpeg_data)
-    {
-        cout << "ERROR: malloc failed" << endl;
-        goto ERR_DIRP_RET;
-    }
+        rjpeg_size = (uint32_t)rjpeg_file_info.st_size;
+        rjpeg_data = (uint8_t *)malloc(rjpeg_size);
+        if (nullptr == rjpeg_data)
+        {
+            cout << "ERROR: malloc failed" << endl;
+            goto ERR_DIRP_RET;
+        }
 
-    fs_i_rjpeg.open(rjpeg_file_path.c_str(), ios::binary);
-    FSTREAM_OPEN_CHECK(fs_i_rjpeg , "rjpeg.jpg", ERR_FILE_OPEN);
-    fs_i_rjpeg.read((char *)rjpeg_data, rjpeg_size);
+        fs_i_rjpeg.open(rjpeg_file_path.c_str(), ios::binary);
+        FSTREAM_OPEN_CHECK(fs_i_rjpeg , "rjpeg.jpg", ERR_FILE_OPEN);
+        {
+            TRACE_SCOPE("read");
+            fs_i_rjpeg.read((char *)rjpeg_data, rjpeg_size);
+        }
+        rjpeg_input = rjpeg_data;
+    }
 
     /* Create a new DIRP handle */
-    ret = dirp_create_from_rjpeg(rjpeg_data, rjpeg_size, &dirp_handle);
+    {
+        TRACE_SCOPE("dirp_create_from_rjpeg");
+        ret = dirp_create_from_rjpeg(rjpeg_input, rjpeg_size, &dirp_handle);
+    }
     if (DIRP_SUCCESS != ret)
     {
         cout << "ERROR: create R-JPEG dirp handle failed" << endl;
@@ -917,8 +1863,9 @@ int main(int argc, char *argv[])
     }
 
     /* Configure ISP parameters */
-    if (dirp_action_type_process == action_type)
+    if (action_types & (1u << dirp_action_type_process))
     {
+        TRACE_SCOPE("isp config");
         ret = prv_isp_config(dirp_handle);
         if (DIRP_SUCCESS != ret)
         {
@@ -928,8 +1875,9 @@ int main(int argc, char *argv[])
     }
 
     /* Configure measurement parameters */
-    if ((dirp_action_type_measure == action_type) || (dirp_action_type_process == action_type))
+    if (action_types & ((1u << dirp_action_type_measure) | (1u << dirp_action_type_process)))
     {
+        TRACE_SCOPE("measurement config");
         ret = prv_measurement_config(dirp_handle);
         if (DIRP_SUCCESS != ret)
         {
@@ -938,18 +1886,36 @@ int main(int argc, char *argv[])
         }
     }
 
-    /* Run actions */
-    ret = prv_action_run(dirp_handle);
-    if (DIRP_SUCCESS != ret)
+    /* Run actions, all of them share the DIRP handle decoded above */
+    for (int32_t i=0; i<dirp_action_type_num; i++)
     {
-        cout << "ERROR: call prv_action_run failed" << endl;
-        goto ERR_DIRP_RET;
+        if (0 == (action_types & (1u << i)))
+        {
+            continue;
+        }
+
+        dirp_action_type_e action_type = (dirp_action_type_e)i;
+        string action_output_path = prv_get_action_output_path(output_file_path, action_type, multiple_actions);
+        if ((dirp_action_type_measure == action_type) && argparse_is_sweep())
+        {
+            ret = prv_measure_sweep_run(dirp_handle, action_output_path);
+        }
+        else
+        {
+            ret = prv_action_run(dirp_handle, action_type, action_output_path);
+        }
+        if (DIRP_SUCCESS != ret)
+        {
+            cout << "ERROR: call prv_action_run failed" << endl;
+            goto ERR_DIRP_RET;
+        }
     }
 
 ERR_DIRP_RET:
     /* Destroy DIRP handle */
     if (dirp_handle)
     {
+        TRACE_SCOPE("dirp_destroy");
         int status = dirp_destroy(dirp_handle);
         if (DIRP_SUCCESS != status)
         {
@@ -966,6 +1932,11 @@ ERR_FILE_OPEN:
     if (rjpeg_data)
         free(rjpeg_data);
 
+    if (DIRP_SUCCESS != prv_trace_report(trace_file))
+    {
+        ret = -1;
+    }
+
     //system("pause");
     return ret;
 }
@@ -28,11 +28,35 @@
 #include <sstream>
 #include <iterator>
 #include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <deque>
+#include <functional>
 #include <string.h>
 #include <sys/stat.h>
 
 #include "dirp_api.h"
 #include "argagg.hpp"
+#include "work_stealing_pool.h"
+#include "bounded_queue.h"
+#include "jpeg_segment.h"
+#include "tiff_writer.h"
+#include "buffer_pool.h"
+#include "mapped_file.h"
+#include "result_cache.h"
+#include "dir_walker.h"
+#include "run_journal.h"
+#include "output_manifest.h"
+#include "rjpeg_probe.h"
+#include "frame_container.h"
+#include "temperature_stats.h"
+#include "temperature_pack.h"
+#include "batch_logger.h"
+#include "dir_watcher.h"
+#include "trace_recorder.h"
+#include "dirp_vendor_lock.h"
 
 #ifdef _WIN32
 #include <io.h>
@@ -40,18 +64,20 @@
 #include <sys/io.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <dirent.h>
+#include <signal.h>
 #endif
 
 using namespace std;
 
 #define APP_VERSION "V1.4"
 
+#define SUBMIT_AHEAD_PER_THREAD (4)      /* Files queued per worker while the source directory is still being walked */
+
 #define FSTREAM_OPEN_CHECK(fs, name, go) \
             { \
                 if(!fs.is_open()) \
                 { \
-                    cout << "ERROR: open " << name << " file failed!" << endl; \
+                    LOG_ERROR("ERROR: open " << name << " file failed!"); \
                     ret = -1; \
                     goto go; \
                 } \
@@ -62,6 +88,7 @@ typedef enum
     dirp_action_type_extract = 0,
     dirp_action_type_measure,
     dirp_action_type_process,
+    dirp_action_type_stats,
     dirp_action_type_num,
 } dirp_action_type_e;
 
@@ -69,9 +96,51 @@ typedef enum
 {
     dirp_measure_format_int16 = 0,
     dirp_measure_format_float32,
+    dirp_measure_format_float16,
     dirp_measure_format_num,
 } dirp_measure_format_e;
 
+/* Command line options of one run, parsed and validated once before any worker starts */
+typedef struct
+{
+    dirp_action_type_e          action_type;
+    string                      source_dir;
+    string                      output_prefix;
+    bool                        tiff_output;
+    bool                        mirror_output;
+    bool                        mmap_input;
+
+    /* action[measure] */
+    dirp_measure_format_e       measure_format;
+    bool                        distance_modified;
+    bool                        humidity_modified;
+    bool                        emissivity_modified;
+    bool                        reflection_modified;
+    dirp_measurement_params_t   measurement_params;
+
+    /* action[process] */
+    bool                        strech_only;
+    bool                        pseudo_color_modified;
+    dirp_pseudo_color_e         pseudo_color;
+    bool                        brightness_modified;
+    int32_t                     brightness;
+    dirp_isotherm_t             isotherm;
+    dirp_color_bar_t            color_bar;
+
+    /* action[stats] */
+    stats_options_t             stats;
+} conversion_config_t;
+
+/* Optional bookkeeping of one run shared by all workers, members are nullptr when disabled */
+typedef struct
+{
+    result_cache               *cache;
+    run_journal                *journal;
+    output_manifest            *manifest;
+    frame_container            *container;
+    stats_report               *stats;
+} run_context_t;
+
 static argagg::parser_results args;
 static argagg::parser argparser {{
     {
@@ -88,25 +157,135 @@ static argagg::parser argparser {{
         "        " "0: none      | 1: debug     | 2: detail" "\r\n"
         "        " "(default=\"none\")", 1,
     },
+    {
+        "loglevel", {"--loglevel"},
+        "console messages of the conversion, written in batches by a logger thread" "\r\n"
+        "        " "quiet: errors and a progress line | error | warning" "\r\n"
+        "        " "info: one line per step of a file | debug: R-JPEG details" "\r\n"
+        "        " "(default=\"info\")", 1,
+    },
     {
         "logger", {"--logger"},
         "logger file" "\r\n"
         "        " "0: none      | 1: logger_file_name.txt" "\r\n"
         "        " "(default=\"none\")", 1,
     },
+    {
+        "trace", {"--trace"},
+        "time every stage of every file per thread and write a Chrome trace event file" "\r\n"
+        "        " "argument : file path, e.g. out.json, load it in chrome://tracing or ui.perfetto.dev" "\r\n"
+        "        " "(default=\"none\")", 1,
+    },
     {
         "source", {"-s", "--source"},
         "source file path", 1,
     },
     {
         "extension", {"-e", "--extension"},
-        "source file extension name" "\r\n"
+        "source file extension name, or file name pattern with * and ?" "\r\n"
+        "        " "e.g. \"JPG\", \"DJI_*_R.JPG\", case insensitive" "\r\n"
         "        " "(default=\"JPG\")", 1,
     },
+    {
+        "watch", {"--watch"},
+        "convert R-JPEG files as they land in a directory tree, until SIGINT or SIGTERM (Linux only)" "\r\n"
+        "        " "argument : directory, used instead of --source, files already in it are converted first" "\r\n"
+        "        " "a file is taken on IN_CLOSE_WRITE or IN_MOVED_TO once it is unchanged for --settle ms" "\r\n"
+        "        " "outputs always use the mirror layout" "\r\n"
+        "        " "(default=\"off\")", 1,
+    },
+    {
+        "settle", {"--settle"},
+        "(watch usage) milliseconds a new file must keep its size and time before it is converted" "\r\n"
+        "        " "(default=\"500\")", 1,
+    },
+    {
+        "threads", {"-t", "--threads"},
+        "worker thread count" "\r\n"
+        "        " "[N] positive number | auto: one per CPU core" "\r\n"
+        "        " "(default=\"auto\")", 1,
+    },
+    {
+        "pipeline", {"--pipeline"},
+        "run read, process and write as separate pipeline stages" "\r\n"
+        "        " "0: off       | 1: on" "\r\n"
+        "        " "(default=\"off\")", 1,
+    },
+    {
+        "readers", {"--readers"},
+        "(pipeline usage) file reader thread count" "\r\n"
+        "        " "(default=\"2\")", 1,
+    },
+    {
+        "writers", {"--writers"},
+        "(pipeline usage) output writer thread count" "\r\n"
+        "        " "(default=\"2\")", 1,
+    },
+    {
+        "queue", {"--queue"},
+        "(pipeline usage) depth of each bounded stage queue" "\r\n"
+        "        " "(default=\"16\")", 1,
+    },
+    {
+        "poolmb", {"--poolmb"},
+        "max size in MB of idle input/output buffers kept for reuse" "\r\n"
+        "        " "0: no buffer reuse" "\r\n"
+        "        " "(default=\"256\")", 1,
+    },
+    {
+        "io", {"--io"},
+        "R-JPEG input file access method" "\r\n"
+        "        " "0: read      | 1: mmap" "\r\n"
+        "        " "mmap passes the mapped file to the SDK without a copy" "\r\n"
+        "        " "(default=\"read\")", 1,
+    },
+    {
+        "cache", {"--cache"},
+        "result cache directory, files already converted with the same options are linked from it" "\r\n"
+        "        " "(default=\"none\")", 1,
+    },
+    {
+        "cachemb", {"--cachemb"},
+        "(cache usage) max size in MB of the result cache, least recently used results are removed first" "\r\n"
+        "        " "(default=\"1024\")", 1,
+    },
+    {
+        "journal", {"--journal"},
+        "journal file of finished inputs, appended while the run goes on" "\r\n"
+        "        " "outputs use the mirror layout unless --layout is given" "\r\n"
+        "        " "none: no journal" "\r\n"
+        "        " "(default=\"none\")", 1,
+    },
+    {
+        "resume", {"--resume"},
+        "skip inputs the journal lists as finished, with unchanged size and time and an existing output" "\r\n"
+        "        " "needs --journal and the mirror layout", 0,
+    },
+    {
+        "layout", {"--layout"},
+        "output file naming" "\r\n"
+        "        " "0: index     | [output]_[N].raw, N in directory walk order" "\r\n"
+        "        " "1: mirror    | [output]/[source sub directory]/[source name].raw" "\r\n"
+        "        " "(default=\"index\", \"mirror\" with --journal)", 1,
+    },
+    {
+        "manifest", {"--manifest"},
+        "JSON lines manifest with source, output, width, height, dtype and pixel offset of every output" "\r\n"
+        "        " "none: no manifest" "\r\n"
+        "        " "(default=\"none\")", 1,
+    },
+    {
+        "container", {"--container"},
+        "pack the outputs of all inputs into one page aligned container file with a frame index" "\r\n"
+        "        " "instead of writing one file per input" "\r\n"
+        "        " "(default=\"none\")", 1,
+    },
     {
         "action", {"-a", "--action"},
         "action name " "\r\n"
-        "        " "(possible values=\"extract\", \"measure\", \"process\")", 1,
+        "        " "(possible values=\"extract\", \"measure\", \"process\", \"stats\")" "\r\n"
+        "        " "stats measures every R-JPEG and writes one row of temperature statistics per file" "\r\n"
+        "        " "to the output file, CSV or JSON lines when its name ends with .json or .jsonl", 1,
     },
     {
         "output", {"-o", "--output"},
@@ -154,9 +333,37 @@ static argagg::parser argparser {{
     {
         "measurefmt", {"--measurefmt"},
         "(action[measure] usage) output format for temperature measurement" "\r\n"
-        "        " "0: int16     | 1: float32" "\r\n"
+        "        " "0: int16     | 1: float32   | 2: float16" "\r\n"
+        "        " "int16 is 0.1 Celsius, float16 is packed from float32 with an AVX2 kernel" "\r\n"
         "        " "(default=\"int16\")", 1,
     },
+    {
+        "outfmt", {"--outfmt"},
+        "(action[measure] usage) output file format" "\r\n"
+        "        " "0: raw       | 1: tiff" "\r\n"
+        "        " "tiff carries the GPS tags of the R-JPEG, and is FLOAT32 unless --measurefmt is given" "\r\n"
+        "        " "int16 tiff stores its 0.1 scale in the GDAL_METADATA tag" "\r\n"
+        "        " "(default=\"raw\")", 1,
+    },
+    {
+        "roi", {"--roi"},
+        "(action[stats] usage) polygon regions reported besides the whole frame" "\r\n"
+        "        " "argument format : [name]:[x],[y],[x],[y],[x],[y]...;[name]:..." "\r\n"
+        "        " "or @[file] with one region per line, pixel coordinates" "\r\n"
+        "        " "(default=\"none\")", 1,
+    },
+    {
+        "percentiles", {"--percentiles"},
+        "(action[stats] usage) comma separated percentiles in [0,100]" "\r\n"
+        "        " "none: no percentiles" "\r\n"
+        "        " "(default=\"5,50,95\")", 1,
+    },
+    {
+        "histogram", {"--histogram"},
+        "(action[stats] usage) temperature histogram" "\r\n"
+        "        " "argument format : [bins],[low],[high]" "\r\n"
+        "        " "(default=\"none\")", 1,
+    },
     {
         "distance", {"--distance"},
         "(action[measure] usage) distance to the target" "\r\n"
@@ -183,9 +390,6 @@ static argagg::parser argparser {{
     },
 }};
 
-static dirp_isotherm_t s_isotherm =  {false, 30.0f, 25.0f};
-static dirp_color_bar_t s_color_bar = {false, 30.0f, 25.0f};
-
 int argparse_init(int argc, char *argv[])
 {
     ostringstream usage;
@@ -208,8 +412,27 @@ int argparse_init(int argc, char *argv[])
     return 0;
 }
 
+bool argparse_is_watch(void)
+{
+    return args["watch"] && ("off" != args["watch"].as<string>());
+}
+
+int32_t argparse_get_settle_ms(void)
+{
+    if (args["settle"])
+    {
+        return args["settle"].as<int32_t>();
+    }
+
+    return 500;
+}
+
 string argparse_get_source_path(void)
 {
+    if (argparse_is_watch())
+    {
+        return args["watch"].as<string>();
+    }
     if (args["source"])
     {
         return args["source"].as<string>();
@@ -228,6 +451,85 @@ string argparse_get_source_extension(void)
     return "JPG";
 }
 
+int32_t argparse_get_thread_count(void)
+{
+    if (args["threads"])
+    {
+        return work_stealing_pool::parse_thread_count(args["threads"].as<string>());
+    }
+
+    return work_stealing_pool::parse_thread_count("auto");
+}
+
+bool argparse_is_pipeline(void)
+{
+    if (args["pipeline"])
+    {
+        return ("on" == args["pipeline"].as<string>());
+    }
+
+    return false;
+}
+
+bool argparse_is_mmap_input(void)
+{
+    if (args["io"])
+    {
+        return ("mmap" == args["io"].as<string>());
+    }
+
+    return false;
+}
+
+int32_t argparse_get_stage_count(const char *name, int32_t default_count)
+{
+    if (args[name])
+    {
+        return args[name].as<int32_t>();
+    }
+
+    return default_count;
+}
+
+uint64_t argparse_get_pool_bytes(void)
+{
+    int32_t pool_mb = 256;
+
+    if (args["poolmb"])
+    {
+        pool_mb = args["poolmb"].as<int32_t>();
+    }
+
+    return (pool_mb > 0) ? ((uint64_t)pool_mb << 20) : 0;
+}
+
+string argparse_get_cache_dir(void)
+{
+    if (args["cache"])
+    {
+        return args["cache"].as<string>();
+    }
+
+    return string("none");
+}
+
+uint64_t argparse_get_cache_bytes(void)
+{
+    int32_t cache_mb = 1024;
+
+    if (args["cachemb"])
+    {
+        cache_mb = args["cachemb"].as<int32_t>();
+    }
+
+    return (cache_mb > 0) ? ((uint64_t)cache_mb << 20) : 0;
+}
+
+bool argparse_is_resume(void)
+{
+    return args["resume"];
+}
+
 string argparse_get_output_path(void)
 {
     if (args["output"])
@@ -238,67 +540,124 @@ string argparse_get_output_path(void)
     return "output.raw";
 }
 
-string argparse_get_logger_file(void)
+string argparse_get_journal_file(void)
 {
-    if (args["logger"])
+    if (args["journal"])
     {
-        return args["logger"].as<string>();
+        return args["journal"].as<string>();
+    }
+
+    return "none";
+}
+
+/*
+ * Arrival order of watched files, and the directory walk order of a journaled run, are not stable
+ * across runs, so their outputs are named after the sources
+ */
+bool argparse_is_mirror_output(void)
+{
+    if (argparse_is_watch())
+    {
+        return true;
+    }
+    if (args["layout"])
+    {
+        return ("mirror" == args["layout"].as<string>());
+    }
+
+    return ("none" != argparse_get_journal_file());
+}
+
+string argparse_get_manifest_file(void)
+{
+    if (args["manifest"])
+    {
+        return args["manifest"].as<string>();
+    }
+
+    return "none";
+}
+
+string argparse_get_container_file(void)
+{
+    if (args["container"])
+    {
+        return args["container"].as<string>();
     }
 
     return string("none");
 }
 
-int32_t argparse_get_measurement_params(dirp_measurement_params_t *measurement_params, bool *modified)
+string argparse_get_log_level(void)
 {
-    int32_t ret = DIRP_SUCCESS;
-    *modified = false;
+    if (args["loglevel"])
+    {
+        return args["loglevel"].as<string>();
+    }
+
+    return string("info");
+}
 
-    if (args["distance"])
+string argparse_get_logger_file(void)
+{
+    if (args["logger"])
     {
-        *modified = true;
-        float original_distance = measurement_params->distance;
-        measurement_params->distance = args["distance"].as<float>();
-        cout << "Change distance from " << original_distance << " to " << measurement_params->distance << endl;
+        return args["logger"].as<string>();
     }
-    if (args["humidity"])
+
+    return string("none");
+}
+
+string argparse_get_trace_file(void)
+{
+    if (args["trace"])
     {
-        *modified = true;
-        float original_humidity = measurement_params->humidity;
-        measurement_params->humidity = args["humidity"].as<float>();
-        cout << "Change humidity from " << original_humidity << " to " << measurement_params->humidity << endl;
+        return args["trace"].as<string>();
     }
-    if (args["emissivity"])
+
+    return string("none");
+}
+
+int32_t argparse_get_measurement_params(conversion_config_t *config)
+{
+    config->distance_modified   = args["distance"];
+    config->humidity_modified   = args["humidity"];
+    config->emissivity_modified = args["emissivity"];
+    config->reflection_modified = args["reflection"];
+
+    try
     {
-        *modified = true;
-        float original_emissivity = measurement_params->emissivity;
-        measurement_params->emissivity = args["emissivity"].as<float>();
-        cout << "Change emissivity from " << original_emissivity << " to " << measurement_params->emissivity << endl;
+        if (config->distance_modified)      config->measurement_params.distance     = args["distance"].as<float>();
+        if (config->humidity_modified)      config->measurement_params.humidity     = args["humidity"].as<float>();
+        if (config->emissivity_modified)    config->measurement_params.emissivity   = args["emissivity"].as<float>();
+        if (config->reflection_modified)    config->measurement_params.reflection   = args["reflection"].as<float>();
     }
-    if (args["reflection"])
+    catch(exception const & e)
     {
-        *modified = true;
-        float original_reflection = measurement_params->reflection;
-        measurement_params->reflection = args["reflection"].as<float>();
-        cout << "Change reflection from " << original_reflection << " to " << measurement_params->reflection << endl;
+        (void)e;
+        cout << "ERROR: measurement parameter format is not float" << endl;
+        return -1;
     }
 
-    return ret;
+    return DIRP_SUCCESS;
 }
 
-int32_t argparse_get_enhancement_params(dirp_enhancement_params_t *enhancement_params, bool *modified)
+int32_t argparse_get_enhancement_params(conversion_config_t *config)
 {
-    int32_t ret = DIRP_SUCCESS;
-    *modified = false;
+    config->brightness_modified = args["brightness"];
 
-    if (args["brightness"])
+    try
     {
-        *modified = true;
-        int32_t original_brightness = enhancement_params->brightness;
-        enhancement_params->brightness = args["brightness"].as<int32_t>();
-        cout << "Change brightness from " << original_brightness << " to " << enhancement_params->brightness << endl;
+        if (config->brightness_modified)    config->brightness = args["brightness"].as<int32_t>();
+    }
+    catch(exception const & e)
+    {
+        (void)e;
+        cout << "ERROR: brightness format is not integer" << endl;
+        return -1;
     }
 
-    return ret;
+    return DIRP_SUCCESS;
 }
 
 int32_t argparse_get_isotherm_params(dirp_isotherm_t *isotherm)
@@ -440,13 +799,37 @@ dirp_action_type_e argparse_get_action_type(void)
     if      ("extract" == action_name)  return dirp_action_type_extract;
     else if ("measure" == action_name)  return dirp_action_type_measure;
     else if ("process" == action_name)  return dirp_action_type_process;
+    else if ("stats" == action_name)    return dirp_action_type_stats;
     else                                return dirp_action_type_process;
 }
 
+bool argparse_is_tiff_output(void)
+{
+    string output_format;
+
+    if (args["outfmt"])
+    {
+        output_format = args["outfmt"].as<string>();
+    }
+    else
+    {
+        output_format = "raw";
+    }
+
+    if      ("tiff" == output_format)   return true;
+    else                                return false;
+}
+
 dirp_measure_format_e argparse_get_measure_format(void)
 {
     string measure_format;
 
+    /* TIFF output carries the FLOAT32 temperature of dirp_measure_ex unless asked otherwise */
+    if (argparse_is_tiff_output() && !args["measurefmt"])
+    {
+        return dirp_measure_format_float32;
+    }
+
     if (args["measurefmt"])
     {
         measure_format = args["measurefmt"].as<string>();
@@ -458,33 +841,33 @@ dirp_measure_format_e argparse_get_measure_format(void)
 
     if      ("int16" == measure_format)     return dirp_measure_format_int16;
     else if ("float32" == measure_format)   return dirp_measure_format_float32;
+    else if ("float16" == measure_format)   return dirp_measure_format_float16;
     else                                    return dirp_measure_format_int16;
 }
 
-dirp_pseudo_color_e argparse_get_pseudo_color(dirp_pseudo_color_e pseudo_color_old, bool *modified)
+dirp_pseudo_color_e argparse_get_pseudo_color(bool *modified)
 {
-    dirp_pseudo_color_e pseudo_color_new = pseudo_color_old;
+    dirp_pseudo_color_e pseudo_color = DIRP_PSEUDO_COLOR_IRONRED;
 
     *modified = false;
     if (args["palette"])
     {
         string pseudo_color_name = args["palette"].as<string>();
         *modified = true;
-        if      ("white_hot" == pseudo_color_name)  pseudo_color_new = DIRP_PSEUDO_COLOR_WHITEHOT;
-        else if ("fulgurite" == pseudo_color_name)  pseudo_color_new = DIRP_PSEUDO_COLOR_FULGURITE;
-        else if ("iron_red"  == pseudo_color_name)  pseudo_color_new = DIRP_PSEUDO_COLOR_IRONRED;
-        else if ("hot_iron"  == pseudo_color_name)  pseudo_color_new = DIRP_PSEUDO_COLOR_HOTIRON;
-        else if ("medical"   == pseudo_color_name)  pseudo_color_new = DIRP_PSEUDO_COLOR_MEDICAL;
-        else if ("arctic"    == pseudo_color_name)  pseudo_color_new = DIRP_PSEUDO_COLOR_ARCTIC;
-        else if ("rainbow1"  == pseudo_color_name)  pseudo_color_new = DIRP_PSEUDO_COLOR_RAINBOW1;
-        else if ("rainbow2"  == pseudo_color_name)  pseudo_color_new = DIRP_PSEUDO_COLOR_RAINBOW2;
-        else if ("tint"      == pseudo_color_name)  pseudo_color_new = DIRP_PSEUDO_COLOR_TINT;
-        else if ("black_hot" == pseudo_color_name)  pseudo_color_new = DIRP_PSEUDO_COLOR_BLACKHOT;
-        else                                        pseudo_color_new = DIRP_PSEUDO_COLOR_IRONRED;
-        cout << "Change pseudo color from " << pseudo_color_old << " to " << pseudo_color_new << endl;
-    }
-
-    return pseudo_color_new;
+        if      ("white_hot" == pseudo_color_name)  pseudo_color = DIRP_PSEUDO_COLOR_WHITEHOT;
+        else if ("fulgurite" == pseudo_color_name)  pseudo_color = DIRP_PSEUDO_COLOR_FULGURITE;
+        else if ("iron_red"  == pseudo_color_name)  pseudo_color = DIRP_PSEUDO_COLOR_IRONRED;
+        else if ("hot_iron"  == pseudo_color_name)  pseudo_color = DIRP_PSEUDO_COLOR_HOTIRON;
+        else if ("medical"   == pseudo_color_name)  pseudo_color = DIRP_PSEUDO_COLOR_MEDICAL;
+        else if ("arctic"    == pseudo_color_name)  pseudo_color = DIRP_PSEUDO_COLOR_ARCTIC;
+        else if ("rainbow1"  == pseudo_color_name)  pseudo_color = DIRP_PSEUDO_COLOR_RAINBOW1;
+        else if ("rainbow2"  == pseudo_color_name)  pseudo_color = DIRP_PSEUDO_COLOR_RAINBOW2;
+        else if ("tint"      == pseudo_color_name)  pseudo_color = DIRP_PSEUDO_COLOR_TINT;
+        else if ("black_hot" == pseudo_color_name)  pseudo_color = DIRP_PSEUDO_COLOR_BLACKHOT;
+        else                                        pseudo_color = DIRP_PSEUDO_COLOR_IRONRED;
+    }
+
+    return pseudo_color;
 }
 
 bool argparse_is_strech_only(void)
@@ -504,123 +887,279 @@ bool argparse_is_strech_only(void)
     else                            return false;
 }
 
-int32_t prv_rjpeg_info_print(DIRP_HANDLE dirp_handle)
+/* Fields of the comma separated list text as floats, false when one is not a number */
+static bool prv_parse_float_list(const string &text, vector<float> &values)
 {
-    int32_t ret = DIRP_SUCCESS;
-    dirp_rjpeg_version_t rjpeg_version = {0};
-    dirp_resolution_t rjpeg_resolution = {0};
+    stringstream ss(text);
+    string str;
 
-    ret = dirp_get_rjpeg_version(dirp_handle, &rjpeg_version);
-    if (DIRP_SUCCESS != ret)
+    values.clear();
+    try
     {
-        cout << "ERROR: call dirp_get_rjpeg_version failed" << endl;
-        goto ERR_RJPEG_INFO_PRINT_RET;
+        while (getline(ss, str, ','))
+        {
+            values.push_back(stof(str));
+        }
     }
-    cout << "R-JPEG version information" << endl;
-    cout << "    R-JPEG version : 0x" << hex << rjpeg_version.rjpeg  << dec << endl;
-    cout << "    header version : 0x" << hex << rjpeg_version.header << dec << endl;
-    cout << " curve LUT version : 0x" << hex << rjpeg_version.curve  << dec << endl;
-
-    ret = dirp_get_rjpeg_resolution(dirp_handle, &rjpeg_resolution);
-    if (DIRP_SUCCESS != ret)
+    catch(exception const & e)
     {
-        cout << "ERROR: call dirp_get_rjpeg_version failed" << endl;
-        goto ERR_RJPEG_INFO_PRINT_RET;
+        (void)e;
+        return false;
     }
-    cout << "R-JPEG resolution size" << endl;
-    cout << "      image  width : " << rjpeg_resolution.width  << endl;
-    cout << "      image height : " << rjpeg_resolution.height << endl;
 
-ERR_RJPEG_INFO_PRINT_RET:
-    return ret;
+    return true;
 }
 
-int32_t prv_isp_config(DIRP_HANDLE dirp_handle)
+int32_t argparse_get_stats_options(conversion_config_t *config)
 {
-    int32_t ret = DIRP_SUCCESS;
-    bool modified = false;
-    dirp_enhancement_params_t enhancement_params = {0};
-    dirp_pseudo_color_e pseudo_color_old = DIRP_PSEUDO_COLOR_IRONRED;
-    dirp_pseudo_color_e pseudo_color_new = DIRP_PSEUDO_COLOR_IRONRED;
+    stats_options_t &options = config->stats;
+    vector<string> roi_specs;
+    string str;
 
-    /* Set pseudo color type */
-    ret = dirp_get_pseudo_color(dirp_handle, &pseudo_color_old);
-    if (DIRP_SUCCESS != ret)
+    options.json = false;
+    size_t dot = config->output_prefix.find_last_of('.');
+    if (string::npos != dot)
     {
-        cout << "ERROR: call dirp_get_pseudo_color failed" << endl;
-        goto ERR_ISP_CONFIG_RET;
+        string extension = config->output_prefix.substr(dot);
+        options.json = (".json" == extension) || (".jsonl" == extension);
     }
 
-    /* Refresh custom pseudo color type */
-    modified = false;
-    pseudo_color_new = argparse_get_pseudo_color(pseudo_color_old, &modified);
-    if (modified)
+    /* Regions come inline separated by ';', or one per line from a file */
+    if (args["roi"])
     {
-        ret = dirp_set_pseudo_color(dirp_handle, pseudo_color_new);
-        if (DIRP_SUCCESS != ret)
+        string arg_str = args["roi"].as<string>();
+        if ((arg_str.size() > 1) && ('@' == arg_str[0]))
         {
-            cout << "ERROR: call dirp_set_pseudo_color failed" << endl;
-            goto ERR_ISP_CONFIG_RET;
+            ifstream roi_file(arg_str.substr(1).c_str());
+            if (!roi_file.is_open())
+            {
+                cout << "ERROR: open roi file " << arg_str.substr(1).c_str() << " failed" << endl;
+                return -1;
+            }
+            while (getline(roi_file, str))
+            {
+                roi_specs.push_back(str);
+            }
         }
-    }
-
-    /* Set isotherm parameters */
-    ret = argparse_get_isotherm_params(&s_isotherm);
-    if (DIRP_SUCCESS != ret)
-    {
-        cout << "ERROR: call argparse_get_isotherm_params failed" << endl;
-        s_isotherm.enable = false;
-    }
-    if (s_isotherm.enable)
-    {
-        ret = dirp_set_isotherm(dirp_handle, &s_isotherm);
-        if (DIRP_SUCCESS != ret)
+        else
         {
-            cout << "ERROR: call dirp_set_isotherm failed" << endl;
-            goto ERR_ISP_CONFIG_RET;
+            stringstream ss(arg_str);
+            while (getline(ss, str, ';'))
+            {
+                roi_specs.push_back(str);
+            }
         }
     }
 
-    /* Set color bar parameters */
-    ret = argparse_get_color_bar_params(&s_color_bar);
-    if (DIRP_SUCCESS != ret)
-    {
-        cout << "ERROR: call argparse_get_color_bar_params failed" << endl;
-        s_color_bar.manual_enable = false;
-    }
-    if (s_color_bar.manual_enable)
+    for (const string &spec : roi_specs)
     {
-        ret = dirp_set_color_bar(dirp_handle, &s_color_bar);
-        if (DIRP_SUCCESS != ret)
+        size_t colon = spec.find(':');
+        if (spec.find_first_not_of(" \t\r") == string::npos)
         {
-            cout << "ERROR: call dirp_set_color_bar failed" << endl;
-            goto ERR_ISP_CONFIG_RET;
+            continue;
         }
-    }
 
-    /* Get original enhancement parameters */
-    ret = dirp_get_enhancement_params(dirp_handle, &enhancement_params);
-    if (DIRP_SUCCESS != ret)
-    {
-        cout << "ERROR: call dirp_get_enhancement_params failed" << endl;
-        goto ERR_ISP_CONFIG_RET;
+        stats_roi_t roi;
+        roi.name = (string::npos == colon) ? string() : spec.substr(0, colon);
+        if (roi.name.empty() || (string::npos != roi.name.find_first_of(",\"\\")) ||
+            !prv_parse_float_list(spec.substr(colon + 1), roi.points) || (roi.points.size() < 6) || (roi.points.size() % 2))
+        {
+            cout << "ERROR: roi \"" << spec.c_str() << "\" is not [name]:[x],[y],... with at least 3 points" << endl;
+            return -1;
+        }
+        options.rois.push_back(roi);
     }
 
-    /* Refresh custom enhancement parameters */
-    modified = false;
-    ret = argparse_get_enhancement_params(&enhancement_params, &modified);
-    if (DIRP_SUCCESS != ret)
+    string percentiles = args["percentiles"] ? args["percentiles"].as<string>() : string("5,50,95");
+    if ("none" != percentiles)
     {
-        cout << "ERROR: call argparse_get_enhancement_params failed" << endl;
-        goto ERR_ISP_CONFIG_RET;
+        if (!prv_parse_float_list(percentiles, options.percentiles))
+        {
+            cout << "ERROR: percentile format is not float" << endl;
+            return -1;
+        }
+        for (float percentile : options.percentiles)
+        {
+            if ((percentile < 0) || (percentile > 100))
+            {
+                cout << "ERROR: percentile " << percentile << " is not in [0,100]" << endl;
+                return -1;
+            }
+        }
+        sort(options.percentiles.begin(), options.percentiles.end());
+    }
+
+    options.hist_bins = 0;
+    if (args["histogram"])
+    {
+        vector<float> histogram;
+        if (!prv_parse_float_list(args["histogram"].as<string>(), histogram) || (3 != histogram.size()) ||
+            (histogram[0] < 1) || !(histogram[2] > histogram[1]))
+        {
+            cout << "ERROR: histogram arguments are not [bins],[low],[high] with high above low" << endl;
+            return -1;
+        }
+        options.hist_bins = (int32_t)histogram[0];
+        options.hist_low  = histogram[1];
+        options.hist_high = histogram[2];
+    }
+
+    return DIRP_SUCCESS;
+}
+
+/* Parse all conversion options once, so workers only read the resulting const structure */
+int32_t argparse_get_conversion_config(conversion_config_t *config)
+{
+    int32_t ret = DIRP_SUCCESS;
+
+    config->action_type     = argparse_get_action_type();
+    config->source_dir      = argparse_get_source_path();
+    config->output_prefix   = argparse_get_output_path();
+    config->tiff_output     = argparse_is_tiff_output();
+    config->mirror_output   = argparse_is_mirror_output();
+    config->mmap_input      = argparse_is_mmap_input();
+    config->measure_format  = argparse_get_measure_format();
+    config->strech_only     = argparse_is_strech_only();
+    config->pseudo_color    = argparse_get_pseudo_color(&config->pseudo_color_modified);
+
+    if (config->tiff_output && (dirp_action_type_measure != config->action_type))
+    {
+        cout << "ERROR: tiff output is only supported by action measure" << endl;
+        return -1;
+    }
+
+    ret = argparse_get_measurement_params(config);
+    if (DIRP_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    ret = argparse_get_enhancement_params(config);
+    if (DIRP_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    ret = argparse_get_isotherm_params(&config->isotherm);
+    if (DIRP_SUCCESS != ret)
+    {
+        cout << "ERROR: call argparse_get_isotherm_params failed" << endl;
+        return ret;
+    }
+
+    ret = argparse_get_color_bar_params(&config->color_bar);
+    if (DIRP_SUCCESS != ret)
+    {
+        cout << "ERROR: call argparse_get_color_bar_params failed" << endl;
+        return ret;
+    }
+
+    ret = argparse_get_stats_options(config);
+    if (DIRP_SUCCESS != ret)
+    {
+        cout << "ERROR: call argparse_get_stats_options failed" << endl;
+        return ret;
+    }
+
+    return DIRP_SUCCESS;
+}
+
+int32_t prv_rjpeg_info_print(DIRP_HANDLE dirp_handle)
+{
+    int32_t ret = DIRP_SUCCESS;
+    dirp_rjpeg_version_t rjpeg_version = {0};
+    dirp_resolution_t rjpeg_resolution = {0};
+
+    ret = dirp_get_rjpeg_version(dirp_handle, &rjpeg_version);
+    if (DIRP_SUCCESS != ret)
+    {
+        LOG_ERROR("ERROR: call dirp_get_rjpeg_version failed");
+        goto ERR_RJPEG_INFO_PRINT_RET;
     }
-    if (modified)
+    LOG_DEBUG("R-JPEG version information" << "\n"
+              "    R-JPEG version : 0x" << hex << rjpeg_version.rjpeg  << dec << "\n"
+              "    header version : 0x" << hex << rjpeg_version.header << dec << "\n"
+              " curve LUT version : 0x" << hex << rjpeg_version.curve  << dec);
+
+    ret = dirp_get_rjpeg_resolution(dirp_handle, &rjpeg_resolution);
+    if (DIRP_SUCCESS != ret)
+    {
+        LOG_ERROR("ERROR: call dirp_get_rjpeg_version failed");
+        goto ERR_RJPEG_INFO_PRINT_RET;
+    }
+    LOG_DEBUG("R-JPEG resolution size" << "\n"
+              "      image  width : " << rjpeg_resolution.width  << "\n"
+              "      image height : " << rjpeg_resolution.height);
+
+ERR_RJPEG_INFO_PRINT_RET:
+    return ret;
+}
+
+int32_t prv_isp_config(DIRP_HANDLE dirp_handle, const conversion_config_t &config)
+{
+    int32_t ret = DIRP_SUCCESS;
+    dirp_enhancement_params_t enhancement_params = {0};
+    dirp_pseudo_color_e pseudo_color_old = DIRP_PSEUDO_COLOR_IRONRED;
+
+    /* Set pseudo color type */
+    if (config.pseudo_color_modified)
+    {
+        ret = dirp_get_pseudo_color(dirp_handle, &pseudo_color_old);
+        if (DIRP_SUCCESS != ret)
+        {
+            LOG_ERROR("ERROR: call dirp_get_pseudo_color failed");
+            goto ERR_ISP_CONFIG_RET;
+        }
+        LOG_DEBUG("Change pseudo color from " << pseudo_color_old << " to " << config.pseudo_color);
+
+        ret = dirp_set_pseudo_color(dirp_handle, config.pseudo_color);
+        if (DIRP_SUCCESS != ret)
+        {
+            LOG_ERROR("ERROR: call dirp_set_pseudo_color failed");
+            goto ERR_ISP_CONFIG_RET;
+        }
+    }
+
+    /* Set isotherm parameters */
+    if (config.isotherm.enable)
+    {
+        dirp_isotherm_t isotherm = config.isotherm;
+        ret = dirp_set_isotherm(dirp_handle, &isotherm);
+        if (DIRP_SUCCESS != ret)
+        {
+            LOG_ERROR("ERROR: call dirp_set_isotherm failed");
+            goto ERR_ISP_CONFIG_RET;
+        }
+    }
+
+    /* Set color bar parameters */
+    if (config.color_bar.manual_enable)
+    {
+        dirp_color_bar_t color_bar = config.color_bar;
+        ret = dirp_set_color_bar(dirp_handle, &color_bar);
+        if (DIRP_SUCCESS != ret)
+        {
+            LOG_ERROR("ERROR: call dirp_set_color_bar failed");
+            goto ERR_ISP_CONFIG_RET;
+        }
+    }
+
+    /* Set custom enhancement parameters */
+    if (config.brightness_modified)
     {
-        /* Set custom enhancement parameters */
+        ret = dirp_get_enhancement_params(dirp_handle, &enhancement_params);
+        if (DIRP_SUCCESS != ret)
+        {
+            LOG_ERROR("ERROR: call dirp_get_enhancement_params failed");
+            goto ERR_ISP_CONFIG_RET;
+        }
+        LOG_DEBUG("Change brightness from " << enhancement_params.brightness << " to " << config.brightness);
+        enhancement_params.brightness = config.brightness;
+
         ret = dirp_set_enhancement_params(dirp_handle, &enhancement_params);
         if (DIRP_SUCCESS != ret)
         {
-            cout << "ERROR: call dirp_set_enhancement_params failed" << endl;
+            LOG_ERROR("ERROR: call dirp_set_enhancement_params failed");
             goto ERR_ISP_CONFIG_RET;
         }
     }
@@ -631,267 +1170,1277 @@ ERR_ISP_CONFIG_RET:
     return ret;
 }
 
-int32_t prv_measurement_config(DIRP_HANDLE dirp_handle)
+int32_t prv_measurement_config(DIRP_HANDLE dirp_handle, const conversion_config_t &config, dirp_lock_scope_e lock_scope)
 {
     int32_t ret = DIRP_SUCCESS;
-    bool modified = false;
+    dirp_measurement_params_t measurement_params = {0};
+
+    if (!(config.distance_modified || config.humidity_modified || config.emissivity_modified || config.reflection_modified))
+    {
+        return DIRP_SUCCESS;
+    }
 
     /* Get original measurement parameters */
-    dirp_measurement_params_t measurement_params = {0};
     ret = dirp_get_measurement_params(dirp_handle, &measurement_params);
     if (DIRP_SUCCESS != ret)
     {
-        cout << "ERROR: call dirp_get_measurement_params failed" << endl;
+        LOG_ERROR("ERROR: call dirp_get_measurement_params failed");
         goto ERR_MEASUREMENT_CONFIG_RET;
     }
 
     /* Refresh custom measurement parameters */
-    ret = argparse_get_measurement_params(&measurement_params, &modified);
+    if (config.distance_modified)
+    {
+        LOG_DEBUG("Change distance from " << measurement_params.distance << " to " << config.measurement_params.distance);
+        measurement_params.distance = config.measurement_params.distance;
+    }
+    if (config.humidity_modified)
+    {
+        LOG_DEBUG("Change humidity from " << measurement_params.humidity << " to " << config.measurement_params.humidity);
+        measurement_params.humidity = config.measurement_params.humidity;
+    }
+    if (config.emissivity_modified)
+    {
+        LOG_DEBUG("Change emissivity from " << measurement_params.emissivity << " to " << config.measurement_params.emissivity);
+        measurement_params.emissivity = config.measurement_params.emissivity;
+    }
+    if (config.reflection_modified)
+    {
+        LOG_DEBUG("Change reflection from " << measurement_params.reflection << " to " << config.measurement_params.reflection);
+        measurement_params.reflection = config.measurement_params.reflection;
+    }
+
+    /* Set custom measurement parameters */
+    {
+        dirp_vendor_lock lock(lock_scope, DIRP_LOCK_CALLS);
+        ret = dirp_set_measurement_params(dirp_handle, &measurement_params);
+    }
+    if (DIRP_SUCCESS != ret)
+    {
+        LOG_ERROR("ERROR: call dirp_set_measurement_params failed");
+        goto ERR_MEASUREMENT_CONFIG_RET;
+    }
+
+ERR_MEASUREMENT_CONFIG_RET:
+    return ret;
+}
+
+int32_t prv_get_rjpeg_output_size(const conversion_config_t &config, const dirp_resolution_t *resolution)
+{
+    int32_t image_width     = resolution->width;
+    int32_t image_height    = resolution->height;
+    int32_t image_size      = 0;
+
+    dirp_measure_format_e   measure_format  = config.measure_format;
+    bool                    strech_only     = config.strech_only;
+
+    switch (config.action_type)
+    {
+        case dirp_action_type_extract:
+            image_size = image_width * image_height * sizeof(uint16_t);
+            break;
+        case dirp_action_type_measure:
+            /* FLOAT16 is packed from the FLOAT32 image after the measurement */
+            if ((dirp_measure_format_float32 == measure_format) || (dirp_measure_format_float16 == measure_format))
+            {
+                image_size = image_width * image_height * sizeof(float);
+            }
+            else
+            {
+                image_size = image_width * image_height * sizeof(int16_t);
+            }
+            break;
+        case dirp_action_type_process:
+            if (strech_only)
+            {
+                image_size = image_width * image_height * sizeof(float);
+            }
+            else
+            {
+                image_size = image_width * image_height * 3 * sizeof(uint8_t);
+            }
+            break;
+        case dirp_action_type_stats:
+            image_size = image_width * image_height * sizeof(float);
+            break;
+        default:
+            break;
+    }
+
+    return image_size;
+}
+
+int32_t prv_action_compute(DIRP_HANDLE dirp_handle, const conversion_config_t &config, dirp_lock_scope_e lock_scope, buffer_pool &buffers, vector<uint8_t> &raw_out)
+{
+    int32_t ret = DIRP_SUCCESS;
+    int32_t out_size = 0;
+    dirp_resolution_t rjpeg_resolution = {0};
+    dirp_measure_format_e measure_format = config.measure_format;
+    bool strech_only = config.strech_only;
+    dirp_action_type_e action_type = config.action_type;
+
+    LOG_DEBUG("Run action " << (int)action_type);
+
+    ret = dirp_get_rjpeg_resolution(dirp_handle, &rjpeg_resolution);
+    if (DIRP_SUCCESS != ret)
+    {
+        LOG_ERROR("ERROR: call dirp_get_rjpeg_version failed");
+        goto ERR_ACT_RET;
+    }
+
+    out_size = prv_get_rjpeg_output_size(config, &rjpeg_resolution);
+    if (0 == out_size)
+    {
+        LOG_ERROR("ERROR: get zero raw size");
+        ret = -1;
+        goto ERR_ACT_RET;
+    }
+
+    buffers.acquire(out_size, raw_out);
+
+    switch(action_type)
+    {
+        case dirp_action_type_extract:
+        {
+            TRACE_SCOPE("dirp_get_original_raw");
+            ret = dirp_get_original_raw(dirp_handle, (uint16_t *)raw_out.data(), out_size);
+            break;
+        }
+        case dirp_action_type_measure:
+            if ((dirp_measure_format_float32 == measure_format) || (dirp_measure_format_float16 == measure_format))
+            {
+                TRACE_SCOPE("dirp_measure_ex");
+                dirp_vendor_lock lock(lock_scope, DIRP_LOCK_CALLS);
+                ret = dirp_measure_ex(dirp_handle, (float *)raw_out.data(), out_size);
+            }
+            else
+            {
+                TRACE_SCOPE("dirp_measure");
+                dirp_vendor_lock lock(lock_scope, DIRP_LOCK_CALLS);
+                ret = dirp_measure(dirp_handle, (int16_t *)raw_out.data(), out_size);
+            }
+            break;
+        case dirp_action_type_process:
+            if (strech_only)
+            {
+                TRACE_SCOPE("dirp_process_strech");
+                ret = dirp_process_strech(dirp_handle, (float *)raw_out.data(), out_size);
+            }
+            else
+            {
+                TRACE_SCOPE("dirp_process");
+                ret = dirp_process(dirp_handle, (uint8_t *)raw_out.data(), out_size);
+            }
+            break;
+        case dirp_action_type_stats:
+        {
+            TRACE_SCOPE("dirp_measure_ex");
+            dirp_vendor_lock lock(lock_scope, DIRP_LOCK_CALLS);
+            ret = dirp_measure_ex(dirp_handle, (float *)raw_out.data(), out_size);
+            break;
+        }
+        default:
+            break;
+    }
     if (DIRP_SUCCESS != ret)
     {
-        cout << "ERROR: call argparse_get_measurement_params failed" << endl;
-        goto ERR_MEASUREMENT_CONFIG_RET;
+        LOG_ERROR("ERROR: call dirp_get_[original_raw/measure/proess] failed");
+        goto ERR_ACT_RET;
+    }
+
+    if ((dirp_action_type_measure == action_type) && (dirp_measure_format_float16 == measure_format))
+    {
+        TRACE_SCOPE("float16 pack");
+        size_t pixel_count = (size_t)rjpeg_resolution.width * rjpeg_resolution.height;
+        vector<uint8_t> half_out;
+        buffers.acquire(pixel_count * sizeof(uint16_t), half_out);
+        temperature_pack::to_float16((const float *)raw_out.data(), pixel_count, (uint16_t *)half_out.data());
+        raw_out.swap(half_out);
+        buffers.release(half_out);
+    }
+
+    if ((dirp_action_type_process == action_type) && (false == config.color_bar.manual_enable))
+    {
+        dirp_color_bar_t color_bar_adaptive = {0};
+        ret = dirp_get_color_bar_adaptive_params(dirp_handle, &color_bar_adaptive);
+        if (DIRP_SUCCESS == ret)
+        {
+            LOG_DEBUG("Corlor bar adaptive range is [" << color_bar_adaptive.low << "," << color_bar_adaptive.high << "]");
+        }
+    }
+
+ERR_ACT_RET:
+    return ret;
+}
+
+/*
+ * index  : [output]_[number].raw
+ * mirror : [output]/[source path relative to the source directory, extension replaced].raw
+ */
+string prv_get_output_file_path(const conversion_config_t &config, int32_t number, const string &rjpeg_file_path)
+{
+    const char *extension = config.tiff_output ? ".tiff" : ".raw";
+
+    if (!config.mirror_output)
+    {
+        return config.output_prefix + "_" + std::to_string(number) + extension;
+    }
+
+    string relative = rjpeg_file_path;
+    if (0 == relative.compare(0, config.source_dir.size(), config.source_dir))
+    {
+        relative.erase(0, config.source_dir.size());
+    }
+    relative.erase(0, relative.find_first_not_of("/\\"));
+
+    size_t dot   = relative.find_last_of('.');
+    size_t slash = relative.find_last_of("/\\");
+    if ((string::npos != dot) && ((string::npos == slash) || (dot > slash)))
+    {
+        relative.erase(dot);
+    }
+
+    return config.output_prefix + "/" + relative + extension;
+}
+
+/* Create the sub directories of a mirrored output path */
+void prv_output_dir_create(const conversion_config_t &config, const string &output_file_path)
+{
+    if (!config.mirror_output)
+    {
+        return;
+    }
+
+    for (size_t pos = output_file_path.find_first_of("/\\", 1); string::npos != pos; pos = output_file_path.find_first_of("/\\", pos + 1))
+    {
+        string dir = output_file_path.substr(0, pos);
+#ifdef _WIN32
+        _mkdir(dir.c_str());
+#else
+        mkdir(dir.c_str(), 0755);
+#endif
+    }
+}
+
+/* Element type, channel count and bytes per pixel of the output image */
+const char *prv_get_output_dtype(const conversion_config_t &config, int32_t *channels, int32_t *pixel_size)
+{
+    *channels = 1;
+    switch (config.action_type)
+    {
+        case dirp_action_type_extract:
+            *pixel_size = sizeof(uint16_t);
+            return "uint16";
+        case dirp_action_type_measure:
+            if (dirp_measure_format_float32 == config.measure_format)
+            {
+                *pixel_size = sizeof(float);
+                return "float32";
+            }
+            *pixel_size = sizeof(int16_t);
+            return (dirp_measure_format_float16 == config.measure_format) ? "float16" : "int16";
+        default:
+            if (config.strech_only)
+            {
+                *pixel_size = sizeof(float);
+                return "float32";
+            }
+            *channels   = 3;
+            *pixel_size = 3 * sizeof(uint8_t);
+            return "uint8";
+    }
+}
+
+int32_t prv_output_write(const string &output_file_path, const vector<uint8_t> &raw_out, const result_cache *cache)
+{
+    ofstream ofstream;
+
+    /* The old output may be a hard link to a cache entry, replace it instead of overwriting the entry */
+    if (cache)
+    {
+        remove(output_file_path.c_str());
+    }
+
+    ofstream.open(output_file_path.c_str(), ios::binary);
+    if (!ofstream.is_open())
+    {
+        LOG_ERROR("ERROR: create ofstream failed");
+        return -1;
+    }
+
+    ofstream.write((const char *)raw_out.data(), raw_out.size());
+    ofstream.close();
+    if (ofstream.fail())
+    {
+        LOG_ERROR("ERROR: write " << output_file_path.c_str() << " failed");
+        return -1;
+    }
+
+    LOG_INFO("Save image file as : " << output_file_path.c_str());
+
+    return DIRP_SUCCESS;
+}
+
+/* Write the output file, append the frame to the container of the run or add its statistics row to the report */
+int32_t prv_output_store(const run_context_t &context, const string &output_file_path, const vector<uint8_t> &raw_out,
+                         const frame_container::frame_t &frame, const string &rjpeg_file_path, uint64_t *frame_offset)
+{
+    TRACE_SCOPE("write");
+    if (context.stats)
+    {
+        context.stats->add(rjpeg_file_path, (const char *)raw_out.data(), raw_out.size());
+        LOG_INFO("Add statistics of " << rjpeg_file_path.c_str() << " to : " << output_file_path.c_str());
+        return DIRP_SUCCESS;
+    }
+
+    if (nullptr == context.container)
+    {
+        return prv_output_write(output_file_path, raw_out, context.cache);
+    }
+
+    *frame_offset = context.container->append(raw_out.data(), raw_out.size(), frame, rjpeg_file_path);
+    if (0 == *frame_offset)
+    {
+        LOG_ERROR("ERROR: write frame to container failed");
+        return -1;
+    }
+
+    LOG_INFO("Pack image into container at offset : " << *frame_offset);
+
+    return DIRP_SUCCESS;
+}
+
+/*
+ * Wrap the temperature image in raw_out, in the --measurefmt of the run, into a TIFF file image.
+ * The GPS IFD is copied from the EXIF APP1 segment of the R-JPEG, no JPEG decoding involved.
+ */
+int32_t prv_tiff_encode(DIRP_HANDLE dirp_handle, const conversion_config_t &config, const uint8_t *rjpeg_data, int32_t rjpeg_size,
+                        buffer_pool &buffers, vector<uint8_t> &raw_out)
+{
+    TRACE_SCOPE("tiff encode");
+    dirp_resolution_t rjpeg_resolution = {0};
+    int32_t ret = dirp_get_rjpeg_resolution(dirp_handle, &rjpeg_resolution);
+    if (DIRP_SUCCESS != ret)
+    {
+        LOG_ERROR("ERROR: call dirp_get_rjpeg_resolution failed");
+        return ret;
+    }
+
+    vector<tiff_entry_t> gps;
+    const uint8_t *exif = nullptr;
+    size_t exif_size = 0;
+    if (jpeg_exif_find(rjpeg_data, (size_t)rjpeg_size, &exif, &exif_size))
+    {
+        tiff_reader(exif, exif_size).read_gps_ifd(gps);
+    }
+    if (gps.empty())
+    {
+        LOG_WARNING("WARNING: no GPS information found in R-JPEG");
+    }
+
+    vector<uint8_t> tiff_out;
+    buffers.acquire(raw_out.size() + 4096, tiff_out);      /* TIFF header and GPS tags fit in 4 KB */
+    switch (config.measure_format)
+    {
+        case dirp_measure_format_int16:
+            tiff_writer::encode_int16_scaled((const int16_t *)raw_out.data(), rjpeg_resolution.width, rjpeg_resolution.height,
+                                             0.1, 0.0, gps, tiff_out);
+            break;
+        case dirp_measure_format_float16:
+            tiff_writer::encode_float16((const uint16_t *)raw_out.data(), rjpeg_resolution.width, rjpeg_resolution.height, gps, tiff_out);
+            break;
+        default:
+            tiff_writer::encode_float32((const float *)raw_out.data(), rjpeg_resolution.width, rjpeg_resolution.height, gps, tiff_out);
+            break;
+    }
+    raw_out.swap(tiff_out);
+    buffers.release(tiff_out);
+
+    return DIRP_SUCCESS;
+}
+
+/* Reduce the FLOAT32 temperature image in raw_out to its statistics report row, which replaces it */
+int32_t prv_stats_encode(DIRP_HANDLE dirp_handle, const conversion_config_t &config, vector<uint8_t> &raw_out)
+{
+    TRACE_SCOPE("stats");
+    dirp_resolution_t rjpeg_resolution = {0};
+    int32_t ret = dirp_get_rjpeg_resolution(dirp_handle, &rjpeg_resolution);
+    if (DIRP_SUCCESS != ret)
+    {
+        LOG_ERROR("ERROR: call dirp_get_rjpeg_resolution failed");
+        return ret;
+    }
+
+    temperature_stats stats(config.stats);
+    vector<stats_region_t> regions;
+    stats.compute((const float *)raw_out.data(), rjpeg_resolution.width, rjpeg_resolution.height, regions);
+
+    string row = temperature_stats::format(config.stats, rjpeg_resolution.width, rjpeg_resolution.height, regions);
+    raw_out.assign(row.begin(), row.end());       /* Keeps the capacity of the pooled buffer */
+
+    return DIRP_SUCCESS;
+}
+
+typedef function<void(int32_t number, const string &path, const string &next_path)> source_visit_t;
+
+/*
+ * Walk the source directory and pass every matching file to visit as soon as it is found.
+ * next_path is the file found lookahead files later, the one a worker is likely to load next,
+ * empty when lookahead is 0.
+ * Returns the number of files, or -1 when the source is not a directory.
+ */
+int32_t prv_source_walk(const string &source_dir, const string &extension, int32_t lookahead, const source_visit_t &visit)
+{
+    dir_walker walker(extension);
+    deque<string> window;
+    int32_t found_count = 0;
+    int32_t visit_count = 0;
+
+    bool walked = walker.walk(source_dir, [&](const string &path)
+    {
+        LOG_DEBUG("FILE [" << found_count << "] " << path.c_str());
+        found_count++;
+        batch_logger::instance().progress_found();
+        window.push_back(path);
+        if ((int32_t)window.size() > lookahead)
+        {
+            visit(visit_count++, window.front(), (lookahead > 0) ? window.back() : string());
+            window.pop_front();
+        }
+    });
+    if (!walked)
+    {
+        LOG_ERROR("ERROR: " << source_dir.c_str() << " is not a directory");
+        return -1;
+    }
+
+    for (; !window.empty(); window.pop_front())
+    {
+        visit(visit_count++, window.front(), string());
+    }
+
+    return found_count;
+}
+
+#ifdef __linux__
+static volatile sig_atomic_t s_watch_stop = 0;
+
+static void prv_watch_signal_handler(int signal_number)
+{
+    (void)signal_number;
+    s_watch_stop = 1;
+}
+#endif
+
+/*
+ * Pass every matching file of the source tree to visit once it has settled, first the files already
+ * there and then each new one as it lands, until SIGINT or SIGTERM.
+ * Returns the number of files, or -1 when the source can not be watched.
+ */
+int32_t prv_source_watch(const string &source_dir, const string &extension, int32_t settle_ms, const source_visit_t &visit)
+{
+#ifdef __linux__
+    dir_watcher watcher(extension, settle_ms);
+    int32_t found_count = 0;
+
+    if (!watcher.open(source_dir))
+    {
+        LOG_ERROR("ERROR: watch " << source_dir.c_str() << " failed : " << strerror(errno));
+        return -1;
+    }
+
+    signal(SIGINT,  prv_watch_signal_handler);
+    signal(SIGTERM, prv_watch_signal_handler);
+    LOG_INFO("Watch " << source_dir.c_str() << " and " << watcher.watch_count() - 1 << " sub directories, stop with Ctrl+C");
+
+    while (!s_watch_stop)
+    {
+        watcher.poll(200, [&](const string &path)
+        {
+            LOG_DEBUG("FILE [" << found_count << "] " << path.c_str());
+            found_count++;
+            batch_logger::instance().progress_found();
+            visit(found_count - 1, path, string());
+        });
+    }
+
+    if (watcher.overflow_count() > 0)
+    {
+        LOG_WARNING("WARNING: inotify queue overflowed " << watcher.overflow_count() << " times, the tree was scanned again");
+    }
+    if (watcher.pending_count() > 0)
+    {
+        LOG_WARNING("WARNING: " << watcher.pending_count() << " files were still being written and are left for the next run");
+    }
+
+    return found_count;
+#else
+    (void)extension;
+    (void)settle_ms;
+    (void)visit;
+    LOG_ERROR("ERROR: watching " << source_dir.c_str() << " needs inotify, it is only supported on Linux");
+    return -1;
+#endif
+}
+
+/* R-JPEG bytes of one file, either read into a pooled buffer or mapped read-only */
+typedef struct
+{
+    vector<uint8_t> buffer;
+    mapped_file     mapping;
+} rjpeg_input_t;
+
+static const uint8_t *prv_rjpeg_input_data(const rjpeg_input_t &input)
+{
+    return input.mapping.is_open() ? input.mapping.data() : input.buffer.data();
+}
+
+static int32_t prv_rjpeg_input_size(const rjpeg_input_t &input)
+{
+    return (int32_t)(input.mapping.is_open() ? input.mapping.size() : input.buffer.size());
+}
+
+static void prv_rjpeg_input_release(rjpeg_input_t &input, buffer_pool &buffers)
+{
+    buffers.release(input.buffer);
+    input.mapping.close();
+}
+
+/*
+ * Load one R-JPEG file. With --io mmap the file is mapped instead of copied, and
+ * next_file_path, the file this thread is likely to load next, is prefetched meanwhile.
+ */
+int32_t prv_rjpeg_file_load(const string &rjpeg_file_path, const string &next_file_path, const conversion_config_t &config,
+                            buffer_pool &buffers, rjpeg_input_t &rjpeg_input)
+{
+    TRACE_SCOPE("read");
+    int32_t ret = DIRP_SUCCESS;
+    ifstream fs_i_rjpeg;
+
+    if (config.mmap_input)
+    {
+        if (!next_file_path.empty())
+        {
+            mapped_file::prefetch(next_file_path.c_str());
+        }
+        if (!rjpeg_input.mapping.open(rjpeg_file_path.c_str()))
+        {
+            LOG_ERROR("ERROR: mmap " << rjpeg_file_path.c_str() << " failed");
+            return -1;
+        }
+        return DIRP_SUCCESS;
+    }
+
+    /* Load R-JPEG data to buffer */
+#ifdef _WIN32
+    struct _stat rjpeg_file_info;
+    ret = _stat(rjpeg_file_path.c_str(), &rjpeg_file_info);
+#else
+    struct stat rjpeg_file_info;
+    ret = stat(rjpeg_file_path.c_str(), &rjpeg_file_info);
+#endif
+    if (0 != ret)
+    {
+        LOG_ERROR("ERROR: stat " << rjpeg_file_path.c_str() << " failed");
+        return -1;
+    }
+    buffers.acquire((uint32_t)rjpeg_file_info.st_size, rjpeg_input.buffer);
+
+    fs_i_rjpeg.open(rjpeg_file_path.c_str(), ios::binary);
+    FSTREAM_OPEN_CHECK(fs_i_rjpeg , "rjpeg.jpg", ERR_FILE_OPEN);
+    fs_i_rjpeg.read((char *)rjpeg_input.buffer.data(), rjpeg_input.buffer.size());
+    fs_i_rjpeg.close();
+
+ERR_FILE_OPEN:
+    return ret;
+}
+
+int32_t prv_rjpeg_data_process(const uint8_t *rjpeg_data, int32_t rjpeg_size, const conversion_config_t &config, buffer_pool &buffers, vector<uint8_t> &raw_out)
+{
+    int32_t ret = DIRP_SUCCESS;
+    DIRP_HANDLE dirp_handle = nullptr;
+    dirp_action_type_e action_type = config.action_type;
+    dirp_lock_scope_e lock_scope = dirp_vendor_lock::scope(rjpeg_data, (rjpeg_size > 0) ? (size_t)rjpeg_size : 0);
+    dirp_vendor_lock handle_lock(lock_scope, DIRP_LOCK_HANDLE);
+
+    /* Create a new DIRP handle */
+    {
+        TRACE_SCOPE("dirp_create_from_rjpeg");
+        dirp_vendor_lock lock(lock_scope, DIRP_LOCK_CALLS);
+        ret = dirp_create_from_rjpeg(rjpeg_data, rjpeg_size, &dirp_handle);
+    }
+    if (DIRP_SUCCESS != ret)
+    {
+        LOG_ERROR("ERROR: create R-JPEG dirp handle failed");
+        goto ERR_DIRP_RET;
+    }
+
+    /* Print R-JPEG information */
+    ret = prv_rjpeg_info_print(dirp_handle);
+    if (DIRP_SUCCESS != ret)
+    {
+        LOG_ERROR("ERROR: call prv_rjpeg_info_print failed");
+        goto ERR_DIRP_RET;
+    }
+
+    /* Configure ISP parameters */
+    if (dirp_action_type_process == action_type)
+    {
+        ret = prv_isp_config(dirp_handle, config);
+        if (DIRP_SUCCESS != ret)
+        {
+            LOG_ERROR("ERROR: call prv_isp_config failed");
+            goto ERR_DIRP_RET;
+        }
+    }
+
+    /* Configure measurement parameters */
+    if ((dirp_action_type_measure == action_type) || (dirp_action_type_process == action_type) || (dirp_action_type_stats == action_type))
+    {
+        ret = prv_measurement_config(dirp_handle, config, lock_scope);
+        if (DIRP_SUCCESS != ret)
+        {
+            LOG_ERROR("ERROR: call prv_isp_config failed");
+            goto ERR_DIRP_RET;
+        }
+    }
+
+    /* Run actions */
+    ret = prv_action_compute(dirp_handle, config, lock_scope, buffers, raw_out);
+    if (DIRP_SUCCESS != ret)
+    {
+        LOG_ERROR("ERROR: call prv_action_compute failed");
+        goto ERR_DIRP_RET;
+    }
+
+    /* Pack temperature into TIFF */
+    if ((dirp_action_type_measure == action_type) && config.tiff_output)
+    {
+        ret = prv_tiff_encode(dirp_handle, config, rjpeg_data, rjpeg_size, buffers, raw_out);
+        if (DIRP_SUCCESS != ret)
+        {
+            LOG_ERROR("ERROR: call prv_tiff_encode failed");
+            goto ERR_DIRP_RET;
+        }
+    }
+
+    /* Reduce temperature to statistics */
+    if (dirp_action_type_stats == action_type)
+    {
+        ret = prv_stats_encode(dirp_handle, config, raw_out);
+        if (DIRP_SUCCESS != ret)
+        {
+            LOG_ERROR("ERROR: call prv_stats_encode failed");
+            goto ERR_DIRP_RET;
+        }
+    }
+
+ERR_DIRP_RET:
+    /* Destroy DIRP handle */
+    if (dirp_handle)
+    {
+        TRACE_SCOPE("dirp_destroy");
+        int status = dirp_destroy(dirp_handle);
+        if (DIRP_SUCCESS != status)
+        {
+            LOG_ERROR("ERROR: destroy dirp handle failed");
+        }
+    }
+
+    return ret;
+}
+
+/* Link the cached result of an R-JPEG to its output path, cache_key is set for a later store on a miss */
+static bool prv_result_cache_lookup(result_cache *cache, const rjpeg_input_t &rjpeg_input, const string &output_file_path, string &cache_key)
+{
+    if (nullptr == cache)
+    {
+        return false;
+    }
+
+    TRACE_SCOPE("cache lookup");
+    cache_key = cache->key(prv_rjpeg_input_data(rjpeg_input), prv_rjpeg_input_size(rjpeg_input));
+    if (!cache->lookup(cache_key, output_file_path))
+    {
+        return false;
+    }
+
+    LOG_INFO("Reuse cached result as : " << output_file_path.c_str());
+    return true;
+}
+
+/*
+ * Check the journal of earlier runs for a source file. record is filled with the current
+ * size and time of the source, to be appended once this run has converted it.
+ */
+static bool prv_journal_finished(run_journal *journal, const string &rjpeg_file_path, const string &output_file_path, run_journal::record_t &record)
+{
+    record.status = -1;
+    record.source = rjpeg_file_path;
+    record.output = output_file_path;
+    if (nullptr == journal)
+    {
+        return false;
+    }
+
+    if (!run_journal::file_state(rjpeg_file_path, &record.size, &record.mtime_ns) ||
+        !journal->is_done(rjpeg_file_path, record.size, record.mtime_ns, output_file_path))
+    {
+        return false;
+    }
+
+    LOG_INFO("Skip R-JPEG file finished as : " << output_file_path.c_str());
+    batch_logger::instance().progress_done(false);
+    return true;
+}
+
+/* R-JPEG header resolution, the output is listed in the manifest and container without asking the SDK again */
+static void prv_rjpeg_input_resolution(const run_context_t &context, const rjpeg_input_t &rjpeg_input, dirp_resolution_t &resolution)
+{
+    rjpeg_probe_info_t probe_info;
+
+    resolution.width  = 0;
+    resolution.height = 0;
+    if ((context.manifest || context.container) &&
+        (DIRP_SUCCESS == rjpeg_probe::probe_buffer(prv_rjpeg_input_data(rjpeg_input), prv_rjpeg_input_size(rjpeg_input), &probe_info)))
+    {
+        resolution = probe_info.resolution;
+    }
+}
+
+/* Container index entry of one input : shape, element type and the GPS position of its R-JPEG */
+static void prv_container_frame(const run_context_t &context, const conversion_config_t &config, const rjpeg_input_t &rjpeg_input,
+                                int32_t number, const dirp_resolution_t &resolution, frame_container::frame_t &frame)
+{
+    int32_t channels = 0;
+    int32_t pixel_size = 0;
+    const uint8_t *exif = nullptr;
+    size_t exif_size = 0;
+    vector<tiff_entry_t> gps;
+
+    memset(&frame, 0, sizeof(frame));
+    if (nullptr == context.container)
+    {
+        return;
+    }
+
+    frame.number   = number;
+    frame.width    = resolution.width;
+    frame.height   = resolution.height;
+    frame.dtype    = frame_container::dtype_code(prv_get_output_dtype(config, &channels, &pixel_size));
+    frame.channels = channels;
+    if (jpeg_exif_find(prv_rjpeg_input_data(rjpeg_input), (size_t)prv_rjpeg_input_size(rjpeg_input), &exif, &exif_size) &&
+        tiff_reader(exif, exif_size).read_gps_ifd(gps))
+    {
+        frame.gps = tiff_gps_decimal(gps, &frame.latitude, &frame.longitude, &frame.altitude);
+    }
+}
+
+/* Output file of an input, or the container or statistics report all inputs are added to */
+static string prv_get_output_target(const conversion_config_t &config, const run_context_t &context, int32_t number, const string &rjpeg_file_path)
+{
+    if (context.stats)
+    {
+        return context.stats->path();
+    }
+
+    return context.container ? context.container->path() : prv_get_output_file_path(config, number, rjpeg_file_path);
+}
+
+/*
+ * Journal the result of one input, and list its output in the manifest once it is complete.
+ * frame_offset is where a packed frame starts in the container.
+ */
+static void prv_output_finish(const run_context_t &context, const conversion_config_t &config, run_journal::record_t &record,
+                              const dirp_resolution_t &resolution, uint64_t frame_offset, int32_t status)
+{
+    TRACE_SCOPE("journal and manifest");
+    batch_logger::instance().progress_done(DIRP_SUCCESS != status);
+
+    if (context.journal)
+    {
+        /* Output files are synced with the journal batch, the statistics report before each batch */
+        record.status = status;
+        context.journal->append(record, (DIRP_SUCCESS == status) && !context.stats && !context.container);
+    }
+
+    if (context.manifest && (DIRP_SUCCESS == status))
+    {
+        output_manifest::entry_t entry;
+        int32_t pixel_size = 0;
+        uint64_t output_size = 0;
+        int64_t output_mtime = 0;
+
+        entry.source = record.source;
+        entry.output = record.output;
+        entry.width  = resolution.width;
+        entry.height = resolution.height;
+        entry.dtype  = prv_get_output_dtype(config, &entry.channels, &pixel_size);
+        if (context.container)
+        {
+            entry.offset = frame_offset;
+        }
+        else
+        {
+            /* Pixels end the file, after the header of a TIFF */
+            run_journal::file_state(record.output, &output_size, &output_mtime);
+            entry.offset = output_size - std::min(output_size, (uint64_t)resolution.width * resolution.height * pixel_size);
+        }
+        context.manifest->add(entry);
+    }
+}
+
+int32_t prv_rjpeg_file_process(const string &rjpeg_file_path, const string &next_file_path, int32_t number,
+                               const conversion_config_t &config, buffer_pool &buffers, const run_context_t &context)
+{
+    TRACE_SCOPE_FILE("file", number);
+    int32_t ret = DIRP_SUCCESS;
+    rjpeg_input_t rjpeg_input;
+    vector<uint8_t> raw_out;
+    string output_file_path = prv_get_output_target(config, context, number, rjpeg_file_path);
+    string cache_key;
+    run_journal::record_t record;
+    dirp_resolution_t resolution = {0};
+    frame_container::frame_t frame;
+    uint64_t frame_offset = 0;
+    result_cache *cache = context.cache;
+
+    if (prv_journal_finished(context.journal, rjpeg_file_path, output_file_path, record))
+    {
+        return DIRP_SUCCESS;
+    }
+    LOG_INFO("Process R-JPEG file : " << rjpeg_file_path.c_str());
+    prv_output_dir_create(config, output_file_path);
+
+    ret = prv_rjpeg_file_load(rjpeg_file_path, next_file_path, config, buffers, rjpeg_input);
+    if (DIRP_SUCCESS == ret)
+    {
+        prv_rjpeg_input_resolution(context, rjpeg_input, resolution);
+    }
+    if ((DIRP_SUCCESS == ret) && prv_result_cache_lookup(cache, rjpeg_input, output_file_path, cache_key))
+    {
+        prv_rjpeg_input_release(rjpeg_input, buffers);
+        prv_output_finish(context, config, record, resolution, frame_offset, ret);
+        LOG_DEBUG("Test done with return code " << ret);
+        return ret;
+    }
+    if (DIRP_SUCCESS == ret)
+    {
+        ret = prv_rjpeg_data_process(prv_rjpeg_input_data(rjpeg_input), prv_rjpeg_input_size(rjpeg_input), config, buffers, raw_out);
+        prv_container_frame(context, config, rjpeg_input, number, resolution, frame);
+    }
+    if (DIRP_SUCCESS == ret)
+    {
+        ret = prv_output_store(context, output_file_path, raw_out, frame, rjpeg_file_path, &frame_offset);
     }
-    if (modified)
+    if ((DIRP_SUCCESS == ret) && cache)
     {
-        /* Set custom measurement parameters */
-        ret = dirp_set_measurement_params(dirp_handle, &measurement_params);
-        if (DIRP_SUCCESS != ret)
-        {
-            cout << "ERROR: call dirp_set_measurement_params failed" << endl;
-            goto ERR_MEASUREMENT_CONFIG_RET;
-        }
+        cache->store(cache_key, output_file_path);
     }
 
-ERR_MEASUREMENT_CONFIG_RET:
+    prv_rjpeg_input_release(rjpeg_input, buffers);
+    buffers.release(raw_out);
+    prv_output_finish(context, config, record, resolution, frame_offset, ret);
+
+    LOG_DEBUG("Test done with return code " << ret);
+
     return ret;
 }
 
-int32_t prv_get_rjpeg_output_size(const dirp_action_type_e action_type, const dirp_resolution_t *resolution)
+void prv_buffer_pool_report(const buffer_pool &buffers)
 {
-    int32_t image_width     = resolution->width;
-    int32_t image_height    = resolution->height;
-    int32_t image_size      = 0;
-
-    dirp_measure_format_e   measure_format  = argparse_get_measure_format();
-    bool                    strech_only     = argparse_is_strech_only();
+    cout << "Buffer pool : " << buffers.acquire_count() << " acquires, reuse hit rate " << 100.0 * buffers.hit_rate()
+         << " %, peak idle " << (buffers.peak_idle_bytes() >> 20) << " MB, peak RSS "
+         << (buffer_pool::peak_rss_bytes() >> 20) << " MB" << endl;
+}
 
-    switch (action_type)
+void prv_result_cache_report(result_cache *cache)
+{
+    if (nullptr == cache)
     {
-        case dirp_action_type_extract:
-            image_size = image_width * image_height * sizeof(uint16_t);
-            break;
-        case dirp_action_type_measure:
-            if (dirp_measure_format_float32 == measure_format)
-            {
-                image_size = image_width * image_height * sizeof(float);
-            }
-            else
-            {
-                image_size = image_width * image_height * sizeof(int16_t);
-            }
-            break;
-        case dirp_action_type_process:
-            if (strech_only)
-            {
-                image_size = image_width * image_height * sizeof(float);
-            }
-            else
-            {
-                image_size = image_width * image_height * 3 * sizeof(uint8_t);
-            }
-            break;
+        return;
     }
 
-    return image_size;
+    uint64_t cache_bytes = cache->trim();
+    cout << "Result cache : " << cache->hits() << " hits, " << cache->misses() << " misses, hit rate "
+         << 100.0 * cache->hit_rate() << " %, " << cache->stores() << " stored, " << cache->evictions() << " evicted, size "
+         << (cache_bytes >> 20) << " MB of " << (cache->cap_bytes() >> 20) << " MB" << endl;
 }
 
-int32_t prv_action_run(DIRP_HANDLE dirp_handle, int32_t number)
+void prv_journal_report(run_journal *journal)
 {
-    int32_t ret = DIRP_SUCCESS;
-    int32_t out_size = 0;
-    dirp_resolution_t rjpeg_resolution = {0};
-    void *raw_out = nullptr;
-    dirp_measure_format_e measure_format = argparse_get_measure_format();
-    bool strech_only = argparse_is_strech_only();
-    dirp_action_type_e action_type = argparse_get_action_type();
-    string output_file_prefix = argparse_get_output_path();
-    string output_file_path = output_file_prefix + "_" + std::to_string(number) + ".raw";
+    if (nullptr == journal)
+    {
+        return;
+    }
 
-    cout << "Run action " << (int)action_type << endl;
+    journal->close();
+    cout << "Journal : " << journal->skipped_count() << " finished files skipped, " << journal->appended_count()
+         << " files recorded in " << journal->sync_count() << " syncs";
+    if (journal->dropped_count() > 0)
+    {
+        cout << ", " << journal->dropped_count() << " records dropped on failed output syncs";
+    }
+    cout << endl;
+}
 
-    ofstream ofstream;
-    ofstream.open(output_file_path.c_str(), ios::binary);
-    if (!ofstream.is_open())
+int32_t prv_container_report(frame_container *container)
+{
+    if (nullptr == container)
     {
-        cout << "ERROR: create ofstream failed" << endl;
-        ret = -1;
-        goto ERR_ACT_RET;
+        return DIRP_SUCCESS;
     }
 
-    ret = dirp_get_rjpeg_resolution(dirp_handle, &rjpeg_resolution);
-    if (DIRP_SUCCESS != ret)
+    if (!container->close())
     {
-        cout << "ERROR: call dirp_get_rjpeg_version failed" << endl;
-        goto ERR_ACT_RET;
+        cout << "ERROR: write container " << container->path().c_str() << " failed" << endl;
+        return -1;
     }
+    cout << "Container : " << container->frame_count() << " frames, " << (container->frame_bytes() >> 20)
+         << " MB of pixels packed in " << container->path().c_str() << endl;
 
-    out_size = prv_get_rjpeg_output_size(action_type, &rjpeg_resolution);
-    if (0 == out_size)
+    return DIRP_SUCCESS;
+}
+
+void prv_stats_report(stats_report *stats)
+{
+    if (nullptr == stats)
     {
-        cout << "ERROR: get zero raw size" << endl;
-        ret = -1;
-        goto ERR_ACT_RET;
+        return;
     }
 
-    raw_out = (void *)malloc(out_size);
-    if (nullptr == raw_out)
+    stats->close();
+    cout << "Statistics : " << stats->count() << " rows written to " << stats->path().c_str() << endl;
+}
+
+void prv_manifest_report(output_manifest *manifest, const string &manifest_file)
+{
+    if (nullptr == manifest)
     {
-        cout << "ERROR: malloc memory failed" << endl;
-        ret = -1;
-        goto ERR_ACT_RET;
+        return;
     }
 
-    switch(action_type)
+    manifest->close();
+    cout << "Manifest : " << manifest->count() << " outputs listed in " << manifest_file.c_str() << endl;
+}
+
+int32_t prv_trace_report(const string &trace_file)
+{
+    if ("none" == trace_file)
     {
-        case dirp_action_type_extract:
-            ret = dirp_get_original_raw(dirp_handle, (uint16_t *)raw_out, out_size);
-            break;
-        case dirp_action_type_measure:
-            if (dirp_measure_format_float32 == measure_format)
-            {
-                ret = dirp_measure_ex(dirp_handle, (float *)raw_out, out_size);
-            }
-            else
-            {
-                ret = dirp_measure(dirp_handle, (int16_t *)raw_out, out_size);
-            }
-            break;
-        case dirp_action_type_process:
-            if (strech_only)
-            {
-                ret = dirp_process_strech(dirp_handle, (float *)raw_out, out_size);
-            }
-            else
-            {
-                ret = dirp_process(dirp_handle, (uint8_t *)raw_out, out_size);
-            }
-            break;
+        return DIRP_SUCCESS;
     }
-    if (DIRP_SUCCESS != ret)
+
+    trace_recorder &recorder = trace_recorder::instance();
+    if (!recorder.write(trace_file))
     {
-        cout << "ERROR: call dirp_get_[original_raw/measure/proess] failed" << endl;
-        goto ERR_ACT_RET;
+        cout << "ERROR: write trace file " << trace_file.c_str() << " failed" << endl;
+        return -1;
+    }
+
+    cout << "Trace : " << recorder.event_count() << " events written to " << trace_file.c_str() << endl;
+    if (recorder.dropped_count() > 0)
+    {
+        cout << "Trace : " << recorder.dropped_count() << " older events dropped, each thread keeps its last "
+             << TRACE_BUFFER_EVENTS << endl;
     }
-    ofstream.write((const char *)raw_out, out_size);
+    return DIRP_SUCCESS;
+}
+
+/*
+ * Everything besides the R-JPEG bytes that decides an output file : conversion options,
+ * SDK version and the cache layout version. Output paths and the input access method are left out.
+ */
+string prv_result_cache_salt(const conversion_config_t &config, const dirp_api_version_t &api_version)
+{
+    ostringstream salt;
+    const dirp_measurement_params_t &params = config.measurement_params;
+
+    salt << "dji_irp_omp result cache 1;api " << api_version.api << ";magic " << string(api_version.magic, strnlen(api_version.magic, sizeof(api_version.magic)))
+         << ";action " << (int)config.action_type << ";tiff " << config.tiff_output << ";measurefmt " << (int)config.measure_format;
+    salt.precision(9);
+    salt << ";distance " << config.distance_modified << "," << params.distance
+         << ";humidity " << config.humidity_modified << "," << params.humidity
+         << ";emissivity " << config.emissivity_modified << "," << params.emissivity
+         << ";reflection " << config.reflection_modified << "," << params.reflection
+         << ";strech " << config.strech_only
+         << ";palette " << config.pseudo_color_modified << "," << (int)config.pseudo_color
+         << ";brightness " << config.brightness_modified << "," << config.brightness
+         << ";isotherm " << config.isotherm.enable << "," << config.isotherm.high << "," << config.isotherm.low
+         << ";colorbar " << config.color_bar.manual_enable << "," << config.color_bar.high << "," << config.color_bar.low;
+
+    return salt.str();
+}
 
-    cout << "Save image file as : " << output_file_path.c_str() << endl;
+/*
+ * Digest of everything besides the R-JPEG that decides the outputs of a run, kept in the journal
+ * next to each output : the result cache salt, the output layout and the statistics options.
+ */
+string prv_journal_options(const conversion_config_t &config, const dirp_api_version_t &api_version)
+{
+    ostringstream options;
+    const stats_options_t &stats = config.stats;
 
-    if ((dirp_action_type_process == action_type) && (false == s_color_bar.manual_enable))
+    options << prv_result_cache_salt(config, api_version) << ";mirror " << config.mirror_output;
+    if (dirp_action_type_stats == config.action_type)
     {
-        dirp_color_bar_t color_bar_adaptive = {0};
-        ret = dirp_get_color_bar_adaptive_params(dirp_handle, &color_bar_adaptive);
-        if (DIRP_SUCCESS == ret)
+        options.precision(9);
+        options << ";json " << stats.json << ";histogram " << stats.hist_bins << "," << stats.hist_low << "," << stats.hist_high << ";percentiles";
+        for (float percentile : stats.percentiles)
+        {
+            options << " " << percentile;
+        }
+        for (const stats_roi_t &roi : stats.rois)
         {
-            cout << "Corlor bar adaptive range is [" << color_bar_adaptive.low << "," << color_bar_adaptive.high << "]" << endl;
+            options << ";roi " << roi.name;
+            for (float point : roi.points)
+            {
+                options << " " << point;
+            }
         }
     }
 
-ERR_ACT_RET:
-    if (ofstream.is_open())
-        ofstream.close();
+    string text = options.str();
+    char digest[24];
+    snprintf(digest, sizeof(digest), "%016llx", (unsigned long long)content_hash::hash64(text.data(), text.size(), 0));
+    return string(digest);
+}
 
-    if (raw_out)
-        free(raw_out);
+typedef struct
+{
+    int32_t         number;
+    string          path;
+    string          next_path;
+} pipeline_source_t;
 
-    return ret;
+typedef struct
+{
+    int32_t         number;
+    string          path;
+    rjpeg_input_t   input;
+    vector<uint8_t> data;
+    string          cache_key;
+    run_journal::record_t record;
+    dirp_resolution_t resolution;
+    frame_container::frame_t frame;
+    uint64_t        frame_offset;
+} pipeline_item_t;
+
+typedef struct
+{
+    const char     *name;
+    int32_t         threads;
+    atomic<int64_t> busy_ns;
+    atomic<int32_t> running;
+} pipeline_stage_t;
+
+static void prv_pipeline_stage_busy_add(pipeline_stage_t &stage, chrono::steady_clock::time_point start)
+{
+    stage.busy_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
 }
 
-#ifdef _WIN32
-static void prv_get_file_list(string path, string exd, vector<string>& files)
+/*
+ * Walk -> read -> decode/measure -> write pipeline.
+ * Every stage has its own thread count and hands items over through a bounded queue,
+ * so file I/O of one image overlaps SDK processing of another.
+ * The calling thread walks the source directory, readers start on the first file it finds.
+ */
+int32_t prv_pipeline_run(const string &source_dir, const string &extension, const conversion_config_t &config, buffer_pool &buffers,
+                         const run_context_t &context, int32_t reader_count, int32_t worker_count, int32_t writer_count, int32_t queue_depth)
 {
-    string pathName, exdName;
-    if (0 != strcmp(exd.c_str(), ""))
+    result_cache *cache = context.cache;
+    bounded_queue<pipeline_source_t> source_queue(queue_depth);
+    bounded_queue<pipeline_item_t> read_queue(queue_depth);
+    bounded_queue<pipeline_item_t> write_queue(queue_depth);
+
+    pipeline_stage_t stage_read;
+    pipeline_stage_t stage_process;
+    pipeline_stage_t stage_write;
+    pipeline_stage_t *stages[] = {&stage_read, &stage_process, &stage_write};
+
+    stage_read.name     = "read";
+    stage_read.threads  = reader_count;
+    stage_process.name  = "process";
+    stage_process.threads = worker_count;
+    stage_write.name    = "write";
+    stage_write.threads = writer_count;
+    for (pipeline_stage_t *stage : stages)
     {
-        exdName = "\\*." + exd;
+        stage->busy_ns  = 0;
+        stage->running  = stage->threads;
     }
-    else
+
+    atomic<int32_t> failed_count(0);
+    vector<thread> threads;
+
+    chrono::steady_clock::time_point time_start = chrono::steady_clock::now();
+
+    /* Buffer pool caches : readers first, then workers, then writers */
+    for (int32_t i=0; i<reader_count; i++)
     {
-        exdName = "\\*";
+        threads.push_back(thread([&, i]()
+        {
+            buffer_pool::bind_thread(i);
+            trace_recorder::instance().thread_name("reader", i);
+            pipeline_source_t source;
+            while (source_queue.pop(source))
+            {
+                TRACE_SCOPE_FILE("file read", source.number);
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                pipeline_item_t item;
+                item.number = source.number;
+                item.path   = source.path;
+                item.frame_offset = 0;
+                if (prv_journal_finished(context.journal, item.path, prv_get_output_target(config, context, item.number, item.path), item.record))
+                {
+                    prv_pipeline_stage_busy_add(stage_read, start);
+                    continue;
+                }
+                int32_t ret = prv_rjpeg_file_load(item.path, source.next_path, config, buffers, item.input);
+                prv_pipeline_stage_busy_add(stage_read, start);
+
+                if (DIRP_SUCCESS != ret)
+                {
+                    prv_rjpeg_input_release(item.input, buffers);
+                    prv_output_finish(context, config, item.record, item.resolution, item.frame_offset, ret);
+                    failed_count++;
+                    continue;
+                }
+                TRACE_SCOPE("queue wait");
+                read_queue.push(std::move(item));
+            }
+            if (1 == stage_read.running--)
+            {
+                read_queue.close();
+            }
+        }));
     }
 
-#ifndef PLATFORM_X64
-    int32_t hFile = 0;
-    struct _finddata_t fileinfo;
-    if ((hFile = _findfirst(pathName.assign(path).append(exdName).c_str(), &fileinfo)) != -1)
-#else
-    int64_t hFile = 0;
-    struct __finddata64_t fileinfo;
-    if ((hFile = _findfirst64(pathName.assign(path).append(exdName).c_str(), &fileinfo)) != -1)
-#endif
+    for (int32_t i=0; i<worker_count; i++)
     {
-        do
+        threads.push_back(thread([&, i]()
         {
-            //cout << fileinfo.name << endl;
-            if ((fileinfo.attrib & _A_SUBDIR))
+            buffer_pool::bind_thread(reader_count + i);
+            trace_recorder::instance().thread_name("worker", i);
+            pipeline_item_t item;
+            while (read_queue.pop(item))
             {
-                if (strcmp(fileinfo.name, ".") != 0 && strcmp(fileinfo.name, "..") != 0)
-                    prv_get_file_list(pathName.assign(path).append("\\").append(fileinfo.name), exd, files);
+                TRACE_SCOPE_FILE("file process", item.number);
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                pipeline_item_t output;
+                output.number = item.number;
+                output.path   = item.record.output;
+                output.record = item.record;
+                output.frame_offset = 0;
+                LOG_INFO("Process R-JPEG file : " << item.path.c_str());
+                prv_output_dir_create(config, output.path);
+                prv_rjpeg_input_resolution(context, item.input, output.resolution);
+                if (prv_result_cache_lookup(cache, item.input, output.path, output.cache_key))
+                {
+                    prv_rjpeg_input_release(item.input, buffers);
+                    prv_output_finish(context, config, output.record, output.resolution, output.frame_offset, DIRP_SUCCESS);
+                    prv_pipeline_stage_busy_add(stage_process, start);
+                    continue;
+                }
+                int32_t ret = prv_rjpeg_data_process(prv_rjpeg_input_data(item.input), prv_rjpeg_input_size(item.input),
+                                                     config, buffers, output.data);
+                prv_container_frame(context, config, item.input, item.number, output.resolution, output.frame);
+                prv_rjpeg_input_release(item.input, buffers);
+                prv_pipeline_stage_busy_add(stage_process, start);
+
+                if (DIRP_SUCCESS != ret)
+                {
+                    buffers.release(output.data);
+                    prv_output_finish(context, config, output.record, output.resolution, output.frame_offset, ret);
+                    failed_count++;
+                    continue;
+                }
+                TRACE_SCOPE("queue wait");
+                write_queue.push(std::move(output));
             }
-            else
+            if (1 == stage_process.running--)
             {
-                if (strcmp(fileinfo.name, ".") != 0 && strcmp(fileinfo.name, "..") != 0)
-                    files.push_back(pathName.assign(path).append("\\").append(fileinfo.name));
+                write_queue.close();
             }
-#ifndef PLATFORM_X64
-        } while (_findnext(hFile, &fileinfo) == 0);
-#else
-        } while (_findnext64(hFile, &fileinfo) == 0);
-#endif
-        _findclose(hFile);
+        }));
     }
-}
-#else
-static void prv_get_file_list(string path, string exd, vector<string>& files)
-{
-    DIR *dir;
-    struct dirent *ptr;
-    char base[1000];
 
-    if (nullptr == (dir = opendir(path.c_str())))
+    for (int32_t i=0; i<writer_count; i++)
     {
-        cout << "ERROR: " << path.c_str() << " is not a directory" << endl;
-        return;
+        threads.push_back(thread([&, i]()
+        {
+            buffer_pool::bind_thread(reader_count + worker_count + i);
+            trace_recorder::instance().thread_name("writer", i);
+            pipeline_item_t item;
+            while (write_queue.pop(item))
+            {
+                TRACE_SCOPE_FILE("file write", item.number);
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                int32_t ret = prv_output_store(context, item.path, item.data, item.frame, item.record.source, &item.frame_offset);
+                buffers.release(item.data);
+                if ((DIRP_SUCCESS == ret) && cache)
+                {
+                    cache->store(item.cache_key, item.path);
+                }
+                prv_output_finish(context, config, item.record, item.resolution, item.frame_offset, ret);
+                prv_pipeline_stage_busy_add(stage_write, start);
+
+                if (DIRP_SUCCESS != ret)
+                {
+                    failed_count++;
+                }
+            }
+        }));
     }
 
-    while (nullptr != (ptr = readdir(dir)))
+    /* Readers take files in turn, so a reader's next file is reader_count ahead */
+    int32_t files_count = 0;
     {
-        if ((0 == strcmp(ptr->d_name,".")) || (0 == strcmp(ptr->d_name,"..")))   //current dir OR parrent dir
+        TRACE_SCOPE("source walk");
+        files_count = prv_source_walk(source_dir, extension, reader_count,
+                                      [&](int32_t number, const string &path, const string &next_path)
         {
-            continue;
-        }
-        else if (8 == ptr->d_type)      //file
-        {
-            //cout << "d_name" << path.c_str() << ptr->d_name << endl;
-            files.push_back(string(path + ptr->d_name));
+            pipeline_source_t source;
+            source.number    = number;
+            source.path      = path;
+            source.next_path = next_path;
+            source_queue.push(std::move(source));
+        });
+    }
+    source_queue.close();
 
-        }
-        else if (10 == ptr->d_type)     ///link file
-        {
-            //cout << "d_name" << path.c_str() << ptr->d_name << endl;
-        }
-        else if (4 == ptr->d_type)      ///dir
-        {
-            memset(base, '\0', sizeof(base));
-            strcpy(base, path.c_str());
-            strcat(base, "/");
-            strcat(base, ptr->d_name);
-            prv_get_file_list(base, exd, files);
-        }
+    for (size_t i=0; i<threads.size(); i++)
+    {
+        threads[i].join();
+    }
+    batch_logger::instance().stop();
+
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - time_start).count();
+    if (files_count <= 0)
+    {
+        cout << "ERROR: Found none R-JPEG files" << endl;
+        return -1;
+    }
+
+    cout << "Processed " << files_count << " files in " << elapsed << " s ("
+         << (elapsed > 0 ? files_count / elapsed : 0) << " files/s), "
+         << failed_count.load() << " failed" << endl;
+    cout << "Pipeline stage summary" << endl;
+    for (pipeline_stage_t *stage : stages)
+    {
+        double busy = stage->busy_ns.load() / 1e9;
+        cout << "    " << stage->name << " : " << stage->threads << " threads, busy " << busy << " s, utilization "
+             << ((elapsed > 0) ? 100.0 * busy / (elapsed * stage->threads) : 0) << " %" << endl;
     }
-    closedir(dir);
+    cout << "    read -> process queue : capacity " << read_queue.capacity()
+         << ", depth max " << read_queue.depth_max() << ", depth mean " << read_queue.depth_mean()
+         << ", readers blocked " << read_queue.blocked_seconds() << " s" << endl;
+    cout << "    process -> write queue : capacity " << write_queue.capacity()
+         << ", depth max " << write_queue.depth_max() << ", depth mean " << write_queue.depth_mean()
+         << ", workers blocked " << write_queue.blocked_seconds() << " s" << endl;
+
+    return (0 == failed_count.load()) ? DIRP_SUCCESS : -1;
 }
-#endif
 
 int main(int argc, char *argv[])
 {
@@ -951,6 +2500,14 @@ int main(int argc, char *argv[])
     dirp_verbose_level_e verbose_level = argparse_get_verbose_level();
     dirp_set_verbose_level(verbose_level);
 
+    /* Record per stage timings of every thread */
+    string trace_file = argparse_get_trace_file();
+    if ("none" != trace_file)
+    {
+        trace_recorder::instance().start();
+        trace_recorder::instance().thread_name("main");
+    }
+
     /* Get DIRP API version number */
     ret = dirp_get_api_version(&api_version);
     {
@@ -963,121 +2520,247 @@ int main(int argc, char *argv[])
     cout << "DIRP API version number : 0x"  << hex << api_version.api << dec << endl;
     cout << "DIRP API magic version  : "    << api_version.magic << endl;
 
-    /* Get action type */
-    dirp_action_type_e action_type = argparse_get_action_type();
+    /* Parse conversion options once for all workers */
+    conversion_config_t conversion_config = {};
+    ret = argparse_get_conversion_config(&conversion_config);
+    if (DIRP_SUCCESS != ret)
+    {
+        cout << "ERROR: invalid conversion arguments" << endl;
+        return ret;
+    }
+    const conversion_config_t &config = conversion_config;
 
-    /* Generate file list */
+    /* Files are converted while the source directory is walked */
     cout << "R-JPEG source file directory : " << rjpeg_file_dir.c_str() << endl;
 
-    vector<string> rjpeg_files;
-    prv_get_file_list(rjpeg_file_dir, rjpeg_file_ext, rjpeg_files);
-
-    int32_t rjpeg_files_count = (int32_t)rjpeg_files.size();
-    if (rjpeg_files_count <= 0)
+    /* Create worker pool */
+    int32_t thread_count = argparse_get_thread_count();
+    if (thread_count <= 0)
     {
-        cout << "ERROR: Found none R-JPEG files" << endl;
+        cout << "ERROR: thread count must be a positive number or \"auto\"" << endl;
         return -1;
     }
 
-    /* Print all file names */
-    for (int32_t i=0; i<rjpeg_files_count; i++)
+    uint64_t pool_bytes = argparse_get_pool_bytes();
+
+    /* Results are keyed by input content and conversion options */
+    string cache_dir = argparse_get_cache_dir();
+    unique_ptr<result_cache> cache;
+    if ("none" != cache_dir)
     {
-        cout << "FILE [" << i << "] " << rjpeg_files[i].c_str() << endl;
+        cache.reset(new result_cache(cache_dir, argparse_get_cache_bytes(), prv_result_cache_salt(config, api_version)));
+        if (!cache->open())
+        {
+            cout << "ERROR: create cache directory " << cache_dir.c_str() << " failed" << endl;
+            return -1;
+        }
     }
 
-    #pragma omp parallel for num_threads(4)
-    for (int32_t i=0; i<rjpeg_files_count; i++)
+    /* Outputs of all inputs are packed into one file, which the cache can not link and a resumed run would overwrite */
+    string container_file = argparse_get_container_file();
+    unique_ptr<frame_container> container;
+    if ("none" != container_file)
     {
-        DIRP_HANDLE dirp_handle = nullptr;
-        string rjpeg_file_path = rjpeg_files[i];
-        ifstream fs_i_rjpeg;
-        cout << "Process R-JPEG file : " << rjpeg_file_path.c_str() << endl;
+        if (config.tiff_output || cache || argparse_is_resume())
+        {
+            cout << "ERROR: container output does not support tiff output, cache or resume" << endl;
+            return -1;
+        }
+        container.reset(new frame_container());
+        if (!container->open(container_file))
+        {
+            cout << "ERROR: create container " << container_file.c_str() << " failed" << endl;
+            return -1;
+        }
+    }
 
-    /* Load R-JPEG data to buffer */
-#ifdef _WIN32
-        struct _stat rjpeg_file_info;
-        _stat(rjpeg_file_path.c_str(), &rjpeg_file_info);
-#else
-        struct stat rjpeg_file_info;
-        stat(rjpeg_file_path.c_str(), &rjpeg_file_info);
-#endif
-        int32_t  rjpeg_size = (uint32_t)rjpeg_file_info.st_size;
-        uint8_t *rjpeg_data = (uint8_t *)malloc(rjpeg_size);
-        if (nullptr == rjpeg_data)
+    /* Statistics of all inputs go to one report, the output path */
+    unique_ptr<stats_report> stats;
+    if (dirp_action_type_stats == config.action_type)
+    {
+        if (cache || container)
         {
-            cout << "ERROR: malloc failed" << endl;
-            goto ERR_DIRP_RET;
+            cout << "ERROR: action stats does not support cache or container output" << endl;
+            return -1;
+        }
+        stats.reset(new stats_report());
+        if (!stats->open(config.output_prefix, config.stats, argparse_is_resume()))
+        {
+            cout << "ERROR: open statistics report " << config.output_prefix.c_str() << " failed" << endl;
+            return -1;
         }
+        cout << "Statistics report : " << config.output_prefix.c_str() << ", " << config.stats.rois.size() << " regions besides the frame" << endl;
+    }
+
+    /* A mirrored layout starts with the output directory itself */
+    if (!container && !stats)
+    {
+        prv_output_dir_create(config, config.output_prefix + "/");
+    }
 
-        fs_i_rjpeg.open(rjpeg_file_path.c_str(), ios::binary);
-        FSTREAM_OPEN_CHECK(fs_i_rjpeg , "rjpeg.jpg", ERR_FILE_OPEN);
-        fs_i_rjpeg.read((char *)rjpeg_data, rjpeg_size);
+    /* Index numbers follow the directory walk order, which changes between runs as files come and go */
+    if (argparse_is_resume() && !config.mirror_output && !stats)
+    {
+        cout << "ERROR: resume needs the mirror layout" << endl;
+        return -1;
+    }
 
-        /* Create a new DIRP handle */
-        ret = dirp_create_from_rjpeg(rjpeg_data, rjpeg_size, &dirp_handle);
-        if (DIRP_SUCCESS != ret)
+    /* Finished inputs are journaled, so an interrupted run can be resumed */
+    string journal_file = argparse_get_journal_file();
+    unique_ptr<run_journal> journal;
+    if ("none" != journal_file)
+    {
+        journal.reset(new run_journal());
+        if (!journal->open(journal_file, argparse_is_resume(), prv_journal_options(config, api_version)))
         {
-            cout << "ERROR: create R-JPEG dirp handle failed" << endl;
-            goto ERR_DIRP_RET;
+            cout << "ERROR: open journal " << journal_file.c_str() << " failed" << endl;
+            return -1;
+        }
+        if (stats)
+        {
+            journal->set_before_sync([&stats]() { return stats->flush() && run_journal::sync_file(stats->path()); });
         }
+        cout << "Journal file : " << journal_file.c_str() << ", " << journal->loaded_count() << " finished files loaded" << endl;
+    }
+    else if (argparse_is_resume())
+    {
+        cout << "ERROR: resume needs a journal" << endl;
+        return -1;
+    }
 
-        /* Print R-JPEG information */
-        ret = prv_rjpeg_info_print(dirp_handle);
-        if (DIRP_SUCCESS != ret)
+    /* Resumed runs add to the manifest of the runs before, a statistics run has no outputs to list */
+    string manifest_file = argparse_get_manifest_file();
+    unique_ptr<output_manifest> manifest;
+    if (("none" != manifest_file) && !stats)
+    {
+        manifest.reset(new output_manifest());
+        if (!manifest->open(manifest_file, argparse_is_resume()))
         {
-            cout << "ERROR: call prv_rjpeg_info_print failed" << endl;
-            goto ERR_DIRP_RET;
+            cout << "ERROR: open manifest " << manifest_file.c_str() << " failed" << endl;
+            return -1;
         }
+    }
+
+    run_context_t context = {cache.get(), journal.get(), manifest.get(), container.get(), stats.get()};
+
+    /* Workers queue their messages, which a logger thread writes in batches until the run is summarized */
+    batch_log_level_e log_level = batch_log_level_info;
+    bool log_quiet = false;
+    if (!batch_logger::parse_level(argparse_get_log_level(), &log_level, &log_quiet))
+    {
+        cout << "ERROR: log level must be quiet, error, warning, info or debug" << endl;
+        return -1;
+    }
+    batch_logger::instance().start(log_level, log_quiet);
 
-        /* Configure ISP parameters */
-        if (dirp_action_type_process == action_type)
+    if (argparse_is_pipeline())
+    {
+        int32_t reader_count = argparse_get_stage_count("readers", 2);
+        int32_t writer_count = argparse_get_stage_count("writers", 2);
+        int32_t queue_depth  = argparse_get_stage_count("queue", 16);
+        if ((reader_count <= 0) || (writer_count <= 0) || (queue_depth <= 0))
         {
-            ret = prv_isp_config(dirp_handle);
-            if (DIRP_SUCCESS != ret)
-            {
-                cout << "ERROR: call prv_isp_config failed" << endl;
-                goto ERR_DIRP_RET;
-            }
+            cout << "ERROR: readers, writers and queue must be positive numbers" << endl;
+            return -1;
         }
 
-        /* Configure measurement parameters */
-        if ((dirp_action_type_measure == action_type) || (dirp_action_type_process == action_type))
+        if (argparse_is_watch())
         {
-            ret = prv_measurement_config(dirp_handle);
-            if (DIRP_SUCCESS != ret)
-            {
-                cout << "ERROR: call prv_isp_config failed" << endl;
-                goto ERR_DIRP_RET;
-            }
+            cout << "ERROR: watch mode converts each file on the worker pool, it does not support pipeline" << endl;
+            return -1;
         }
 
-        /* Run actions */
-        ret = prv_action_run(dirp_handle, i);
-        if (DIRP_SUCCESS != ret)
+        buffer_pool buffers(reader_count + thread_count + writer_count, pool_bytes);
+        ret = prv_pipeline_run(rjpeg_file_dir, rjpeg_file_ext, config, buffers, context, reader_count, thread_count, writer_count, queue_depth);
+        prv_buffer_pool_report(buffers);
+        prv_result_cache_report(cache.get());
+        prv_journal_report(journal.get());
+        prv_manifest_report(manifest.get(), manifest_file);
+        prv_stats_report(stats.get());
+        if (DIRP_SUCCESS != prv_container_report(container.get()))
         {
-            cout << "ERROR: call prv_action_run failed" << endl;
-            goto ERR_DIRP_RET;
+            ret = -1;
+        }
+        if (DIRP_SUCCESS != prv_trace_report(trace_file))
+        {
+            ret = -1;
         }
 
-    ERR_DIRP_RET:
-        /* Destroy DIRP handle */
-        if (dirp_handle)
+        //system("pause");
+        return ret;
+    }
+
+    atomic<int32_t> failed_count(0);
+    chrono::steady_clock::time_point time_start = chrono::steady_clock::now();
+    int32_t rjpeg_files_count = 0;
+    uint64_t steal_count = 0;
+    buffer_pool buffers(thread_count, pool_bytes);
+    {
+        work_stealing_pool pool(thread_count);
+        LOG_INFO("Worker thread count : " << pool.size());
+
+        /*
+         * Which worker runs a queued file, and when, depends on steals, so instead of guessing a next file
+         * every file is prefetched as it is queued, at most SUBMIT_AHEAD_PER_THREAD files per worker ahead
+         */
+        source_visit_t visit = [&](int32_t i, const string &rjpeg_file_path, const string &)
         {
-            int status = dirp_destroy(dirp_handle);
-            if (DIRP_SUCCESS != status)
+            if (config.mmap_input)
             {
-                cout << "ERROR: destroy dirp handle failed" << endl;
+                mapped_file::prefetch(rjpeg_file_path.c_str());
             }
+            pool.submit([rjpeg_file_path, i, &config, &buffers, &context, &failed_count](int32_t worker)
+            {
+                buffer_pool::bind_thread(worker);
+                trace_recorder::instance().thread_name("worker", worker);
+                if (DIRP_SUCCESS != prv_rjpeg_file_process(rjpeg_file_path, string(), i, config, buffers, context))
+                {
+                    failed_count++;
+                }
+            });
+            /* Keep the queued work, and so the memory of a huge tree, bounded */
+            pool.wait_pending(thread_count * SUBMIT_AHEAD_PER_THREAD);
+        };
+
+        if (argparse_is_watch())
+        {
+            rjpeg_files_count = prv_source_watch(rjpeg_file_dir, rjpeg_file_ext, argparse_get_settle_ms(), visit);
+        }
+        else
+        {
+            TRACE_SCOPE("source walk");
+            rjpeg_files_count = prv_source_walk(rjpeg_file_dir, rjpeg_file_ext, 0, visit);
         }
 
-        cout << "Test done with return code " << ret << endl;
+        pool.wait_idle();
+        steal_count = pool.steal_count();
+    }
+    batch_logger::instance().stop();
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - time_start).count();
+    if ((rjpeg_files_count < 0) || ((0 == rjpeg_files_count) && !argparse_is_watch()))
+    {
+        cout << "ERROR: Found none R-JPEG files" << endl;
+        return -1;
+    }
 
-    ERR_FILE_OPEN:
-        if (fs_i_rjpeg.is_open())
-            fs_i_rjpeg.close();
+    cout << "Processed " << rjpeg_files_count << " files in " << elapsed << " s ("
+         << (elapsed > 0 ? rjpeg_files_count / elapsed : 0) << " files/s), "
+         << thread_count << " threads, " << steal_count << " steals, "
+         << failed_count.load() << " failed" << endl;
+    prv_buffer_pool_report(buffers);
+    prv_result_cache_report(cache.get());
+    prv_journal_report(journal.get());
+    prv_manifest_report(manifest.get(), manifest_file);
+    prv_stats_report(stats.get());
 
-        if (rjpeg_data)
-            free(rjpeg_data);
+    ret = (0 == failed_count.load()) ? DIRP_SUCCESS : -1;
+    if (DIRP_SUCCESS != prv_container_report(container.get()))
+    {
+        ret = -1;
+    }
+    if (DIRP_SUCCESS != prv_trace_report(trace_file))
+    {
+        ret = -1;
     }
 
     //system("pause");
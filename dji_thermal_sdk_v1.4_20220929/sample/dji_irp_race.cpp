@@ -0,0 +1,271 @@
+/*
+ * Concurrent DIRP handle reproducer for DJI Thermal SDK.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <string.h>
+
+#include "dirp_api.h"
+#include "argagg.hpp"
+#include "dir_walker.h"
+#include "dirp_vendor_lock.h"
+
+using namespace std;
+
+#define APP_VERSION "V1.4"
+
+static argagg::parser_results args;
+static argagg::parser argparser {{
+    {
+        "help", {"-h", "--help"},
+        "Print help and exit", 0,
+    },
+    {
+        "source", {"-s", "--source"},
+        "source R-JPEG directory, every file is decoded by every thread and checked against a decode on one thread", 1,
+    },
+    {
+        "extension", {"-e", "--extension"},
+        "source file extension or name pattern with * and ?" "\r\n"
+        "        " "(default=\"JPG\")", 1,
+    },
+    {
+        "threads", {"-t", "--threads"},
+        "threads creating, measuring and destroying handles side by side" "\r\n"
+        "        " "(default=\"4\")", 1,
+    },
+    {
+        "rounds", {"-n", "--rounds"},
+        "passes of every thread over the source files" "\r\n"
+        "        " "(default=\"10\")", 1,
+    },
+    {
+        "lock", {"--lock"},
+        "hold dirp_vendor_lock around the handles or SDK calls the R-JPEG needs" "\r\n"
+        "        " "on: lock the R-JPEGs that need it | off: call the SDK unlocked" "\r\n"
+        "        " "(default=\"on\")", 1,
+    },
+}};
+
+typedef struct
+{
+    string              path;
+    vector<uint8_t>     data;
+    dirp_lock_scope_e   lock_scope;
+    vector<uint8_t>     temp;                   /* Reference outputs of a decode on one thread */
+    vector<uint8_t>     image;
+} race_input_t;
+
+/*
+ * One handle through every SDK call the samples make, under the locks the R-JPEG needs when asked.
+ * temp receives the FLOAT32 temperature and image the pseudo color image.
+ */
+static int32_t prv_handle_run(const race_input_t &input, bool lock, vector<uint8_t> &temp, vector<uint8_t> &image)
+{
+    int32_t ret = DIRP_SUCCESS;
+    DIRP_HANDLE dirp_handle = nullptr;
+    dirp_resolution_t resolution = {0};
+    dirp_measurement_params_t params = {0};
+    dirp_lock_scope_e lock_scope = lock ? input.lock_scope : DIRP_LOCK_NONE;
+    dirp_vendor_lock handle_lock(lock_scope, DIRP_LOCK_HANDLE);
+    vector<uint8_t> out;
+    int32_t pixels = 0;
+
+    {
+        dirp_vendor_lock guard(lock_scope, DIRP_LOCK_CALLS);
+        ret = dirp_create_from_rjpeg(input.data.data(), (int32_t)input.data.size(), &dirp_handle);
+    }
+    if (DIRP_SUCCESS != ret)
+    {
+        goto ERR_HANDLE_RET;
+    }
+
+    ret = dirp_get_rjpeg_resolution(dirp_handle, &resolution);
+    if (DIRP_SUCCESS != ret)
+    {
+        goto ERR_HANDLE_RET;
+    }
+    pixels = resolution.width * resolution.height;
+    temp.resize((size_t)pixels * sizeof(float));
+    out.resize((size_t)pixels * sizeof(uint16_t));
+
+    ret = dirp_get_measurement_params(dirp_handle, &params);
+    if (DIRP_SUCCESS != ret)
+    {
+        goto ERR_HANDLE_RET;
+    }
+    params.distance = 10;
+    {
+        dirp_vendor_lock guard(lock_scope, DIRP_LOCK_CALLS);
+        ret = dirp_set_measurement_params(dirp_handle, &params);
+    }
+    if (DIRP_SUCCESS != ret)
+    {
+        goto ERR_HANDLE_RET;
+    }
+
+    {
+        dirp_vendor_lock guard(lock_scope, DIRP_LOCK_CALLS);
+        ret = dirp_measure_ex(dirp_handle, (float *)temp.data(), (int32_t)(pixels * sizeof(float)));
+    }
+    if (DIRP_SUCCESS == ret)
+    {
+        dirp_vendor_lock guard(lock_scope, DIRP_LOCK_CALLS);
+        ret = dirp_measure(dirp_handle, (int16_t *)out.data(), (int32_t)(pixels * sizeof(int16_t)));
+    }
+    if (DIRP_SUCCESS == ret)
+    {
+        ret = dirp_get_original_raw(dirp_handle, (uint16_t *)out.data(), (int32_t)(pixels * sizeof(uint16_t)));
+    }
+    if (DIRP_SUCCESS == ret)
+    {
+        image.resize((size_t)pixels * 3);
+        ret = dirp_process(dirp_handle, image.data(), pixels * 3);
+    }
+
+ERR_HANDLE_RET:
+    if (dirp_handle)
+    {
+        dirp_destroy(dirp_handle);
+    }
+
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    vector<race_input_t> inputs;
+    vector<thread> workers;
+    atomic<uint64_t> handles(0);
+    atomic<uint64_t> failed(0);
+    atomic<uint64_t> wrong(0);
+    size_t calls_lock_count = 0;
+    size_t handle_lock_count = 0;
+
+    try {
+        args = argparser.parse(argc, argv);
+    } catch (const std::exception& e) {
+        argagg::fmt_ostream fmt(cerr);
+        fmt << argparser << '\n'
+            << "Encountered exception while parsing arguments: " << e.what()
+            << '\n';
+        return -1;
+    }
+    if (args["help"] || !args["source"])
+    {
+        argagg::fmt_ostream fmt(cerr);
+        fmt << argv[0] << " " << APP_VERSION << "\n\n" << argparser;
+        return 0;
+    }
+
+    string source_dir = args["source"].as<string>();
+    string extension = args["extension"] ? args["extension"].as<string>() : string("JPG");
+    int32_t thread_count = args["threads"] ? args["threads"].as<int32_t>() : 4;
+    int32_t rounds = args["rounds"] ? args["rounds"].as<int32_t>() : 10;
+    bool lock = !args["lock"] || ("off" != args["lock"].as<string>());
+
+    dir_walker walker(extension);
+    bool walked = walker.walk(source_dir, [&](const string &path)
+    {
+        ifstream file(path.c_str(), ios::binary);
+        race_input_t input;
+        input.path = path;
+        input.data.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        input.lock_scope = dirp_vendor_lock::scope(input.data.data(), input.data.size());
+        calls_lock_count  += (DIRP_LOCK_CALLS == input.lock_scope) ? 1 : 0;
+        handle_lock_count += (DIRP_LOCK_HANDLE == input.lock_scope) ? 1 : 0;
+        inputs.push_back(move(input));
+    });
+    if (!walked || inputs.empty())
+    {
+        cout << "ERROR: no R-JPEG file found in " << source_dir << endl;
+        return -1;
+    }
+    if ((thread_count < 1) || (rounds < 1))
+    {
+        cout << "ERROR: threads and rounds must be at least 1" << endl;
+        return -1;
+    }
+
+    dirp_set_verbose_level(DIRP_VERBOSE_LEVEL_NONE);
+    cout << inputs.size() << " R-JPEG files, " << calls_lock_count << " lock their table calls, " << handle_lock_count
+         << " lock their whole handle, " << thread_count << " threads, lock " << (lock ? "on" : "off") << endl;
+
+    /* Reference outputs, decoded one at a time */
+    for (race_input_t &input : inputs)
+    {
+        if (DIRP_SUCCESS != prv_handle_run(input, true, input.temp, input.image))
+        {
+            cout << "ERROR: SDK call failed on " << input.path << endl;
+            return -1;
+        }
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int32_t i=0; i<thread_count; i++)
+    {
+        workers.emplace_back([&, i]()
+        {
+            vector<uint8_t> temp;
+            vector<uint8_t> image;
+            for (int32_t round=0; round<rounds; round++)
+            {
+                for (size_t k=0; k<inputs.size(); k++)
+                {
+                    /* Threads start at different files so each file meets every other one */
+                    const race_input_t &input = inputs[(k + (size_t)i * 7) % inputs.size()];
+                    if (DIRP_SUCCESS != prv_handle_run(input, lock, temp, image))
+                    {
+                        cout << "ERROR: SDK call failed on " << input.path << endl;
+                        failed++;
+                    }
+                    else if ((temp != input.temp) || (image != input.image))
+                    {
+                        cout << "ERROR: output differs from the one thread decode of " << input.path << endl;
+                        wrong++;
+                    }
+                    handles++;
+                }
+            }
+        });
+    }
+    for (thread &worker : workers)
+    {
+        worker.join();
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Ran " << handles.load() << " handles in " << seconds << " s without a crash, " << failed.load() << " failed, "
+         << wrong.load() << " wrong outputs" << endl;
+
+    return ((0 == failed.load()) && (0 == wrong.load())) ? 0 : -1;
+}
@@ -25,10 +25,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <iostream>
 #include <list>
+#include <new>
 #include <numeric>
 #include <algorithm>
+#include <vector>
 #include <time.h>
 
 #ifdef _WIN32
@@ -36,12 +39,20 @@
 #include <conio.h>
 #endif
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define CIRP_SSE2_ENABLE    (1)
+#include <emmintrin.h>
+#else
+#define CIRP_SSE2_ENABLE    (0)
+#endif
+
 #include "dirp_wrapper.h"
+#include "handle_registry.h"
+#include "jpeg_segment.h"
+#include "rjpeg_probe.h"
 
 using namespace std;
 
-#define CIRP_DEBUG_ENABLE   (0)
-
 #define DIRP_ADJ_PTR_INPUT(ptr)             do{ \
                                                 if (nullptr == ptr) \
                                                 { \
@@ -49,55 +60,133 @@ using namespace std;
                                                 } \
                                             } while(0)
 
-#if (CIRP_DEBUG_ENABLE)
-// TODO: Create a list to manage multiple instances
-static DIRPV_HANDLE __dirpv_handle = nullptr;
+/* One APP segment payload of the RAW16 image, pointing into the caller's R-JPEG buffer */
+typedef struct
+{
+    const uint8_t  *data;
+    size_t          size;
+} cirp_segment_t;
+
+/*
+ * DIRPV context of one R-JPEG.
+ * The R-JPEG buffer stays valid until destroy (see dirp_create_from_rjpeg), so only the
+ * segment locations are kept and RAW16 is unpacked straight into the caller's buffer.
+ */
+typedef struct
+{
+    rjpeg_probe_info_t          info;
+    vector<cirp_segment_t>      raw_segments;
+} cirp_context_t;
+
+typedef handle_registry<cirp_context_t> cirp_registry_t;
+
+/* DIRPV handles are registry handles, so instances are created and used from any thread without a global lock */
+static cirp_registry_t s_contexts;
+
+#define CIRP_ADJ_HANDLE_INPUT(h, context)   do{ \
+                                                context = s_contexts.get((cirp_registry_t::handle_t)h); \
+                                                if (nullptr == context) \
+                                                { \
+                                                    return DIRP_ERROR_INVALID_HANDLE; \
+                                                } \
+                                            } while(0)
+
+/*
+ * Copy count little endian RAW16 pixels from src to dst, shifted right by shift bits.
+ * The 14-bit families store raw values left aligned, the others are copied as is.
+ */
+static void prv_raw_unpack(const uint8_t *src, size_t count, uint16_t *dst, uint8_t shift)
+{
+    if (0 == shift)
+    {
+        memcpy(dst, src, count * sizeof(uint16_t));
+        return;
+    }
+
+    size_t i = 0;
+#if (CIRP_SSE2_ENABLE)
+    const __m128i bits = _mm_cvtsi32_si128(shift);
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(src + i * 2 + 16));
+        _mm_storeu_si128((__m128i *)(dst + i),     _mm_srl_epi16(lo, bits));
+        _mm_storeu_si128((__m128i *)(dst + i + 8), _mm_srl_epi16(hi, bits));
+    }
 #endif
+    for (; i < count; i++)
+    {
+        dst[i] = (uint16_t)(((uint32_t)src[i * 2] | ((uint32_t)src[i * 2 + 1] << 8)) >> shift);
+    }
+}
 
 int32_t create_from_rjpeg(const uint8_t *data, int32_t size, DIRPV_HANDLE *ph)
 {
     DIRP_ADJ_PTR_INPUT(data);
     DIRP_ADJ_PTR_INPUT(ph);
 
-    //TODO: create handle
-
-#if (CIRP_DEBUG_ENABLE)
-    if (nullptr != __dirpv_handle)
+    if (size <= 0)
     {
-        *ph = __dirpv_handle;
-        return DIRP_SUCCESS;
+        return DIRP_ERROR_SIZE;
     }
 
-    /* TODO: Parse R-JPEG APPx from EXIF metadata */
-    /* TODO: Create a new DIRPV context instance */
-    DIRPV_HANDLE __handle = malloc(sizeof(DIRPV_HANDLE));
-    if (nullptr == __handle)
+    cirp_registry_t::handle_t handle = 0;
+    cirp_context_t *context = s_contexts.create(&handle);
+    if (nullptr == context)
     {
         return DIRP_ERROR_MALLOC;
     }
 
+    /* Parse R-JPEG APPx : resolution, versions and where the RAW16 image is stored */
+    int32_t ret = rjpeg_probe::probe_buffer(data, (size_t)size, &context->info);
+    if (DIRP_SUCCESS != ret)
+    {
+        s_contexts.destroy(handle);
+        return ret;
+    }
+
+    size_t raw_size = 0;
+    bool   raw_odd  = false;
+    jpeg_segment_walk(data, (size_t)size, [&](uint8_t marker, const uint8_t *payload, size_t payload_size)
+    {
+        if (context->info.raw_marker == marker)
+        {
+            /* A pixel split over two segments never happens in practice, reject it */
+            if (payload_size & 1)
+            {
+                raw_odd = true;
+                return false;
+            }
+            cirp_segment_t segment = {payload, payload_size};
+            context->raw_segments.push_back(segment);
+            raw_size += payload_size;
+        }
+        return true;
+    });
+
+    size_t image_size = (size_t)context->info.resolution.width * context->info.resolution.height * sizeof(uint16_t);
+    if (raw_odd || (raw_size < image_size))
+    {
+        s_contexts.destroy(handle);
+        return DIRP_ERROR_INVALID_RAW;
+    }
+
     /* Output DIRPV handle */
-    *ph = __handle;
+    *ph = (DIRPV_HANDLE)handle;
 
     return DIRP_SUCCESS;
-#else
-    return DIRP_ERROR_UNSUPPORTED_FUNC;
-#endif
 }
 
 int32_t destroy(DIRPV_HANDLE h)
 {
     DIRP_ADJ_PTR_INPUT(h);
 
-    //TODO: destroy handle
-
-#if (CIRP_DEBUG_ENABLE)
-    free(h);
+    if (!s_contexts.destroy((cirp_registry_t::handle_t)h))
+    {
+        return DIRP_ERROR_INVALID_HANDLE;
+    }
 
     return DIRP_SUCCESS;
-#else
-    return DIRP_ERROR_UNSUPPORTED_FUNC;
-#endif
 }
 
 int32_t get_api_version(dirp_api_version_t *version)
@@ -114,9 +203,12 @@ int32_t get_rjpeg_version(DIRPV_HANDLE h, dirp_rjpeg_version_t *version)
     DIRP_ADJ_PTR_INPUT(h);
     DIRP_ADJ_PTR_INPUT(version);
 
-    //TODO: refer to the function definition in dirp_api.h
+    cirp_context_t *context = nullptr;
+    CIRP_ADJ_HANDLE_INPUT(h, context);
 
-    return DIRP_ERROR_UNSUPPORTED_FUNC;
+    *version = context->info.version;
+
+    return DIRP_SUCCESS;
 }
 
 int32_t get_rjpeg_resolution(DIRPV_HANDLE h, dirp_resolution_t *resolution)
@@ -124,9 +216,12 @@ int32_t get_rjpeg_resolution(DIRPV_HANDLE h, dirp_resolution_t *resolution)
     DIRP_ADJ_PTR_INPUT(h);
     DIRP_ADJ_PTR_INPUT(resolution);
 
-    //TODO: refer to the function definition in dirp_api.h
+    cirp_context_t *context = nullptr;
+    CIRP_ADJ_HANDLE_INPUT(h, context);
 
-    return DIRP_ERROR_UNSUPPORTED_FUNC;
+    *resolution = context->info.resolution;
+
+    return DIRP_SUCCESS;
 }
 
 int32_t get_original_raw(DIRPV_HANDLE h, uint16_t *raw_image, int32_t size)
@@ -134,9 +229,25 @@ int32_t get_original_raw(DIRPV_HANDLE h, uint16_t *raw_image, int32_t size)
     DIRP_ADJ_PTR_INPUT(h);
     DIRP_ADJ_PTR_INPUT(raw_image);
 
-    //TODO: refer to the function definition in dirp_api.h
+    cirp_context_t *context = nullptr;
+    CIRP_ADJ_HANDLE_INPUT(h, context);
 
-    return DIRP_ERROR_UNSUPPORTED_FUNC;
+    size_t pixels = (size_t)context->info.resolution.width * context->info.resolution.height;
+    if ((size < 0) || ((size_t)size < pixels * sizeof(uint16_t)))
+    {
+        return DIRP_ERROR_SIZE;
+    }
+
+    for (size_t i = 0; (i < context->raw_segments.size()) && (pixels > 0); i++)
+    {
+        size_t count = context->raw_segments[i].size / sizeof(uint16_t);
+        count = (count < pixels) ? count : pixels;
+        prv_raw_unpack(context->raw_segments[i].data, count, raw_image, context->info.raw_shift);
+        raw_image += count;
+        pixels    -= count;
+    }
+
+    return DIRP_SUCCESS;
 }
 
 int32_t process(DIRPV_HANDLE h, uint8_t *color_image, const int32_t size)
@@ -159,6 +270,12 @@ int32_t process_strech(DIRPV_HANDLE h, float *strech_image, int32_t size)
     return DIRP_ERROR_UNSUPPORTED_FUNC;
 }
 
+/*
+ * The RAW16 to temperature conversion of each camera family, including the ambient
+ * compensation applied by the measurement parameters, is not published.
+ * The XT S curve LUT in APP3 alone does not reproduce the SDK results, so measurement
+ * stays with the vendor libraries.
+ */
 int32_t measure(DIRPV_HANDLE h, int16_t *temp_image, int32_t size)
 {
     DIRP_ADJ_PTR_INPUT(h);
@@ -297,6 +414,16 @@ int32_t get_measurement_params(DIRPV_HANDLE h, dirp_measurement_params_t *measur
     return DIRP_ERROR_UNSUPPORTED_FUNC;
 }
 
+int32_t get_measurement_params_range(DIRPV_HANDLE h, dirp_measurement_params_range_t *params_range)
+{
+    DIRP_ADJ_PTR_INPUT(h);
+    DIRP_ADJ_PTR_INPUT(params_range);
+
+    //TODO: refer to the function definition in dirp_api.h
+
+    return DIRP_ERROR_UNSUPPORTED_FUNC;
+}
+
 void set_verbose_level(dirp_verbose_level_e level)
 {
     (void)level;
@@ -328,6 +455,7 @@ dllexport int32_t dirp_vendor_get_api(dirp_api_wrapper_t *api)
     api->get_enhancement_params         = get_enhancement_params;
     api->set_measurement_params         = set_measurement_params;
     api->get_measurement_params         = get_measurement_params;
+    api->get_measurement_params_range   = get_measurement_params_range;
     api->get_pseudo_color_lut           = get_pseudo_color_lut;
     api->set_verbose_level              = set_verbose_level;
 
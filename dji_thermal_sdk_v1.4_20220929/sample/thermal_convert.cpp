@@ -0,0 +1,382 @@
+/*
+ * In-process temperature conversion library for DJI Thermal SDK.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "thermal_convert.h"
+#include "work_stealing_pool.h"
+#include "jpeg_segment.h"
+#include "tiff_writer.h"
+#include "rjpeg_probe.h"
+#include "dirp_vendor_lock.h"
+
+using namespace std;
+
+#define TC_ADJ_PTR_INPUT(ptr)               do{ \
+                                                if (nullptr == ptr) \
+                                                { \
+                                                    return DIRP_ERROR_POINTER_NULL; \
+                                                } \
+                                            } while(0)
+
+static int32_t prv_file_load(const char *path, vector<uint8_t> &data)
+{
+    ifstream fs_i(path, ios::binary | ios::ate);
+    if (!fs_i.is_open())
+    {
+        return DIRP_ERROR_INVALID_PARAMS;
+    }
+
+    streamoff size = fs_i.tellg();
+    if ((size <= 0) || (size > INT32_MAX))
+    {
+        return DIRP_ERROR_SIZE;
+    }
+
+    data.resize((size_t)size);
+    fs_i.seekg(0, ios::beg);
+    fs_i.read((char *)data.data(), size);
+
+    return fs_i ? DIRP_SUCCESS : DIRP_ERROR_RJPEG_PARSE;
+}
+
+static int32_t prv_measurement_config(DIRP_HANDLE dirp_handle, const tc_measure_params_t *params, dirp_lock_scope_e lock_scope)
+{
+    int32_t ret = DIRP_SUCCESS;
+    dirp_measurement_params_t measurement_params = {0};
+
+    if ((nullptr == params) || (0 == params->flags))
+    {
+        return DIRP_SUCCESS;
+    }
+
+    ret = dirp_get_measurement_params(dirp_handle, &measurement_params);
+    if (DIRP_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    if (params->flags & TC_PARAM_DISTANCE)      measurement_params.distance     = params->distance;
+    if (params->flags & TC_PARAM_HUMIDITY)      measurement_params.humidity     = params->humidity;
+    if (params->flags & TC_PARAM_EMISSIVITY)    measurement_params.emissivity   = params->emissivity;
+    if (params->flags & TC_PARAM_REFLECTION)    measurement_params.reflection   = params->reflection;
+
+    dirp_vendor_lock lock(lock_scope, DIRP_LOCK_CALLS);
+    return dirp_set_measurement_params(dirp_handle, &measurement_params);
+}
+
+static int32_t prv_thread_count_adjust(int32_t threads, int32_t count)
+{
+    if (threads <= 0)
+    {
+        threads = work_stealing_pool::parse_thread_count("auto");
+    }
+    if (threads > count)
+    {
+        threads = (count > 0) ? count : 1;
+    }
+    return threads;
+}
+
+int32_t tc_get_api_version(void)
+{
+    return TC_API_VERSION;
+}
+
+int32_t tc_get_resolution(const uint8_t *data, int32_t size, int32_t *width, int32_t *height)
+{
+    TC_ADJ_PTR_INPUT(data);
+    TC_ADJ_PTR_INPUT(width);
+    TC_ADJ_PTR_INPUT(height);
+
+    DIRP_HANDLE dirp_handle = nullptr;
+    dirp_resolution_t resolution = {0};
+    dirp_lock_scope_e lock_scope = dirp_vendor_lock::scope(data, (size > 0) ? (size_t)size : 0);
+    dirp_vendor_lock handle_lock(lock_scope, DIRP_LOCK_HANDLE);
+    int32_t ret = DIRP_SUCCESS;
+
+    {
+        dirp_vendor_lock lock(lock_scope, DIRP_LOCK_CALLS);
+        ret = dirp_create_from_rjpeg(data, size, &dirp_handle);
+    }
+    if (DIRP_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    ret = dirp_get_rjpeg_resolution(dirp_handle, &resolution);
+    dirp_destroy(dirp_handle);
+
+    *width  = resolution.width;
+    *height = resolution.height;
+
+    return ret;
+}
+
+static void prv_probe_info_copy(const rjpeg_probe_info_t &probe_info, tc_probe_info_t *info)
+{
+    info->resolution = probe_info.resolution;
+    info->version    = probe_info.version;
+    memcpy(info->camera_model, probe_info.camera_model, sizeof(info->camera_model));
+}
+
+int32_t tc_probe_buffer(const uint8_t *data, int32_t size, tc_probe_info_t *info)
+{
+    TC_ADJ_PTR_INPUT(data);
+    TC_ADJ_PTR_INPUT(info);
+
+    rjpeg_probe_info_t probe_info;
+    int32_t ret = rjpeg_probe::probe_buffer(data, (size_t)size, &probe_info);
+    if (DIRP_SUCCESS == ret)
+    {
+        prv_probe_info_copy(probe_info, info);
+    }
+
+    return ret;
+}
+
+int32_t tc_probe_file(const char *path, tc_probe_info_t *info)
+{
+    TC_ADJ_PTR_INPUT(path);
+    TC_ADJ_PTR_INPUT(info);
+
+    rjpeg_probe_info_t probe_info;
+    int32_t ret = rjpeg_probe::probe_file(path, &probe_info);
+    if (DIRP_SUCCESS == ret)
+    {
+        prv_probe_info_copy(probe_info, info);
+    }
+
+    return ret;
+}
+
+int32_t tc_measure_buffer(const uint8_t *data, int32_t size, const tc_measure_params_t *params,
+                          float *temp_image, int32_t temp_size, int32_t *width, int32_t *height)
+{
+    TC_ADJ_PTR_INPUT(data);
+    TC_ADJ_PTR_INPUT(temp_image);
+
+    int32_t ret = DIRP_SUCCESS;
+    DIRP_HANDLE dirp_handle = nullptr;
+    dirp_resolution_t resolution = {0};
+    int32_t image_size = 0;
+
+    /* The library is called from several threads, only sub libraries with process wide state take turns */
+    dirp_lock_scope_e lock_scope = dirp_vendor_lock::scope(data, (size > 0) ? (size_t)size : 0);
+    dirp_vendor_lock handle_lock(lock_scope, DIRP_LOCK_HANDLE);
+
+    {
+        dirp_vendor_lock lock(lock_scope, DIRP_LOCK_CALLS);
+        ret = dirp_create_from_rjpeg(data, size, &dirp_handle);
+    }
+    if (DIRP_SUCCESS != ret)
+    {
+        goto ERR_MEASURE_RET;
+    }
+
+    ret = dirp_get_rjpeg_resolution(dirp_handle, &resolution);
+    if (DIRP_SUCCESS != ret)
+    {
+        goto ERR_MEASURE_RET;
+    }
+    if (width)  *width  = resolution.width;
+    if (height) *height = resolution.height;
+
+    image_size = resolution.width * resolution.height * (int32_t)sizeof(float);
+    if (temp_size < image_size)
+    {
+        ret = DIRP_ERROR_SIZE;
+        goto ERR_MEASURE_RET;
+    }
+
+    ret = prv_measurement_config(dirp_handle, params, lock_scope);
+    if (DIRP_SUCCESS != ret)
+    {
+        goto ERR_MEASURE_RET;
+    }
+
+    {
+        dirp_vendor_lock lock(lock_scope, DIRP_LOCK_CALLS);
+        ret = dirp_measure_ex(dirp_handle, temp_image, image_size);
+    }
+
+ERR_MEASURE_RET:
+    if (dirp_handle)
+    {
+        dirp_destroy(dirp_handle);
+    }
+
+    return ret;
+}
+
+int32_t tc_measure_file(const char *path, const tc_measure_params_t *params,
+                        float *temp_image, int32_t temp_size, int32_t *width, int32_t *height)
+{
+    TC_ADJ_PTR_INPUT(path);
+    TC_ADJ_PTR_INPUT(temp_image);
+
+    vector<uint8_t> data;
+    int32_t ret = prv_file_load(path, data);
+    if (DIRP_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    return tc_measure_buffer(data.data(), (int32_t)data.size(), params, temp_image, temp_size, width, height);
+}
+
+int32_t tc_measure_batch(const char *const *paths, int32_t count, const tc_measure_params_t *params,
+                         float *const *temp_images, int32_t temp_size,
+                         int32_t *widths, int32_t *heights, int32_t *results, int32_t threads)
+{
+    TC_ADJ_PTR_INPUT(paths);
+    TC_ADJ_PTR_INPUT(temp_images);
+
+    if (count < 0)
+    {
+        return DIRP_ERROR_INVALID_PARAMS;
+    }
+    threads = prv_thread_count_adjust(threads, count);
+
+    atomic<int32_t> failed_count(0);
+    {
+        work_stealing_pool pool(threads);
+
+        for (int32_t i=0; i<count; i++)
+        {
+            pool.submit([=, &failed_count](int32_t worker)
+            {
+                (void)worker;
+                int32_t ret = tc_measure_file(paths[i], params, temp_images[i], temp_size,
+                                              widths ? &widths[i] : nullptr, heights ? &heights[i] : nullptr);
+                if (results)
+                {
+                    results[i] = ret;
+                }
+                if (DIRP_SUCCESS != ret)
+                {
+                    failed_count++;
+                }
+            });
+        }
+
+        pool.wait_idle();
+    }
+
+    return failed_count.load();
+}
+
+int32_t tc_convert_file_to_tiff(const char *path, const char *tiff_path, const tc_measure_params_t *params)
+{
+    TC_ADJ_PTR_INPUT(path);
+    TC_ADJ_PTR_INPUT(tiff_path);
+
+    vector<uint8_t> data;
+    int32_t ret = prv_file_load(path, data);
+    if (DIRP_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    /* All supported cameras are 640x512, retry once with the reported size otherwise */
+    int32_t width = 640;
+    int32_t height = 512;
+    vector<float> temp_image;
+    for (int32_t retry=0; retry<2; retry++)
+    {
+        temp_image.resize((size_t)width * height);
+        ret = tc_measure_buffer(data.data(), (int32_t)data.size(), params, temp_image.data(),
+                                (int32_t)(temp_image.size() * sizeof(float)), &width, &height);
+        if (DIRP_ERROR_SIZE != ret)
+        {
+            break;
+        }
+    }
+    if (DIRP_SUCCESS != ret)
+    {
+        return ret;
+    }
+
+    vector<tiff_entry_t> gps;
+    const uint8_t *exif = nullptr;
+    size_t exif_size = 0;
+    if (jpeg_exif_find(data.data(), data.size(), &exif, &exif_size))
+    {
+        tiff_reader(exif, exif_size).read_gps_ifd(gps);
+    }
+
+    vector<uint8_t> tiff_out;
+    tiff_writer::encode_float32(temp_image.data(), width, height, gps, tiff_out);
+
+    ofstream fs_o(tiff_path, ios::binary);
+    if (!fs_o.is_open())
+    {
+        return DIRP_ERROR_INVALID_PARAMS;
+    }
+    fs_o.write((const char *)tiff_out.data(), tiff_out.size());
+
+    return fs_o ? DIRP_SUCCESS : DIRP_ERROR_SIZE;
+}
+
+int32_t tc_convert_batch_to_tiff(const char *const *paths, const char *const *tiff_paths, int32_t count,
+                                 const tc_measure_params_t *params, int32_t *results, int32_t threads)
+{
+    TC_ADJ_PTR_INPUT(paths);
+    TC_ADJ_PTR_INPUT(tiff_paths);
+
+    if (count < 0)
+    {
+        return DIRP_ERROR_INVALID_PARAMS;
+    }
+    threads = prv_thread_count_adjust(threads, count);
+
+    atomic<int32_t> failed_count(0);
+    {
+        work_stealing_pool pool(threads);
+
+        for (int32_t i=0; i<count; i++)
+        {
+            pool.submit([=, &failed_count](int32_t worker)
+            {
+                (void)worker;
+                int32_t ret = tc_convert_file_to_tiff(paths[i], tiff_paths[i], params);
+                if (results)
+                {
+                    results[i] = ret;
+                }
+                if (DIRP_SUCCESS != ret)
+                {
+                    failed_count++;
+                }
+            });
+        }
+
+        pool.wait_idle();
+    }
+
+    return failed_count.load();
+}
@@ -0,0 +1,178 @@
+/*
+ * In-process temperature conversion library for DJI Thermal SDK.
+ *
+ * @Copyright (c) 2020-2023 DJI. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#pragma once
+
+#ifndef _THERMAL_CONVERT_H_
+#define _THERMAL_CONVERT_H_
+
+#include "dirp_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TC_API_VERSION                          (0x0100)
+
+/**
+ * @brief   Flags of @ref tc_measure_params_t fields which override the values stored in the R-JPEG
+ */
+#define TC_PARAM_DISTANCE                       (1u << 0)
+#define TC_PARAM_HUMIDITY                       (1u << 1)
+#define TC_PARAM_EMISSIVITY                     (1u << 2)
+#define TC_PARAM_REFLECTION                     (1u << 3)
+
+/**
+ * @brief   Temperature measurement parameters.
+ *          Fields without their TC_PARAM_* bit in flags are left as stored in the R-JPEG.
+ *          Value ranges are described in @ref dirp_measurement_params_t.
+ */
+typedef struct
+{
+    uint32_t flags;                             /**< Bit mask of TC_PARAM_* */
+    float    distance;                          /**< The distance to the target in meters */
+    float    humidity;                          /**< The relative humidity of the environment in percent */
+    float    emissivity;                        /**< Emissivity of the target surface */
+    float    reflection;                        /**< Reflected temperature in Celsius */
+} tc_measure_params_t;
+
+/**
+ * @brief   R-JPEG header information returned by @ref tc_probe_file
+ */
+typedef struct
+{
+    dirp_resolution_t       resolution;         /**< Same value as @ref dirp_get_rjpeg_resolution */
+    dirp_rjpeg_version_t    version;            /**< Same value as @ref dirp_get_rjpeg_version */
+    char                    camera_model[64];   /**< Camera model from EXIF, empty string if absent */
+} tc_probe_info_t;
+
+/**
+ * @brief       Get the version of this library, @ref TC_API_VERSION
+ */
+dllexport int32_t tc_get_api_version(void);
+
+/**
+ * @brief       Get the thermal image resolution of an R-JPEG in memory
+ *
+ * @param[in]   data                R-JPEG binary data buffer pointer
+ * @param[in]   size                R-JPEG binary data buffer size in bytes
+ * @param[out]  width               Horizontal size
+ * @param[out]  height              Vertical size
+ * @return      int                 return code @ref dirp_ret_code_e
+ */
+dllexport int32_t tc_get_resolution(const uint8_t *data, int32_t size, int32_t *width, int32_t *height);
+
+/**
+ * @brief       Read resolution, versions and camera model from the APP segments of an R-JPEG in memory
+ * @details     No DIRP handle is created and the thermal data is not decoded.
+ *
+ * @param[in]   data                R-JPEG binary data buffer pointer, the JPEG header is enough
+ * @param[in]   size                R-JPEG binary data buffer size in bytes
+ * @param[out]  info                R-JPEG header information
+ * @return      int                 return code @ref dirp_ret_code_e
+ */
+dllexport int32_t tc_probe_buffer(const uint8_t *data, int32_t size, tc_probe_info_t *info);
+
+/**
+ * @brief       Same as @ref tc_probe_buffer reading only the first few KB of a file
+ */
+dllexport int32_t tc_probe_file(const char *path, tc_probe_info_t *info);
+
+/**
+ * @brief       Measure the whole thermal image of an R-JPEG in memory
+ * @details     Each FLOAT32 pixel of temp_image is the temperature in Celsius, row major.
+ *              If temp_image is smaller than width * height * 4 bytes, DIRP_ERROR_SIZE is returned
+ *              and width / height are still filled in, so the caller can allocate and retry.
+ *
+ * @param[in]   data                R-JPEG binary data buffer pointer
+ * @param[in]   size                R-JPEG binary data buffer size in bytes
+ * @param[in]   params              Measurement parameters, may be NULL to use the R-JPEG values
+ * @param[out]  temp_image          Caller provided temperature buffer
+ * @param[in]   temp_size           Temperature buffer size in bytes
+ * @param[out]  width               Horizontal size, may be NULL
+ * @param[out]  height              Vertical size, may be NULL
+ * @return      int                 return code @ref dirp_ret_code_e
+ */
+dllexport int32_t tc_measure_buffer(const uint8_t *data, int32_t size, const tc_measure_params_t *params,
+                                    float *temp_image, int32_t temp_size, int32_t *width, int32_t *height);
+
+/**
+ * @brief       Same as @ref tc_measure_buffer with the R-JPEG read from a file path
+ */
+dllexport int32_t tc_measure_file(const char *path, const tc_measure_params_t *params,
+                                  float *temp_image, int32_t temp_size, int32_t *width, int32_t *height);
+
+/**
+ * @brief       Measure a list of R-JPEG files on an internal thread pool
+ * @details     File i is measured into temp_images[i], which holds temp_size bytes.
+ *              The per file return code is stored in results[i].
+ *              Files are measured side by side, only XT S and girp files take turns, see dirp_vendor_lock.h.
+ *
+ * @param[in]   paths               R-JPEG file paths
+ * @param[in]   count               Number of paths
+ * @param[in]   params              Measurement parameters shared by all files, may be NULL
+ * @param[out]  temp_images         Caller provided temperature buffers, one per path
+ * @param[in]   temp_size           Size of each temperature buffer in bytes
+ * @param[out]  widths              Horizontal size per file, may be NULL
+ * @param[out]  heights             Vertical size per file, may be NULL
+ * @param[out]  results             Return code per file, may be NULL
+ * @param[in]   threads             Worker thread count, zero or negative for one per CPU core
+ * @return      int                 Number of failed files, or a negative @ref dirp_ret_code_e on invalid input
+ */
+dllexport int32_t tc_measure_batch(const char *const *paths, int32_t count, const tc_measure_params_t *params,
+                                   float *const *temp_images, int32_t temp_size,
+                                   int32_t *widths, int32_t *heights, int32_t *results, int32_t threads);
+
+/**
+ * @brief       Measure an R-JPEG file and save the temperature as a FLOAT32 TIFF file
+ * @details     The GPS IFD of the R-JPEG EXIF is copied into the TIFF, the JPEG image itself is not decoded.
+ *
+ * @param[in]   path                R-JPEG file path
+ * @param[in]   tiff_path           Output TIFF file path
+ * @param[in]   params              Measurement parameters, may be NULL to use the R-JPEG values
+ * @return      int                 return code @ref dirp_ret_code_e
+ */
+dllexport int32_t tc_convert_file_to_tiff(const char *path, const char *tiff_path, const tc_measure_params_t *params);
+
+/**
+ * @brief       Convert a list of R-JPEG files to FLOAT32 TIFF files on an internal thread pool
+ * @details     Files are converted side by side, only XT S and girp files take turns, see dirp_vendor_lock.h.
+ *
+ * @param[in]   paths               R-JPEG file paths
+ * @param[in]   tiff_paths          Output TIFF file paths, one per path
+ * @param[in]   count               Number of paths
+ * @param[in]   params              Measurement parameters shared by all files, may be NULL
+ * @param[out]  results             Return code per file, may be NULL
+ * @param[in]   threads             Worker thread count, zero or negative for one per CPU core
+ * @return      int                 Number of failed files, or a negative @ref dirp_ret_code_e on invalid input
+ */
+dllexport int32_t tc_convert_batch_to_tiff(const char *const *paths, const char *const *tiff_paths, int32_t count,
+                                           const tc_measure_params_t *params, int32_t *results, int32_t threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _THERMAL_CONVERT_H_ */
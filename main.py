@@ -3,7 +3,11 @@
 # @email: 913737515@qq.com
 
 import os
+import json
 import shutil
+import ctypes
+import socket
+import struct
 import platform
 import subprocess
 import piexif
@@ -19,6 +23,269 @@ def get_platform():
     '''
     return platform.system()
 
+SDK_DIR = "dji_thermal_sdk_v1.4_20220929"
+
+# tc_measure_params_t 中对应字段生效的标志位
+TC_PARAM_FLAGS = {"distance": 1 << 0, "humidity": 1 << 1, "emissivity": 1 << 2, "reflection": 1 << 3}
+
+# 容器帧索引和 dji_irp --serve 回复中的像素类型编号
+FRAME_DTYPES = {1: np.uint8, 2: np.uint16, 3: np.int16, 4: np.float32, 5: np.float16}
+
+# dji_irp --serve 的请求和回复头，见 sample/common/serve_protocol.h
+SERVE_ACTIONS = {"extract": 0, "measure": 1, "process": 2}
+SERVE_REQUEST = struct.Struct("<4sIIIIffffiiI")
+SERVE_REPLY = struct.Struct("<4siIIIIII")
+
+
+# measure() 默认使用的 thermal_convert 动态库，首次调用时加载
+_thermal_convert = None
+
+
+class TcMeasureParams(ctypes.Structure):
+    _fields_ = [("flags", ctypes.c_uint32),
+                ("distance", ctypes.c_float),
+                ("humidity", ctypes.c_float),
+                ("emissivity", ctypes.c_float),
+                ("reflection", ctypes.c_float)]
+
+
+class TcProbeInfo(ctypes.Structure):
+    _fields_ = [("width", ctypes.c_int32),
+                ("height", ctypes.c_int32),
+                ("rjpeg_version", ctypes.c_uint32),
+                ("header_version", ctypes.c_uint32),
+                ("curve_version", ctypes.c_uint32),
+                ("camera_model", ctypes.c_char * 64)]
+
+
+def thermal_convert_path():
+    if get_platform() == "Windows":
+        return os.path.join(SDK_DIR, "sample/bin/windows/release_x64/libthermal_convert.dll")
+    return os.path.join(SDK_DIR, "sample/bin/linux/release_x64/libthermal_convert.so")
+
+
+def load_thermal_convert():
+    '''
+    加载 sample 中编译安装的 thermal_convert 动态库（进程内转换，无需子进程和临时文件）
+    build.bat / build.sh 把动态库和 libdirp 一起安装到 sample/bin/<windows或linux>/release_x64
+    :return: ctypes.CDLL or None(未找到动态库)
+    '''
+    lib_path = thermal_convert_path()
+    if not os.path.exists(lib_path):
+        return None
+
+    lib = ctypes.CDLL(os.path.abspath(lib_path))
+    lib.tc_convert_batch_to_tiff.restype = ctypes.c_int32
+    lib.tc_convert_batch_to_tiff.argtypes = [ctypes.POINTER(ctypes.c_char_p), ctypes.POINTER(ctypes.c_char_p),
+                                             ctypes.c_int32, ctypes.POINTER(TcMeasureParams),
+                                             ctypes.POINTER(ctypes.c_int32), ctypes.c_int32]
+    # ctypes.CDLL 在调用期间释放 GIL，这些函数可以在多个 Python 线程中同时调用
+    lib.tc_probe_buffer.restype = ctypes.c_int32
+    lib.tc_probe_buffer.argtypes = [ctypes.c_char_p, ctypes.c_int32, ctypes.POINTER(TcProbeInfo)]
+    lib.tc_probe_file.restype = ctypes.c_int32
+    lib.tc_probe_file.argtypes = [ctypes.c_char_p, ctypes.POINTER(TcProbeInfo)]
+    float_image = np.ctypeslib.ndpointer(dtype=np.float32, flags="C_CONTIGUOUS")
+    lib.tc_measure_buffer.restype = ctypes.c_int32
+    lib.tc_measure_buffer.argtypes = [ctypes.c_char_p, ctypes.c_int32, ctypes.POINTER(TcMeasureParams), float_image,
+                                      ctypes.c_int32, ctypes.POINTER(ctypes.c_int32), ctypes.POINTER(ctypes.c_int32)]
+    lib.tc_measure_file.restype = ctypes.c_int32
+    lib.tc_measure_file.argtypes = [ctypes.c_char_p, ctypes.POINTER(TcMeasureParams), float_image,
+                                    ctypes.c_int32, ctypes.POINTER(ctypes.c_int32), ctypes.POINTER(ctypes.c_int32)]
+    return lib
+
+
+def measure_params(**kwargs):
+    params = TcMeasureParams()
+    for key, flag in TC_PARAM_FLAGS.items():
+        if key in kwargs:
+            params.flags |= flag
+            setattr(params, key, float(kwargs[key]))
+    return params
+
+
+def measure(rjpeg, lib=None, **kwargs):
+    '''
+    进程内测温，温度由 thermal_convert 动态库直接写入返回的数组，没有临时文件、int16 转换和额外拷贝
+    数组尺寸取自 R-JPEG 头部（与 dirp_get_rjpeg_resolution 相同），测温期间释放 GIL，多个线程可以并行调用
+    :param rjpeg: R-JPEG 文件路径，或已读入内存的 bytes
+    :param lib: load_thermal_convert() 的返回值，为 None 时加载一次后复用
+    :param kwargs: distance, humidity, emissivity, reflection，未给出的沿用 R-JPEG 中的值
+    :return: np.ndarray float32 摄氏度 (height, width)
+    '''
+    global _thermal_convert
+    if lib is None:
+        if _thermal_convert is None:
+            _thermal_convert = load_thermal_convert()
+            if _thermal_convert is None:
+                raise FileNotFoundError(thermal_convert_path() + " not found, run build.sh or build.bat in sample first")
+        lib = _thermal_convert
+
+    params = measure_params(**kwargs)
+    info = TcProbeInfo()
+    width, height = ctypes.c_int32(), ctypes.c_int32()
+    if isinstance(rjpeg, str):
+        path = rjpeg.encode("utf-8")
+        ret = lib.tc_probe_file(path, ctypes.byref(info))
+        call = lambda image: lib.tc_measure_file(path, ctypes.byref(params), image, image.nbytes,
+                                                 ctypes.byref(width), ctypes.byref(height))
+    else:
+        ret = lib.tc_probe_buffer(rjpeg, len(rjpeg), ctypes.byref(info))
+        call = lambda image: lib.tc_measure_buffer(rjpeg, len(rjpeg), ctypes.byref(params), image, image.nbytes,
+                                                   ctypes.byref(width), ctypes.byref(height))
+
+    image = np.empty((info.height, info.width) if ret == 0 else (1, 1), dtype=np.float32)
+    ret = call(image)
+    if ret == -8 and (width.value, height.value) != image.shape[::-1]:
+        # 头部无法解析时 DIRP_ERROR_SIZE 会带回实际尺寸，按此重新分配
+        image = np.empty((height.value, width.value), dtype=np.float32)
+        ret = call(image)
+    if ret != 0:
+        raise RuntimeError(f"Measure {rjpeg if isinstance(rjpeg, str) else 'R-JPEG buffer'} failed with return code {ret}")
+    return image
+
+
+def convert_batch(lib, input_file_path_list, tiff_file_path_list, **kwargs):
+    '''
+    调用 tc_convert_batch_to_tiff 在库内部线程池中批量测温，直接写出 float32 tiff（含原图GPS信息）
+    :return: 失败的文件数
+    '''
+    params = measure_params(**kwargs)
+    count = len(input_file_path_list)
+    paths = (ctypes.c_char_p * count)(*[p.encode("utf-8") for p in input_file_path_list])
+    tiff_paths = (ctypes.c_char_p * count)(*[p.encode("utf-8") for p in tiff_file_path_list])
+    results = (ctypes.c_int32 * count)()
+
+    failed = lib.tc_convert_batch_to_tiff(paths, tiff_paths, count, ctypes.byref(params), results, 0)
+    for i in range(count):
+        if results[i] != 0:
+            print(f"Convert {input_file_path_list[i]} failed with return code {results[i]}")
+    return failed
+
+
+def load_manifest(manifest_path):
+    '''
+    读取 dji_irp_omp 写出的 JSON lines 清单，按清单中的尺寸、类型和偏移映射每个输出文件，无需再解析原始 R-JPEG
+    :param manifest_path: 清单文件路径，如 out.manifest.jsonl
+    :return: dict, 原始文件路径 -> np.memmap (height, width) 或 (height, width, channels)
+    '''
+    entries = {}
+    with open(manifest_path, "r", encoding="utf-8") as f:
+        for line in f:
+            entry = json.loads(line)
+            entries[entry["source"]] = entry  # 续跑追加的清单中，同一原图以最后一行为准
+
+    outputs = {}
+    for source, entry in entries.items():
+        shape = (entry["height"], entry["width"]) if entry["channels"] == 1 else \
+            (entry["height"], entry["width"], entry["channels"])
+        outputs[source] = np.memmap(entry["output"], dtype=entry["dtype"], mode="r", offset=entry["offset"], shape=shape)
+    return outputs
+
+
+def load_container(container_path):
+    '''
+    读取 dji_irp_omp --container 写出的多帧容器文件，整个文件只映射一次，按帧索引直接定位每一帧
+    :param container_path: 容器文件路径，如 flight.frames
+    :return: list, 按原图编号排序的 dict(source, number, latitude, longitude, altitude, image)，
+             image 为 np.memmap (height, width) 或 (height, width, channels)，无 GPS 的字段为 None
+    '''
+    header_dtype = np.dtype([("magic", "S8"), ("version", "<u4"), ("align", "<u4"), ("frame_count", "<u8"),
+                             ("index_offset", "<u8"), ("names_offset", "<u8"), ("names_size", "<u8")])
+    frame_dtype = np.dtype([("offset", "<u8"), ("size", "<u8"), ("number", "<u4"), ("width", "<u4"),
+                            ("height", "<u4"), ("channels", "<u2"), ("dtype", "<u2"), ("latitude", "<f8"),
+                            ("longitude", "<f8"), ("altitude", "<f8"), ("gps", "<u4"), ("name_offset", "<u4"),
+                            ("name_size", "<u4"), ("reserved", "<u4")])
+    data = np.memmap(container_path, dtype=np.uint8, mode="r")
+    header = data[:header_dtype.itemsize].view(header_dtype)[0]
+    if header["magic"] != b"DJIFRMC1":
+        raise ValueError("%s is not a closed frame container" % container_path)
+    index = data[header["index_offset"]:header["index_offset"] + header["frame_count"] * frame_dtype.itemsize].view(frame_dtype)
+    names = bytes(data[header["names_offset"]:header["names_offset"] + header["names_size"]])
+
+    frames = []
+    for entry in index:
+        shape = (entry["height"], entry["width"]) if entry["channels"] == 1 else \
+            (entry["height"], entry["width"], entry["channels"])
+        pixels = data[entry["offset"]:entry["offset"] + entry["size"]].view(FRAME_DTYPES[int(entry["dtype"])]).reshape(shape)
+        frames.append({
+            "source": names[entry["name_offset"]:entry["name_offset"] + entry["name_size"]].decode("utf-8"),
+            "number": int(entry["number"]),
+            "latitude": float(entry["latitude"]) if entry["gps"] & 1 else None,
+            "longitude": float(entry["longitude"]) if entry["gps"] & 2 else None,
+            "altitude": float(entry["altitude"]) if entry["gps"] & 4 else None,
+            "image": pixels,
+        })
+    return frames
+
+
+def serve_connect(socket_path):
+    '''
+    连接 dji_irp --serve 守护进程，一个连接可以依次发送任意多个请求
+    :param socket_path: 守护进程监听的 Unix 套接字路径，如 /tmp/dji_irp.sock
+    :return: socket.socket
+    '''
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(socket_path)
+    return sock
+
+
+def recv_exact(sock, size):
+    buf = bytearray(size)
+    view = memoryview(buf)
+    received = 0
+    while received < size:
+        count = sock.recv_into(view[received:])
+        if count == 0:
+            raise ConnectionError("dji_irp --serve closed the connection")
+        received += count
+    return buf
+
+
+def serve_request(sock, rjpeg, action="measure", palette=-1, brightness=-1, strech=False, **kwargs):
+    '''
+    把一张 R-JPEG 交给守护进程转换，SDK 在守护进程中只加载一次
+    :param rjpeg: R-JPEG 文件路径，或已读入内存的 bytes
+    :param action: extract, measure 或 process
+    :param kwargs: distance, humidity, emissivity, reflection，未给出的沿用 R-JPEG 中的值
+    :return: np.ndarray，measure 为 float32 摄氏度 (height, width)，extract 为 uint16，
+             process 为 uint8 (height, width, 3)，strech=True 时为 float32
+    '''
+    if isinstance(rjpeg, str):
+        with open(rjpeg, "rb") as f:
+            rjpeg = f.read()
+    params = measure_params(**kwargs)
+    flags = (1 if action == "measure" else 0) | (2 if strech else 0)
+    sock.sendall(SERVE_REQUEST.pack(b"DIRQ", 1, SERVE_ACTIONS[action], flags, params.flags, params.distance,
+                                    params.humidity, params.emissivity, params.reflection, palette, brightness,
+                                    len(rjpeg)))
+    sock.sendall(rjpeg)
+
+    magic, status, width, height, channels, dtype, size, elapsed_us = SERVE_REPLY.unpack(recv_exact(sock, SERVE_REPLY.size))
+    if magic != b"DIRS":
+        raise ConnectionError("unexpected reply from dji_irp --serve")
+    pixels = recv_exact(sock, size)
+    if status != 0:
+        raise RuntimeError(f"dji_irp --serve failed with return code {status}")
+
+    shape = (height, width) if channels == 1 else (height, width, channels)
+    return np.frombuffer(pixels, dtype=FRAME_DTYPES[dtype]).reshape(shape)
+
+
+def save_tiff(img, input_file_path, tiff_file_path):
+    im = Image.fromarray(img)
+    exif_dict = piexif.load(input_file_path)
+    new_exif = {
+        '0th': {},
+        'Exif': {},
+        'GPS': exif_dict['GPS'],
+        'Interop': {},
+        '1st': {},
+        'thumbnail': exif_dict['thumbnail']
+    }
+    exif_bytes = piexif.dump(new_exif)
+    im.save(tiff_file_path, exif=exif_bytes)
+
+
 def mkdir(path):
     '''
     创建指定的文件夹
@@ -133,7 +400,7 @@ the greater the impact.
 
 
 
-def run(input_dir, output_dir, **kwargs):
+def run(input_dir, output_dir, serve_socket=None, **kwargs):
     print_help()
 
     temp_dir = "temp_dir"
@@ -152,32 +419,39 @@ def run(input_dir, output_dir, **kwargs):
         raise ValueError(f"Program detect 0 raw files in {input_dir}.")
     # ----------------- convert jpg to tiff -----------------
     print(f"Start to convert..")
-    for input_file_path in tqdm(input_file_path_list):
-        img_name = os.path.basename(input_file_path)
-        raw_file_path = os.path.join(temp_dir, img_name.split(".")[0]+".raw")
-        tiff_file_path = os.path.join(
-            output_dir, img_name.split(".")[0] + ".tiff")
-        psReturn = jpg2tiff(input_file_path, raw_file_path, **kwargs)
-
-        # get rows and cols in jpg file
-        image = Image.open(input_file_path)
-        width, height = image.size
-        cols, rows = width, height
-        img = np.fromfile(raw_file_path, dtype='int16')
-        img = img / 10 # raw存储的温度值是实际的10倍
-        img = img.reshape(rows, cols)
-        im = Image.fromarray(img)
-        exif_dict = piexif.load(input_file_path)
-        new_exif = {
-            '0th': {},
-            'Exif': {},
-            'GPS': exif_dict['GPS'],
-            'Interop': {},
-            '1st': {},
-            'thumbnail': exif_dict['thumbnail']
-        }
-        exif_bytes = piexif.dump(new_exif)
-        im.save(tiff_file_path, exif=exif_bytes)
+    lib = load_thermal_convert() if serve_socket is None else None
+    if serve_socket is not None:
+        # 由常驻的 dji_irp --serve 转换，省去每张图的进程启动和 SDK 加载
+        sock = serve_connect(serve_socket)
+        for input_file_path in tqdm(input_file_path_list):
+            img_name = os.path.basename(input_file_path)
+            tiff_file_path = os.path.join(output_dir, img_name.split(".")[0] + ".tiff")
+            img = serve_request(sock, input_file_path, **kwargs)
+            save_tiff(img, input_file_path, tiff_file_path)
+        sock.close()
+    elif lib is not None:
+        # 进程内批量转换，tiff由动态库直接写出
+        batch_size = 64
+        for start in tqdm(range(0, len(input_file_path_list), batch_size)):
+            batch = input_file_path_list[start:start + batch_size]
+            tiff_batch = [os.path.join(output_dir, os.path.basename(p).split(".")[0] + ".tiff") for p in batch]
+            convert_batch(lib, batch, tiff_batch, **kwargs)
+    else:
+        for input_file_path in tqdm(input_file_path_list):
+            img_name = os.path.basename(input_file_path)
+            raw_file_path = os.path.join(temp_dir, img_name.split(".")[0]+".raw")
+            tiff_file_path = os.path.join(
+                output_dir, img_name.split(".")[0] + ".tiff")
+            psReturn = jpg2tiff(input_file_path, raw_file_path, **kwargs)
+
+            # get rows and cols in jpg file
+            image = Image.open(input_file_path)
+            width, height = image.size
+            cols, rows = width, height
+            img = np.fromfile(raw_file_path, dtype='int16')
+            img = img / 10 # raw存储的温度值是实际的10倍
+            img = img.reshape(rows, cols)
+            save_tiff(img, input_file_path, tiff_file_path)
 
     print(f"Program convert {len(input_file_path_list)} raw files to tiff files in {output_dir}.")
     shutil.rmtree(temp_dir)